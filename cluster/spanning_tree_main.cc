@@ -3,7 +3,7 @@ Copyright (c) 2011 Yahoo! Inc.  All rights reserved.  The copyrights
 embodied in the content of this file are licensed under the BSD
 (revised) open source license
 
-This creates a binary tree topology over a set of n nodes that connect.
+This creates a binary tree topology, and a ring through it, over a set of n nodes that connect.
 
  */
 
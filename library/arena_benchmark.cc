@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/gd.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// resident memory of the process in MB, 0 where it's not known
+double resident_mb()
+{
+#ifndef _WIN32
+  ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  if (statm >> pages >> resident)
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+#endif
+  return 0.;
+}
+
+double peak_resident_mb()
+{
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss / 1024.;
+#endif
+  return 0.;
+}
+
+inline void dot(float& sum, float x, float& w) { sum += x * w; }
+
+// Parses the lines of a data set into examples which are all kept, as by a learner holding a minibatch
+// or a cache of examples, and reports the memory their features use. Then times passes of foreach_feature over
+// their features, whose storage is where the parser put it, and parsing them again into the same
+// examples, which reuses it.
+// usage: arena_benchmark [data [copies [passes ["vw arguments"]]]]
+int main(int argc, char *argv[])
+{ string data = argc > 1 ? argv[1] : "../test/train-sets/rcv1_small.dat";
+  size_t copies = argc > 2 ? atol(argv[2]) : 50;
+  size_t passes = argc > 3 ? atol(argv[3]) : 20;
+  string args = argc > 4 ? argv[4] : "";
+
+  vector<string> lines;
+  ifstream in(data.c_str());
+  for (string line; getline(in, line);)
+    lines.push_back(line);
+  if (lines.empty())
+  { printf("%s: no lines read\n", data.c_str());
+    return 1;
+  }
+
+  vw* model = VW::initialize(args + " --quiet --no_stdin");
+  size_t count = lines.size() * copies;
+  example* examples = VW::alloc_examples(model->p->lp.label_size, count);
+  volatile char* bytes = (volatile char*)examples; // the pages of the examples themselves, before parsing
+  for (size_t b = 0; b < count * sizeof(example); b += 4096)
+    bytes[b] = bytes[b];
+  double before = resident_mb();
+  vector<char> buffer;
+  size_t features = 0;
+  auto parse = [&]()
+  { features = 0;
+    for (size_t i = 0; i < count; i++)
+    { example& ec = examples[i];
+      string& line = lines[i % lines.size()];
+      buffer.assign(line.begin(), line.end());
+      buffer.push_back('\0');
+      VW::read_line(*model, &ec, buffer.data());
+      VW::setup_example(*model, &ec);
+      features += ec.num_features;
+    }
+  };
+
+  auto start = high_resolution_clock::now();
+  parse();
+  double first_parse = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+  double parsed = resident_mb();
+
+  float sum = 0.;
+  start = high_resolution_clock::now();
+  for (size_t p = 0; p < passes; p++)
+    for (size_t i = 0; i < count; i++)
+      GD::foreach_feature<float, dot>(*model, examples[i], sum);
+  double iterate = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+
+  start = high_resolution_clock::now();
+  for (size_t p = 0; p < passes; p++)
+  { for (size_t i = 0; i < count; i++)
+    { model->p->lp.default_label(&examples[i].l);
+      VW::empty_example(*model, examples[i]);
+    }
+    parse();
+  }
+  double reparse = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+
+  printf("data = %s, %zu examples kept, %.1f features per example (%f)\n", data.c_str(), count,
+         (double)features / count, sum);
+  printf("memory of the features  %8.1f MB, %6.1f bytes per feature, peak resident %.1f MB\n", parsed - before,
+         (parsed - before) * (1 << 20) / features, peak_resident_mb());
+  printf("first parse             %8.3f s, %10.0f examples/s\n", first_parse, count / first_parse);
+  printf("foreach_feature         %8.3f s, %10.1f M features/s\n", iterate, features * passes / iterate / 1e6);
+  printf("parsing again           %8.3f s, %10.0f examples/s\n", reparse, count * passes / reparse);
+
+  for (size_t i = 0; i < count; i++)
+    VW::dealloc_example(model->p->lp.delete_label, examples[i]);
+  free(examples);
+  VW::finish(*model);
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct run_result
+{ double seconds;
+  double examples;
+  double average_loss;
+};
+
+run_result learn(const string& args)
+{ vw* all = VW::initialize(args + " --quiet");
+  auto start = high_resolution_clock::now();
+  VW::start_parser(*all);
+  LEARNER::generic_driver(*all);
+  VW::end_parser(*all);
+  run_result r;
+  r.seconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e6;
+  shared_data& sd = *all->sd;
+  r.examples = sd.weighted_labeled_examples;
+  r.average_loss = sd.weighted_labeled_examples > 0 ? sd.sum_loss / sd.weighted_labeled_examples : 0.;
+  VW::finish(*all);
+  return r;
+}
+
+// Times the iterations of --bfgs with 1, 2, 4, .. --weight_threads. With few examples and many bits the
+// passes over the data are short and an iteration is mostly the sweeps over the weights and the history of
+// --mem vectors. The losses are the same with any number of threads.
+// usage: bfgs_benchmark [data [bits [mem [passes [max_threads ["vw arguments"]]]]]]
+int main(int argc, char *argv[])
+{ string data = argc > 1 ? argv[1] : "../test/train-sets/rcv1_small.dat";
+  size_t bits = argc > 2 ? atol(argv[2]) : 24;
+  size_t mem = argc > 3 ? atol(argv[3]) : 15;
+  size_t passes = argc > 4 ? atol(argv[4]) : 12;
+  size_t max_threads = argc > 5 ? atol(argv[5]) : max(4u, thread::hardware_concurrency());
+  string args = argc > 6 ? argv[6] : "--l2 1e-6 --loss_function logistic";
+
+  stringstream common;
+  common << args << " -d " << data << " -c --holdout_off";
+  double examples = learn(common.str()).examples; // of a pass, writing the cache that every run reads
+  common << " --bfgs -b " << bits << " --mem " << mem << " --passes " << passes;
+
+  printf("data = %s, bits = %zu, mem = %zu, hardware threads = %u\n", data.c_str(), bits, mem, thread::hardware_concurrency());
+  printf("threads  passes  seconds/pass  speedup  average loss\n");
+  double single = 0.;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2)
+  { stringstream run;
+    run << common.str() << " --weight_threads " << threads;
+    run_result r = learn(run.str());
+    double passes_done = r.examples / examples; // fewer than asked for if bfgs converged
+    double per_pass = r.seconds / passes_done;
+    if (threads == 1)
+      single = per_pass;
+    printf("%7zu %7.0f %13.3f %8.2f %13.6f\n", threads, passes_done, per_pass, single / per_pass, r.average_loss);
+  }
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <sstream>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// synthetic multiclass examples with features_per_namespace features in each of the namespaces a, b and c
+example* read_examples(vw* model, size_t count, size_t features_per_namespace, size_t classes)
+{ example* ecs = VW::alloc_examples(model->p->lp.label_size, count);
+  uint64_t seed = 42;
+  for (size_t i = 0; i < count; i++)
+  { stringstream line;
+    line << 1 + i % classes;
+    for (char ns = 'a'; ns <= 'c'; ns++)
+    { line << " |" << ns;
+      for (size_t j = 0; j < features_per_namespace; j++)
+      { seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        line << " " << ns << (seed >> 33) % 1000;
+      }
+    }
+    VW::read_line(*model, &ecs[i], (char*)line.str().c_str());
+    VW::setup_example(*model, &ecs[i]);
+  }
+  return ecs;
+}
+
+// learns passes over the examples, returns the time per example in microseconds and the sum of the predictions
+double learn(const string& args, size_t num_examples, size_t features_per_namespace, size_t classes, size_t passes,
+             double& prediction_sum)
+{ vw* model = VW::initialize(args);
+  example* ecs = read_examples(model, num_examples, features_per_namespace, classes);
+  prediction_sum = 0.;
+  auto start = high_resolution_clock::now();
+  for (size_t pass = 0; pass < passes; pass++)
+    for (size_t i = 0; i < num_examples; i++)
+    { model->learn(&ecs[i]);
+      prediction_sum += ecs[i].pred.multiclass;
+    }
+  double us = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1000.;
+  for (size_t i = 0; i < num_examples; i++)
+    VW::dealloc_example(model->p->lp.delete_label, ecs[i]);
+  free(ecs);
+  VW::finish(*model);
+  return us / (num_examples * passes);
+}
+
+// Compares learning --oaa with quadratic and cubic interactions with and without --interaction_cache.
+// usage: interaction_cache_benchmark [num_examples [features_per_namespace [classes [passes ["vw arguments"]]]]]
+int main(int argc, char *argv[])
+{ size_t num_examples = argc > 1 ? atol(argv[1]) : 2000;
+  size_t features_per_namespace = argc > 2 ? atol(argv[2]) : 10;
+  size_t classes = argc > 3 ? atol(argv[3]) : 10;
+  size_t passes = argc > 4 ? atol(argv[4]) : 3;
+  string args = argc > 5 ? argv[5] : "-b 22 -q ab -q bc --cubic abc";
+  stringstream common;
+  common << args << " --oaa " << classes << " --quiet --no_stdin";
+
+  printf("examples = %zu, features per namespace = %zu, classes = %zu, passes = %zu, %s\n", num_examples,
+         features_per_namespace, classes, passes, args.c_str());
+  double expanded_sum, cached_sum;
+  double expanded = learn(common.str(), num_examples, features_per_namespace, classes, passes, expanded_sum);
+  printf("expanded: %8.1f us per example\n", expanded);
+  double cached = learn(common.str() + " --interaction_cache", num_examples, features_per_namespace, classes, passes,
+                        cached_sum);
+  printf("cached:   %8.1f us per example, %.2fx\n", cached, expanded / cached);
+  if (expanded_sum != cached_sum)
+    printf("error: cached interactions predict differently\n");
+  return expanded_sum != cached_sum;
+}
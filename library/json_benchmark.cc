@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/parse_example_json.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct example_pool
+{ example* examples;
+  size_t size;
+  size_t used;
+};
+
+example& next_example(void* context)
+{ example_pool& pool = *(example_pool*)context;
+  if (pool.used == pool.size)
+  { fprintf(stderr, "more than %zu examples in a line\n", pool.size);
+    exit(1);
+  }
+  return pool.examples[pool.used++];
+}
+
+// Parses the lines of a JSON data set into examples and reports the parsing speed. The file is read
+// by vw to set up the JSON parser, the lines are parsed from memory.
+// usage: json_benchmark [repetitions [data ["vw arguments"]]]
+int main(int argc, char *argv[])
+{ size_t repetitions = argc > 1 ? atol(argv[1]) : 200;
+  string file = argc > 2 ? argv[2] : "../test/train-sets/decisionservice.json";
+  string args = argc > 3 ? argv[3] : "--dsjson --cb_explore_adf";
+  vw* model = VW::initialize("-d " + file + " " + args + " --quiet");
+  bool decision_service = model->p->decision_service_json;
+
+  vector<string> lines;
+  ifstream in(file.c_str());
+  size_t bytes = 0;
+  for (string line; getline(in, line);)
+  { bytes += line.size() + 1;
+    lines.push_back(line);
+  }
+  if (lines.empty())
+  { printf("%s: no lines read\n", file.c_str());
+    return 1;
+  }
+
+  example_pool pool;
+  pool.size = 1024;
+  pool.examples = VW::alloc_examples(model->p->lp.label_size, pool.size);
+  pool.used = 0;
+  v_array<example*> examples = v_init<example*>();
+
+  vector<char> buffer;
+  size_t example_count = 0;
+  auto start = high_resolution_clock::now();
+  for (size_t r = 0; r < repetitions; r++)
+    for (string& line : lines)
+    { buffer.assign(line.begin(), line.end());
+      buffer.push_back('\0');
+      examples.erase();
+      examples.push_back(&next_example(&pool));
+      if (decision_service)
+      { DecisionServiceInteraction interaction;
+        VW::read_line_decision_service_json<false>(*model, examples, buffer.data(), line.size(), false, next_example, &pool, &interaction);
+      }
+      else
+        VW::read_line_json<false>(*model, examples, buffer.data(), next_example, &pool);
+      example_count += examples.size();
+      for (size_t i = 0; i < pool.used; i++)
+      { model->p->lp.default_label(&pool.examples[i].l);
+        VW::empty_example(*model, pool.examples[i]);
+      }
+      pool.used = 0;
+    }
+  double seconds = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+  printf("%s: %zu lines, %.1f examples per line, %8.1f MB/s, %10.0f lines/s\n", file.c_str(), lines.size(),
+         (double)example_count / (lines.size() * repetitions), bytes * repetitions / seconds / 1e6,
+         lines.size() * repetitions / seconds);
+
+  examples.delete_v();
+  for (size_t i = 0; i < pool.size; i++)
+    VW::dealloc_example(model->p->lp.delete_label, pool.examples[i]);
+  free(pool.examples);
+  VW::finish(*model);
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct run_result
+{ double seconds;
+  double examples;
+  double average_loss; // progressive validation loss of the passes
+  double holdout_loss; // best of the passes
+};
+
+run_result learn(const string& args)
+{ vw* all = VW::initialize(args + " --quiet");
+  auto start = high_resolution_clock::now();
+  VW::start_parser(*all);
+  LEARNER::generic_driver(*all);
+  VW::end_parser(*all);
+  run_result r;
+  r.seconds = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1e6;
+  shared_data& sd = *all->sd;
+  r.examples = sd.weighted_examples() + sd.weighted_holdout_examples;
+  r.average_loss = sd.weighted_labeled_examples > 0 ? sd.sum_loss / sd.weighted_labeled_examples : 0.;
+  r.holdout_loss = sd.holdout_best_loss;
+  VW::finish(*all);
+  return r;
+}
+
+// Learns a data set with 1, 2, 4, .. --learner_threads and compares the speed and the losses reached.
+// usage: learner_threads_benchmark [data [passes [max_threads ["vw arguments"]]]]
+int main(int argc, char *argv[])
+{ string data = argc > 1 ? argv[1] : "../test/train-sets/rcv1_small.dat";
+  size_t passes = argc > 2 ? atol(argv[2]) : 10;
+  size_t max_threads = argc > 3 ? atol(argv[3]) : max(4u, thread::hardware_concurrency());
+  string args = argc > 4 ? argv[4] : "-b 20";
+
+  stringstream common;
+  common << args << " -d " << data << " -c --holdout_period 10";
+  learn(common.str()); // writes the cache, so that every run reads it
+  common << " --passes " << passes << " --early_terminate " << passes;
+
+  printf("data = %s, passes = %zu, hardware threads = %u\n", data.c_str(), passes, thread::hardware_concurrency());
+  printf("threads    seconds   examples/s  speedup  average loss  holdout loss\n");
+  double single = 0.;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2)
+  { stringstream run;
+    run << common.str() << " --learner_threads " << threads;
+    run_result r = learn(run.str());
+    if (threads == 1)
+      single = r.seconds;
+    printf("%7zu %10.3f %12.0f %8.2f %13.6f %13.6f\n", threads, r.seconds, r.examples / r.seconds,
+           single / r.seconds, r.average_loss, r.holdout_loss);
+  }
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Parses the lines of text format data sets into examples, as the parse thread does, and reports the
+// parsing speed. Hashing and tokenizing are timed, not reading the file.
+// usage: parse_benchmark [repetitions ["vw arguments" [data ...]]]
+int main(int argc, char *argv[])
+{ size_t repetitions = argc > 1 ? atol(argv[1]) : 20;
+  string args = argc > 2 ? argv[2] : "";
+  vector<string> files;
+  for (int i = 3; i < argc; i++)
+    files.push_back(argv[i]);
+  if (files.empty())
+  { files.push_back("../test/train-sets/rcv1_small.dat");
+    files.push_back("../test/train-sets/0001.dat");
+    files.push_back("../test/train-sets/wiki256.dat");
+  }
+  vw* model = VW::initialize(args + " --quiet --no_stdin");
+  example* ec = VW::alloc_examples(model->p->lp.label_size, 1);
+
+  for (string& file : files)
+  { vector<string> lines;
+    ifstream in(file.c_str());
+    size_t bytes = 0;
+    for (string line; getline(in, line);)
+    { bytes += line.size() + 1;
+      lines.push_back(line);
+    }
+    if (lines.empty())
+    { printf("%s: no lines read\n", file.c_str());
+      continue;
+    }
+
+    vector<char> buffer;
+    size_t feature_count = 0;
+    auto start = high_resolution_clock::now();
+    for (size_t r = 0; r < repetitions; r++)
+      for (string& line : lines)
+      { buffer.assign(line.begin(), line.end());
+        buffer.push_back('\0');
+        VW::read_line(*model, ec, buffer.data());
+        for (features& fs : *ec)
+          feature_count += fs.size();
+        model->p->lp.default_label(&ec->l);
+        VW::empty_example(*model, *ec);
+      }
+    double seconds = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+    printf("%s: %zu examples, %.1f features per example, %8.1f MB/s, %10.0f examples/s\n", file.c_str(),
+           lines.size(), (double)feature_count / (lines.size() * repetitions), bytes * repetitions / seconds / 1e6,
+           lines.size() * repetitions / seconds);
+  }
+
+  VW::dealloc_example(model->p->lp.delete_label, *ec);
+  free(ec);
+  VW::finish(*model);
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <sstream>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+uint64_t seed = 42;
+uint64_t next_random()
+{ seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return seed >> 33;
+}
+
+// a synthetic extreme multilabel example: 1 to 3 labels with a power law distribution, each with a feature
+// of its own and of its group of 100 and 1000 labels, and 10 noise features
+string synthetic_example(size_t labels)
+{ stringstream line, features;
+  size_t count = 1 + next_random() % 3;
+  for (size_t i = 0; i < count; i++)
+  { double u = (next_random() % 1000000) / 1000000.;
+    size_t label = (size_t)(labels * u * u * u * u);
+    line << (i > 0 ? "," : "") << label;
+    features << " l" << label << " g" << label / 100 << " h" << label / 1000;
+  }
+  for (size_t i = 0; i < 10; i++)
+    features << " n" << next_random() % 100000;
+  line << " |" << features.str();
+  return line.str();
+}
+
+// examples parsed outside of the example ring
+example* read_examples(vw* model, size_t count, size_t labels)
+{ example* ecs = VW::alloc_examples(model->p->lp.label_size, count);
+  for (size_t i = 0; i < count; i++)
+  { VW::read_line(*model, &ecs[i], (char*)synthetic_example(labels).c_str());
+    VW::setup_example(*model, &ecs[i]);
+  }
+  return ecs;
+}
+
+void free_examples(vw* model, example* ecs, size_t count)
+{ for (size_t i = 0; i < count; i++)
+    VW::dealloc_example(model->p->lp.delete_label, ecs[i], model->delete_prediction);
+  free(ecs);
+}
+
+// Learns a probabilistic label tree on synthetic extreme multilabel data, then times top_k and threshold
+// predictions.
+// usage: plt_benchmark [labels [train_examples [test_examples [top_k [threshold ["vw arguments"]]]]]]
+int main(int argc, char *argv[])
+{ size_t labels = argc > 1 ? atol(argv[1]) : 100000;
+  size_t train_examples = argc > 2 ? atol(argv[2]) : 50000;
+  size_t test_examples = argc > 3 ? atol(argv[3]) : 5000;
+  size_t top_k = argc > 4 ? atol(argv[4]) : 5;
+  float threshold = argc > 5 ? (float)atof(argv[5]) : 0.05f;
+  string args = argc > 6 ? argv[6] : "-b 24";
+
+  stringstream plt_args;
+  plt_args << args << " --plt " << labels << " --quiet --no_stdin";
+  vw* trainer = VW::initialize(plt_args.str());
+  example* train = read_examples(trainer, train_examples, labels);
+  auto start = high_resolution_clock::now();
+  for (size_t i = 0; i < train_examples; i++)
+    trainer->learn(&train[i]);
+  double learn_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+  free_examples(trainer, train, train_examples);
+  VW::save_predictor(*trainer, "plt_benchmark.model");
+  VW::finish(*trainer);
+  printf("labels = %zu, train examples = %zu, test examples = %zu\n", labels, train_examples, test_examples);
+  printf("learn:     %10.1f us per example\n", learn_ns / train_examples / 1000.);
+
+  stringstream top_k_args, threshold_args;
+  top_k_args << "-t -i plt_benchmark.model --top_k " << top_k << " --quiet --no_stdin";
+  threshold_args << "-t -i plt_benchmark.model --threshold " << threshold << " --quiet --no_stdin";
+  string predict_args[] = { top_k_args.str(), threshold_args.str() };
+  const char* names[] = { "top_k:", "threshold:" };
+  for (size_t m = 0; m < 2; m++)
+  { vw* model = VW::initialize(predict_args[m]);
+    seed = 4242;
+    example* test = read_examples(model, test_examples, labels);
+    start = high_resolution_clock::now();
+    size_t predicted = 0;
+    for (size_t i = 0; i < test_examples; i++)
+    { model->l->predict(test[i]);
+      predicted += test[i].pred.multilabels.label_v.size();
+    }
+    double predict_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+    free_examples(model, test, test_examples);
+    printf("%-10s %10.1f us per example, %.2f labels predicted per example\n", names[m],
+           predict_ns / test_examples / 1000., predicted / (double)test_examples);
+    VW::finish(*model);
+  }
+  remove("plt_benchmark.model");
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <sstream>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Compares one learner::predict call per example with VW::predict_batch on the same examples.
+// usage: predict_batch_benchmark [num_examples [batch_size [repetitions ["vw arguments"]]]]
+int main(int argc, char *argv[])
+{ size_t num_examples = argc > 1 ? atol(argv[1]) : 100000;
+  size_t batch_size = argc > 2 ? atol(argv[2]) : 64;
+  size_t repetitions = argc > 3 ? atol(argv[3]) : 10;
+  string args = argc > 4 ? argv[4] : "-b 22";
+  vw* model = VW::initialize(args + " --quiet --no_stdin");
+
+  // synthetic examples with 20 features drawn from a million, allocated outside of the example ring
+  example* ecs = VW::alloc_examples(sizeof(label_data), num_examples);
+  v_array<example*> batch = v_init<example*>();
+  uint64_t seed = 42;
+  for (size_t i = 0; i < num_examples; i++)
+  { stringstream line;
+    line << (i % 2 ? "1" : "-1") << " |f";
+    for (size_t j = 0; j < 20; j++)
+    { seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+      line << " w" << (seed >> 33) % 1000000;
+    }
+    VW::read_line(*model, &ecs[i], (char*)line.str().c_str());
+    VW::setup_example(*model, &ecs[i]);
+    model->learn(&ecs[i]);
+    batch.push_back(&ecs[i]);
+  }
+
+  double single_sum = 0.;
+  auto start = high_resolution_clock::now();
+  for (size_t r = 0; r < repetitions; r++)
+    for (size_t i = 0; i < num_examples; i++)
+    { model->l->predict(ecs[i]);
+      single_sum += ecs[i].pred.scalar;
+    }
+  double single_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+
+  double batch_sum = 0.;
+  start = high_resolution_clock::now();
+  for (size_t r = 0; r < repetitions; r++)
+    for (size_t i = 0; i < num_examples; i += batch_size)
+    { size_t count = min(batch_size, num_examples - i);
+      VW::predict_batch(*model, batch.begin() + i, count);
+      for (size_t j = i; j < i + count; j++)
+        batch_sum += ecs[j].pred.scalar;
+    }
+  double batch_ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+
+  double predictions = (double)num_examples * repetitions;
+  printf("examples = %zu, batch size = %zu, repetitions = %zu\n", num_examples, batch_size, repetitions);
+  printf("single:  %8.1f ns per example, %10.0f examples/s\n", single_ns / predictions, predictions * 1e9 / single_ns);
+  printf("batched: %8.1f ns per example, %10.0f examples/s, %8.1f us per batch\n", batch_ns / predictions,
+         predictions * 1e9 / batch_ns, batch_ns / predictions * batch_size / 1000.);
+  if (single_sum != batch_sum)
+    printf("error: batched predictions differ from single predictions\n");
+
+  for (size_t i = 0; i < num_examples; i++)
+    VW::dealloc_example(model->p->lp.delete_label, ecs[i]);
+  free(ecs);
+  batch.delete_v();
+  VW::finish(*model);
+  return single_sum != batch_sum;
+}
@@ -188,6 +188,18 @@ float my_predict(vw_ptr all, example_ptr ec)
   return ec->partial_prediction;
 }
 
+py::list my_predict_batch(vw_ptr all, py::list examples)
+{ vector<example*> ecs;
+  for (ssize_t i=0; i<len(examples); i++)
+    ecs.push_back(py::extract<example_ptr>(examples[i])().get());
+  VW::predict_batch(*all, ecs.data(), ecs.size());
+
+  py::list values;
+  for (example* ec : ecs)
+    values.append(ec->partial_prediction);
+  return values;
+}
+
 float my_predict_string(vw_ptr all, char*str)
 { example*ec = VW::read_example(*all, str);
   all->l->predict(*ec);
@@ -670,6 +682,7 @@ BOOST_PYTHON_MODULE(pylibvw)
   .def("learn", &my_learn, "given a pyvw example, learn (and predict) on that example")
   .def("learn_string", &my_learn_string, "given an example specified as a string (as in a VW data file), learn on that example")
   .def("predict", &my_predict, "given a pyvw example, predict on that example")
+  .def("predict_batch", &my_predict_batch, "given a list of pyvw examples, predict on all of them with one call")
   .def("predict_string", &my_predict_string, "given an example specified as a string (as in a VW data file), predict on that example")
   .def("hash_space", &VW::hash_space, "given a namespace (as a string), compute the hash of that namespace")
   .def("hash_feature", &VW::hash_feature, "given a feature string (arg2) and a hashed namespace (arg3), hash that feature")
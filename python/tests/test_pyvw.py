@@ -47,6 +47,15 @@ def test_delete():
     assert 'model' not in locals()
 
 
+def test_predict_batch():
+    model = vw(quiet=True, b=BIT_SIZE)
+    model.learn('1 | a b c')
+    model.learn('-1 | d e')
+    lines = ['| a b c', '| d e', '| a e', '| f']
+    assert model.predict_batch(lines) == [model.predict(l) for l in lines]
+    model.finish()
+
+
 # Test prediction types
 
 def test_scalar_prediction_type():
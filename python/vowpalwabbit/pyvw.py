@@ -118,6 +118,38 @@ class vw(pylibvw.vw):
             ec.setup_example()
         pylibvw.vw.predict(self, ec)
 
+        prediction = self._get_prediction(ec, prediction_type)
+
+        if new_example:
+            ec.finish()
+
+        return prediction
+
+    def predict_batch(self, examples, prediction_type=None):
+        """Make predictions for a list of examples with a single call into
+        VW; the elements can be example objects or strings, as for predict.
+        Returns the list of predictions in the same order."""
+
+        ecs = []
+        new_examples = []
+        for ec in examples:
+            if isinstance(ec, (str, dict)):
+                ec = self.example(ec)
+                ec.setup_done = True
+                new_examples.append(ec)
+            if not getattr(ec, 'setup_done', True):
+                ec.setup_example()
+            ecs.append(ec)
+
+        pylibvw.vw.predict_batch(self, ecs)
+        predictions = [self._get_prediction(ec, prediction_type) for ec in ecs]
+
+        for ec in new_examples:
+            ec.finish()
+
+        return predictions
+
+    def _get_prediction(self, ec, prediction_type):
         switch_prediction_type = {
             pylibvw.vw.pSCALAR: ec.get_simplelabel_prediction,
             pylibvw.vw.pSCALARS: ec.get_scalars,
@@ -132,12 +164,7 @@ class vw(pylibvw.vw):
         if prediction_type is None:
             prediction_type = pylibvw.vw.get_prediction_type(self)
 
-        prediction = switch_prediction_type[prediction_type]()
-
-        if new_example:
-            ec.finish()
-
-        return prediction
+        return switch_prediction_type[prediction_type]()
 
     def save(self, filename):
         """save model to disk"""
@@ -0,0 +1,152 @@
+#!/bin/bash
+# -- allreduce test: two nodes on localhost averaging their models between
+# passes through a spanning_tree reach the same final loss with every
+# --allreduce_compression as sending floats, and the same model with
+# --sparse_allreduce, which sends only the weights nonzero on some node,
+# and with --allreduce_ring. With -b 20 each chunk of the weights staged for
+# an allreduce is 4MB, large enough to go around the ring. Gathering the
+# chunks in --weight_threads gives the same model as well. Four nodes, where
+# the tree and the ring encode partial sums at more than one hop, reach the
+# loss of floats too, and every node ends with the same model.
+#
+NAME='allreduce-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:cluster:../cluster:${PATH}"
+# The VW under test
+VW=`which vw`
+SPANNING_TREE=`which spanning_tree`
+
+# -- make sure we can find vw and spanning_tree first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+if [ -x "$SPANNING_TREE" ]; then
+    : cool found spanning_tree at: $SPANNING_TREE
+else
+    echo "$NAME: can not find 'spanning_tree' in $PATH - sorry"
+    exit 1
+fi
+
+# relative difference of the losses allowed
+TOLERANCE=0.02
+
+head -n 100 train-sets/0001.dat > $NAME.0.dat
+tail -n 100 train-sets/0001.dat > $NAME.1.dat
+split -l 50 -d -a 1 --additional-suffix=.dat train-sets/0001.dat $NAME.four.
+
+# an already running span server serves the nodes as well
+$SPANNING_TREE --nondaemon > /dev/null 2>&1 &
+SPANNING_TREE_PID=$!
+sleep 1
+
+cleanup() {
+    kill $SPANNING_TREE_PID 2> /dev/null
+    rm -f $NAME.0.dat $NAME.1.dat $NAME.0.cache $NAME.1.cache $NAME.0.stderr $NAME.1.stderr
+    rm -f $NAME.dense.0 $NAME.dense.1 $NAME.sparse.0 $NAME.sparse.1 $NAME.ring.0 $NAME.ring.1
+    rm -f $NAME.threads.0 $NAME.threads.1
+    for node in 0 1 2 3; do
+        rm -f $NAME.four.$node.dat $NAME.four.$node.cache $NAME.$node.stderr $NAME.four.model.$node
+    done
+}
+
+# the final loss of the $NODES nodes (2 by default) reading $DATA.<node>.dat
+# ($NAME by default) run with the options given, saving their models in
+# $MODEL.<node> if it's set
+train() {
+    local id=$RANDOM
+    local nodes=${NODES:-2}
+    local data=${DATA:-$NAME}
+    for node in `seq 0 $((nodes - 1))`; do
+        $VW --total $nodes --node $node --unique_id $id --span_server localhost \
+            -d $data.$node.dat --cache_file $data.$node.cache -k \
+            -b 20 --passes 10 --holdout_off ${MODEL:+-f $MODEL.$node} "$@" > $NAME.$node.stderr 2>&1 &
+    done
+    wait
+    sed -n 's/^average loss = //p' $NAME.0.stderr
+}
+
+# whether the nodes saved the same models in $1 and $2
+same_models() {
+    cmp -s $1.0 $2.0 && cmp -s $1.1 $2.1
+}
+
+# whether the final loss $2 is within the tolerance of the loss $1 of floats,
+# printed for the run $3
+same_loss() {
+    awk -v fp32="$1" -v loss="$2" -v tolerance=$TOLERANCE -v run="$3" 'BEGIN {
+        if (fp32 != "" && loss != "" && (loss - fp32) <= tolerance * fp32 && (fp32 - loss) <= tolerance * fp32)
+            print run ": final loss of fp32"
+        else {
+            print run ": final loss " loss " instead of " fp32
+            exit 1
+        }
+    }'
+}
+
+STATUS=0
+for options in "" "--sgd"; do
+    FP32=`train $options`
+    for codec in fp16 bf16 int8; do
+        LOSS=`train $options --allreduce_compression $codec`
+        same_loss "$FP32" "$LOSS" "$codec${options:+ $options}" || STATUS=1
+    done
+
+    (MODEL=$NAME.dense train $options > /dev/null)
+    (MODEL=$NAME.sparse train $options --sparse_allreduce 0.5 --allreduce_stats > /dev/null)
+    run="sparse${options:+ $options}"
+    if ! grep -q '^allreduce of' $NAME.0.stderr || \
+       grep -q '^allreduce of \([0-9]*\) weights, \1 sent' $NAME.0.stderr; then
+        echo "$run: sent all the weights"
+        STATUS=1
+    elif same_models $NAME.dense $NAME.sparse; then
+        echo "$run: model of dense"
+    else
+        echo "$run: model differs from dense"
+        STATUS=1
+    fi
+
+    (MODEL=$NAME.ring train $options --allreduce_ring > /dev/null)
+    run="ring${options:+ $options}"
+    if ! grep -q '^read ring_position=' $NAME.0.stderr; then
+        echo "$run: no ring set up"
+        STATUS=1
+    elif same_models $NAME.dense $NAME.ring; then
+        echo "$run: model of the tree"
+    else
+        echo "$run: model differs from the tree"
+        STATUS=1
+    fi
+
+    (MODEL=$NAME.threads train $options --weight_threads 3 > /dev/null)
+    run="weight_threads${options:+ $options}"
+    if same_models $NAME.dense $NAME.threads; then
+        echo "$run: model of one thread"
+    else
+        echo "$run: model differs from one thread"
+        STATUS=1
+    fi
+done
+
+# partial sums are encoded again at every hop: at two levels of the tree of
+# four nodes, at three hops around their ring
+export NODES=4 DATA=$NAME.four
+for topology in "" "--allreduce_ring"; do
+    FP32=`train $topology`
+    for codec in bf16 int8; do
+        run="four nodes $codec${topology:+ $topology}"
+        LOSS=`MODEL=$NAME.four.model train $topology --allreduce_compression $codec`
+        same_loss "$FP32" "$LOSS" "$run" || STATUS=1
+        for node in 1 2 3; do
+            if ! cmp -s $NAME.four.model.0 $NAME.four.model.$node; then
+                echo "$run: model of node $node differs from node 0"
+                STATUS=1
+            fi
+        done
+    done
+done
+
+cleanup
+exit $STATUS
@@ -20,6 +20,9 @@ do
         --foreground)
             Foreground="$1"
             ;;
+        --multiplex)
+            Multiplex="$1"
+            ;;
         *)
             echo "$NAME: unknown argument $1"
             exit 1
@@ -61,7 +64,7 @@ fi
 
 
 # A command (+pattern) that is unlikely to match anything but our own test
-DaemonCmd="$VW -t -i $MODEL --daemon $Foreground --num_children 1 --quiet --port $PORT"
+DaemonCmd="$VW -t -i $MODEL --daemon $Foreground $Multiplex --num_children 1 --quiet --port $PORT"
 # libtool may wrap vw with '.libs/lt-vw' so we need to be flexible
 # on the exact process pattern we try to kill.
 DaemonPat=`echo $DaemonCmd | sed 's/^[^ ]*vw /.*vw /'`
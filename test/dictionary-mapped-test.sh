@@ -0,0 +1,41 @@
+#!/bin/bash
+# -- mapped dictionary test: test 67's dictionary compiled with
+# --dictionary_compile in a directory of its own, then mapped, predicts like
+# the text dictionary. The directory is removed afterwards.
+#
+NAME='dictionary-mapped-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+DIR=$NAME.dictionaries
+OPTIONS="-k -d train-sets/dictionary_test.dat --binary --ignore w --holdout_off --dictionary_path $DIR"
+
+cleanup() {
+    rm -rf $DIR $NAME.predict
+}
+
+cleanup
+mkdir $DIR && cp train-sets/dictionary_test.dict $DIR/ || exit 1
+$VW $OPTIONS --dictionary w:dictionary_test.dict --dictionary_compile --quiet || exit 1
+
+STATUS=0
+$VW $OPTIONS --dictionary w:dictionary_test.dict.vwd -p $NAME.predict 2>&1 | grep 'compiled dictionary' || STATUS=1
+if cmp -s $NAME.predict pred-sets/ref/dictionary_test.predict; then
+    echo "predictions of the text dictionary"
+else
+    echo "$NAME: the predictions differ from those of the text dictionary"
+    STATUS=1
+fi
+
+cleanup
+exit $STATUS
@@ -0,0 +1,60 @@
+#!/bin/bash
+# -- learner threads test: a model trained by --learner_threads predicts about
+# as well as the model of one thread, and testing it with --learner_threads,
+# which doesn't update the weights, gives exactly the loss of one thread.
+#
+NAME='learner-threads-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.1.model $NAME.2.model $NAME.4.model
+}
+
+# the final loss of vw run with the options given
+loss() {
+    $VW "$@" 2>&1 | sed -n 's/^average loss = //p'
+}
+
+# the threads learn in any order, the test losses of their models differ by up to 10%
+TOLERANCE=0.2
+DATA="-d train-sets/rcv1_small.dat --holdout_off"
+
+STATUS=0
+loss $DATA -f $NAME.1.model > /dev/null
+SERIAL=`loss -t -i $NAME.1.model $DATA`
+for threads in 2 4; do
+    run="--learner_threads $threads"
+    loss $DATA -f $NAME.$threads.model --learner_threads $threads > /dev/null
+    TESTED=`loss -t -i $NAME.$threads.model $DATA`
+    awk -v serial="$SERIAL" -v loss="$TESTED" -v tolerance=$TOLERANCE -v run="$run" 'BEGIN {
+        number = "^[0-9.e+-]+$"
+        if (serial ~ number && loss ~ number && (loss - serial) <= tolerance * serial && (serial - loss) <= tolerance * serial)
+            print run ": model tested at the loss of the model of one thread"
+        else {
+            print run ": model tested at " loss " instead of " serial
+            exit 1
+        }
+    }' || STATUS=1
+
+    THREADS_TESTED=`loss -t -i $NAME.$threads.model $DATA --learner_threads $threads`
+    if [ -n "$TESTED" ] && [ "$THREADS_TESTED" = "$TESTED" ]; then
+        echo "$run: testing with the threads gives the loss of one thread"
+    else
+        echo "$run: testing with the threads gives $THREADS_TESTED instead of $TESTED"
+        STATUS=1
+    fi
+done
+
+cleanup
+exit $STATUS
@@ -0,0 +1,34 @@
+#!/bin/bash
+# -- plt test: a probabilistic label tree trained on the multilabel set
+# predicts its top 2 labels with --top_k, then the labels it gives a
+# probability over 0.3 with --threshold, each followed by its precision.
+#
+NAME='plt-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.model $NAME.cache $NAME.predict
+}
+
+predict() {
+    echo "$@"
+    $VW -t -d train-sets/multilabel -i $NAME.model -p $NAME.predict "$@" 2>&1 | grep '^P'
+    cat $NAME.predict
+}
+
+cleanup
+$VW -k --plt 10 -d train-sets/multilabel --cache_file $NAME.cache --passes 20 -l 0.5 -f $NAME.model --quiet || exit 1
+predict --top_k 2
+predict --threshold 0.3
+cleanup
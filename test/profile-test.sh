@@ -0,0 +1,26 @@
+#!/bin/bash
+# -- profile test: --profile_reductions prints a line for every function of
+# every reduction of the stack called, with its calls. The seconds vary, only
+# their format is checked.
+#
+NAME='profile-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+$VW -k --oaa 3 -d train-sets/multiclass --holdout_off --profile_reductions 2>&1 | awk -v name="$NAME" '
+    /^reduction profile/ { profile = 1; print; next }
+    !profile { next }
+    /^reduction +function +calls +inclusive +exclusive$/ { print "reduction function calls"; next }
+    NF == 5 && $3 ~ /^[0-9]+$/ && $4 ~ /^[0-9.e-]+$/ && $5 ~ /^[0-9.e-]+$/ && $5 <= $4 + 1e-6 { print $1, $2, $3; lines++; next }
+    { print name ": not a profile line: " $0; exit 1 }
+    END { if (lines == 0) { print name ": no reduction profile"; exit 1 } }'
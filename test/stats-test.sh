@@ -0,0 +1,56 @@
+#!/bin/bash
+# -- stats test: test 2 writing a --stats_file predicts the same, every line
+# of the file has the fields of a progress line in order, the counts never
+# decrease, and the final line has the counts and the loss of the run.
+# Timings vary, only their format is checked.
+#
+NAME='stats-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.stats $NAME.predict
+}
+
+# lines are appended to the file, a run starts with none
+cleanup
+$VW -k -t -d train-sets/0001.dat -i models/0001.model -p $NAME.predict --invariant \
+    --stats_file $NAME.stats --stats_interval 0.001 --quiet
+
+STATUS=0
+paste $NAME.predict pred-sets/ref/0001.predict | awk -v name="$NAME" '
+    NF != 2 || ($1 - $2) > 1e-4 || ($2 - $1) > 1e-4 { print name ": prediction " NR " is " $1 " instead of " $2; exit 1 }
+    END { print "predictions of test 2" }' || STATUS=1
+
+NUMBER='-?[0-9.]+(e[-+]?[0-9]+)?'
+COUNT='[0-9]+'
+LINE="^\{\"seconds\":$NUMBER,\"pass\":$COUNT,\"examples\":$COUNT,\"weighted_examples\":$NUMBER,\"examples_per_second\":($NUMBER|null),\"average_loss\":($NUMBER|null),\"since_last_loss\":($NUMBER|null),\"parse_seconds\":$NUMBER,\"learn_seconds\":$NUMBER,\"ring_used\":$COUNT,\"ring_size\":$COUNT\}$"
+
+awk -v line="$LINE" -v name="$NAME" '
+    $0 !~ line { print name ": line " NR " is not a stats line: " $0; bad = 1; exit 1 }
+    { split($0, fields, /[{}:,]/)
+      examples = fields[7]
+      if (examples < last) { print name ": line " NR " has fewer examples than the line before"; bad = 1; exit 1 }
+      last = examples
+      final = $0 }
+    END {
+      if (bad)
+          exit 1
+      if (NR == 0) { print name ": no stats lines"; exit 1 }
+      print "every line is a stats line"
+      split(final, fields, /[{}:,]/)
+      print "final line: pass " fields[5] ", examples " fields[7] ", weighted examples " fields[9] ", average loss " fields[13] ", ring size " fields[23]
+    }' $NAME.stats || STATUS=1
+
+cleanup
+exit $STATUS
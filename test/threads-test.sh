@@ -0,0 +1,63 @@
+#!/bin/bash
+# -- threads test: examples learned by several threads Hogwild style reach
+# the final loss of one thread learning them. The threads learn in any order,
+# so the losses agree within a tolerance.
+#
+NAME='threads-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+cleanup() {
+    rm -f $NAME.cache
+}
+
+# the final loss of vw run with the options given
+train() {
+    $VW "$@" 2>&1 | sed -n 's/^average loss = //p'
+}
+
+STATUS=0
+
+# the losses of one thread and of the threads of a run, and the relative difference allowed
+compare() {
+    awk -v serial="$2" -v loss="$3" -v tolerance="$4" -v run="$1" 'BEGIN {
+        number = "^[0-9.e+-]+$"
+        if (serial ~ number && loss ~ number && (loss - serial) <= tolerance * serial && (serial - loss) <= tolerance * serial)
+            print run ": final loss of one thread"
+        else {
+            print run ": final loss " loss " instead of " serial
+            exit 1
+        }
+    }' || STATUS=1
+}
+
+# test 1, the passes after the first learned from a cache of 7 blocks. Without advancing the
+# learning rate schedule by every example the loss is 3% more
+PASSES="-k -l 20 --initial_t 128000 --power_t 1 -d train-sets/0001.dat --cache_file $NAME.cache
+        --cache_format 2 --cache_block_size 16384 --passes 8 --invariant --ngram 3 --skips 1 --holdout_off"
+SERIAL=`train $PASSES`
+for threads in 2 4; do
+    compare "--pass_threads $threads" "$SERIAL" "`train $PASSES --pass_threads $threads`" 0.01
+done
+
+# examples learned online by --learner_threads, with the default updates and with --sgd
+for options in "" "--sgd"; do
+    ONLINE="-d train-sets/rcv1_small.dat --holdout_off $options"
+    SERIAL=`train $ONLINE`
+    for threads in 2 4; do
+        compare "--learner_threads $threads${options:+ $options}" "$SERIAL" "`train $ONLINE --learner_threads $threads`" 0.02
+    done
+done
+
+cleanup
+exit $STATUS
@@ -12,34 +12,290 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <sys/timeb.h>
 #include <cmath>
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include "global_data.h"
 #include "vw_allreduce.h"
+#include "allreduce_compression.h"
+#include "weight_threads.h"
 
 using namespace std;
 
 void add_float(float& c1, const float& c2) { c1 += c2; }
 
-void accumulate(vw& all, parameters& weights, size_t offset)
-{ uint64_t length = UINT64_ONE << all.num_bits; //This is size of gradient
-  float* local_grad = new float[length];
+namespace
+{
+void add_size(size_t& c1, const size_t& c2) { c1 += c2; }
+void or_bits(uint64_t& c1, const uint64_t& c2) { c1 |= c2; }
+
+inline size_t lowest_bit(uint64_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+// the bitmap of the nonzero values
+template<class T> uint64_t* nonzero_bitmap(const T* values, uint64_t length)
+{ uint64_t* bitmap = calloc_or_throw<uint64_t>((length + 63) / 64);
+  for (uint64_t i = 0; i < length; i++)
+    if (values[i] != 0)
+      bitmap[i >> 6] |= UINT64_ONE << (i & 63);
+  return bitmap;
+}
+
+// moves the values with their bit set to the front, keeping their order, and returns how many there are
+template<class T> uint64_t gather(T* values, uint64_t length, const uint64_t* bitmap)
+{ uint64_t count = 0;
+  for (uint64_t w = 0; w < (length + 63) / 64; w++)
+    for (uint64_t bits = bitmap[w]; bits != 0; bits &= bits - 1)
+      values[count++] = values[(w << 6) + lowest_bit(bits)];
+  return count;
+}
+
+// undoes gather, the values without their bit set are 0
+template<class T> void scatter(T* values, uint64_t length, const uint64_t* bitmap, uint64_t count)
+{ for (uint64_t i = length; i-- > 0;)
+    values[i] = (bitmap[i >> 6] >> (i & 63)) & 1 ? values[--count] : 0;
+}
+
+// ors bitmap over the nodes. Only its words which are nonzero on some node are sent, found the same way
+// with a bitmap 64 times smaller. Returns the bytes sent.
+size_t all_reduce_bitmap(vw& all, uint64_t* bitmap, uint64_t words)
+{ if (words <= 64)
+  { all_reduce<uint64_t, or_bits>(all, bitmap, words);
+    return words * sizeof(uint64_t);
+  }
+  uint64_t* nonzero_words = nonzero_bitmap(bitmap, words);
+  size_t sent = all_reduce_bitmap(all, nonzero_words, (words + 63) / 64);
+  uint64_t count = gather(bitmap, words, nonzero_words);
+  if (count > 0)
+    all_reduce<uint64_t, or_bits>(all, bitmap, count);
+  scatter(bitmap, words, nonzero_words, count);
+  free(nonzero_words);
+  return sent + count * sizeof(uint64_t);
+}
+
+// what an allreduce of the weights sent, added over its chunks
+struct traffic
+{ uint64_t length; // of the weights summed
+  uint64_t sent; // of the values, the rest were 0 on every node
+  size_t bytes; // each link of the allreduce carried each way
+  bool compressed;
+};
+
+/* Sums values over the nodes as all_reduce<float, add_float> does. While few of them are nonzero on
+   any node (--sparse_allreduce), the nodes first agree on which with a bitmap, then only those are
+   summed. Zeros add nothing, so the sums are the same. */
+void all_reduce_weights(vw& all, float* values, uint64_t length, traffic& t)
+{ size_t nonzero = 0;
+  if (all.sparse_allreduce > 0)
+  { for (uint64_t i = 0; i < length; i++)
+      nonzero += values[i] != 0.f;
+    all_reduce<size_t, add_size>(all, &nonzero, 1); // counts some twice, at least the nonzero sums
+    t.bytes += sizeof(nonzero);
+  }
+
+  if (nonzero >= all.sparse_allreduce * length)
+  { all_reduce<float, add_float>(all, values, length);
+    t.bytes += length * sizeof(float);
+    nonzero = length;
+  }
+  else
+  { uint64_t* bitmap = nonzero_bitmap(values, length);
+    t.bytes += all_reduce_bitmap(all, bitmap, (length + 63) / 64);
+    nonzero = gather(values, length, bitmap);
+    if (nonzero > 0)
+      all_reduce<float, add_float>(all, values, nonzero);
+    scatter(values, length, bitmap, nonzero);
+    free(bitmap);
+    t.bytes += nonzero * sizeof(float);
+  }
+  t.sent += nonzero;
+}
+
+const compressed_buffer uncompressed = COMPRESSED_BUFFERS;
+
+// sums over the nodes the count values starting at offset of a buffer of length values
+void sum_chunk(vw& all, compressed_buffer buffer, float* values, uint64_t offset, uint64_t count, uint64_t length, traffic& t)
+{ t.length += count;
+  if (buffer != uncompressed && all.compression != nullptr)
+  { t.bytes += all_reduce_compressed(all, buffer, values, offset, count, length);
+    t.compressed = true;
+  }
+  else
+    all_reduce_weights(all, values, count, t);
+}
+
+void print_traffic(vw& all, traffic& t)
+{ if (!all.allreduce_stats)
+    return;
+  all.trace_message << "allreduce of " << t.length << " weights, ";
+  if (t.compressed)
+    all.trace_message << "compressed: ";
+  else
+    all.trace_message << t.sent << " sent: ";
+  all.trace_message << t.bytes << " bytes per link instead of " << t.length * sizeof(float) << endl;
+}
+
+const uint64_t staging_floats = (uint64_t)1 << 20;
+
+// the buffer the weights are gathered in, of floats values: all of them or a chunk of staging_floats
+float* staging(vw& all, parameters& weights, uint64_t& floats)
+{ floats = min(staging_floats, (UINT64_ONE << all.num_bits) << weights.stride_shift());
+  if (all.allreduce_staging == nullptr)
+    all.allreduce_staging = calloc_or_throw<float>(floats);
+  return all.allreduce_staging;
+}
+
+// the weights of record i, nullptr for sparse ones which are 0 because they were never added
+inline float* weights_at(dense_parameters& weights, uint64_t i) { return &weights[i << weights.stride_shift()]; }
+inline float* weights_at(sparse_parameters& weights, uint64_t i)
+{ uint64_t index = i << weights.stride_shift();
+  return weights.defaults_zero() ? weights.find(index) : &weights[index];
+}
+
+// the weights of record i to store in, nullptr for sparse ones which needn't be added to store zeros
+inline float* weights_to_store(sparse_parameters& weights, uint64_t i, bool zero)
+{ uint64_t index = i << weights.stride_shift();
+  float* weight = weights.find(index);
+  return weight == nullptr && !zero ? &weights[index] : weight;
+}
+
+// threads the sparse weights can be read in, one while reading them adds them
+size_t reading_threads(vw& all, sparse_parameters& weights)
+{ return weights.defaults_zero() ? all.weight_threads : 1;
+}
 
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
+// the strides are constants for the compiler to vectorize the copies
+template<uint32_t shift> void gather_strided(float* to, const float* from, uint64_t count)
+{ for (uint64_t i = 0; i < count; i++)
+    to[i] = from[i << shift];
+}
+
+template<uint32_t shift> void scatter_strided(float* to, const float* from, uint64_t count, float divisor)
+{ for (uint64_t i = 0; i < count; i++)
+    to[i << shift] = from[i] / divisor;
+}
+
+void gather_strided(float* to, const float* from, uint64_t count, uint32_t shift)
+{ switch (shift)
+  { case 0: gather_strided<0>(to, from, count); break;
+    case 1: gather_strided<1>(to, from, count); break;
+    case 2: gather_strided<2>(to, from, count); break;
+    case 3: gather_strided<3>(to, from, count); break;
+    default:
+      for (uint64_t i = 0; i < count; i++)
+        to[i] = from[i << shift];
+  }
+}
+
+void scatter_strided(float* to, const float* from, uint64_t count, uint32_t shift, float divisor)
+{ switch (shift)
+  { case 0: scatter_strided<0>(to, from, count, divisor); break;
+    case 1: scatter_strided<1>(to, from, count, divisor); break;
+    case 2: scatter_strided<2>(to, from, count, divisor); break;
+    case 3: scatter_strided<3>(to, from, count, divisor); break;
+    default:
+      for (uint64_t i = 0; i < count; i++)
+        to[i << shift] = from[i] / divisor;
+  }
+}
+
+// copies the value at offset of the count records starting at first to values
+void gather_offset(vw& all, parameters& weights, size_t offset, uint64_t first, uint64_t count, float* values)
+{ uint32_t shift = weights.stride_shift();
+  if (!weights.sparse)
+  { float* from = weights.dense_weights.first() + (first << shift) + offset;
+    for_weight_ranges(all, all.weight_threads, count, [=](uint64_t begin, uint64_t end)
+    { gather_strided(values + begin, from + (begin << shift), end - begin, shift); });
+  }
   else
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];    
-  
-  all_reduce<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
-
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i];
+  { sparse_parameters& sparse = weights.sparse_weights;
+    for_weight_ranges(all, reading_threads(all, sparse), count, [&sparse, offset, first, values](uint64_t begin, uint64_t end)
+    { for (uint64_t i = begin; i < end; i++)
+      { float* weight = weights_at(sparse, first + i);
+        values[i] = weight == nullptr ? 0.f : weight[offset];
+      }
+    });
+  }
+}
+
+// stores values divided by divisor at offset of the count records starting at first
+void scatter_offset(vw& all, parameters& weights, size_t offset, uint64_t first, uint64_t count, float* values, float divisor)
+{ uint32_t shift = weights.stride_shift();
+  if (!weights.sparse)
+  { float* to = weights.dense_weights.first() + (first << shift) + offset;
+    for_weight_ranges(all, all.weight_threads, count, [=](uint64_t begin, uint64_t end)
+    { scatter_strided(to + (begin << shift), values + begin, end - begin, shift, divisor); });
+  }
+  else // adding weights isn't thread safe
+    for (uint64_t i = 0; i < count; i++)
+    { float* weight = weights_to_store(weights.sparse_weights, first + i, values[i] == 0.f);
+      if (weight != nullptr)
+        weight[offset] = values[i] / divisor;
+    }
+}
+
+void gather_records(vw& all, sparse_parameters& weights, uint64_t first, uint64_t count, float* values)
+{ uint32_t shift = weights.stride_shift();
+  for_weight_ranges(all, reading_threads(all, weights), count, [&weights, shift, first, values](uint64_t begin, uint64_t end)
+  { for (uint64_t i = begin; i < end; i++)
+    { float* weight = weights_at(weights, first + i);
+      for (uint64_t j = 0; j < (UINT64_ONE << shift); j++)
+        values[(i << shift) + j] = weight == nullptr ? 0.f : weight[j];
+    }
+  });
+}
+
+void scatter_records(sparse_parameters& weights, uint64_t first, uint64_t count, float* values)
+{ uint32_t shift = weights.stride_shift();
+  for (uint64_t i = 0; i < count; i++)
+  { float* record = values + (i << shift);
+    bool zero = true;
+    for (uint64_t j = 0; j < (UINT64_ONE << shift); j++)
+      zero &= record[j] == 0.f;
+    float* weight = weights_to_store(weights, first + i, zero);
+    if (weight != nullptr)
+      memcpy(weight, record, sizeof(float) << shift);
+  }
+}
+
+/* Sums the values at offset of the weights over the nodes and stores them divided by divisor. They are
+   gathered in the staging buffer a chunk at a time, unless they are the weights, which are summed where
+   they are. */
+void all_reduce_offset(vw& all, parameters& weights, size_t offset, compressed_buffer buffer, float divisor)
+{ uint64_t length = UINT64_ONE << all.num_bits;
+  traffic t = {};
+  if (!weights.sparse && weights.stride_shift() == 0)
+  { float* values = weights.dense_weights.first();
+    sum_chunk(all, buffer, values, 0, length, length, t);
+    if (divisor != 1.f)
+      for_weight_ranges(all, all.weight_threads, length, [=](uint64_t begin, uint64_t end)
+      { for (uint64_t i = begin; i < end; i++)
+          values[i] /= divisor;
+      });
+  }
   else
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i];
-  
-  delete[] local_grad;
+  { uint64_t chunk;
+    float* values = staging(all, weights, chunk);
+    for (uint64_t first = 0; first < length; first += chunk)
+    { uint64_t count = min(chunk, length - first);
+      gather_offset(all, weights, offset, first, count, values);
+      sum_chunk(all, buffer, values, first, count, length, t);
+      scatter_offset(all, weights, offset, first, count, values, divisor);
+    }
+  }
+  print_traffic(all, t);
+}
+}
+
+void accumulate(vw& all, parameters& weights, size_t offset)
+{ all_reduce_offset(all, weights, offset, uncompressed, 1.f);
 }
 
 float accumulate_scalar(vw& all, float local_sum)
@@ -49,27 +305,7 @@ float accumulate_scalar(vw& all, float local_sum)
 }
 
 void accumulate_avg(vw& all, parameters& weights, size_t offset)
-{ uint32_t length = 1 << all.num_bits; //This is size of gradient
-  float numnodes = (float)all.all_reduce->total;
-  float* local_grad = new float[length];
-
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset];
-  else
-    for (uint64_t i = 0; i < length; i++)
-      local_grad[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset];    
-  
-  all_reduce<float, add_float>(all, local_grad, length); //TODO: modify to not use first()
-
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
-  else
-    for (uint64_t i = 0; i < length; i++)
-      (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[offset] = local_grad[i] / numnodes;
- 
-  delete[] local_grad;
+{ all_reduce_offset(all, weights, offset, AVERAGED_WEIGHTS, (float)all.all_reduce->total);
 }
 
 float max_elem(float* arr, int length)
@@ -87,12 +323,14 @@ float min_elem(float* arr, int length)
 }
 
 template<class T>
-void do_weighting(vw& all, uint64_t length, float* local_weights, T& weights)
+void do_weighting(vw& all, uint64_t first, uint64_t count, float* local_weights, T& weights)
 {
-  for (uint64_t i = 0; i < length; i++)
+  for (uint64_t i = 0; i < count; i++)
     {
-      float* weight = &weights[i << weights.stride_shift()];
-      if (local_weights[i] > 0)
+      float* weight = weights_at(weights, first + i);
+      if (weight == nullptr) // 0 on this node
+	local_weights[i] = 0;
+      else if (local_weights[i] > 0)
 	{ float ratio = weight[1] / local_weights[i];
 	  local_weights[i] = weight[0] * ratio;
 	  weight[0] *= ratio;
@@ -112,28 +350,40 @@ void accumulate_weighted_avg(vw& all, parameters& weights)
   { all.trace_message<<"Weighted averaging is implemented only for adaptive gradient, use accumulate_avg instead\n";
     return;
   }
-  uint32_t length = 1 << all.num_bits; //This is the number of parameters
-  float* local_weights = new float[length];
+  uint64_t length = UINT64_ONE << all.num_bits; //This is the number of parameters
+  uint32_t shift = weights.stride_shift();
+  uint64_t floats;
+  float* local_weights = staging(all, weights, floats);
+  uint64_t chunk = floats >> shift; // records, all of whose weights fit in the staging buffer
 
-  if (weights.sparse)
-    for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.sparse_weights[i << weights.sparse_weights.stride_shift()]))[1];
-  else
-    for (uint64_t i = 0; i < length; i++)
-      local_weights[i] = (&(weights.dense_weights[i << weights.dense_weights.stride_shift()]))[1];    
+  traffic weighting = {}, averaged = {};
+  for (uint64_t first = 0; first < length; first += chunk)
+  { uint64_t count = min(chunk, length - first);
+    //First compute weights for averaging
+    gather_offset(all, weights, 1, first, count, local_weights);
+    sum_chunk(all, uncompressed, local_weights, first, count, length, weighting);
 
-  //First compute weights for averaging
-  all_reduce<float, add_float>(all, local_weights, length);
+    if (weights.sparse)
+      do_weighting(all, first, count, local_weights, weights.sparse_weights);
+    else
+      do_weighting(all, first, count, local_weights, weights.dense_weights);
 
-  if (weights.sparse)
-    do_weighting(all, length, local_weights, weights.sparse_weights);
-  else
-    do_weighting(all, length, local_weights, weights.dense_weights);
-    
-  if (weights.sparse)
-    cout << "sparse parameters not supported with parallel computation!" << endl;
-  else
-    all_reduce<float, add_float>(all, weights.dense_weights.first(), length*weights.stride_shift()); 
-  delete[] local_weights;
+    if (all.compression != nullptr)
+      // an offset at a time, a block of weights and their much larger accumulators would lose the weights
+      for (size_t offset = 0; offset < (size_t)1 << shift; offset++)
+      { gather_offset(all, weights, offset, first, count, local_weights);
+        sum_chunk(all, WEIGHTED_AVERAGED_WEIGHTS, local_weights, (offset << all.num_bits) + first, count, length << shift, averaged);
+        scatter_offset(all, weights, offset, first, count, local_weights, 1.f);
+      }
+    else if (weights.sparse)
+    { gather_records(all, weights.sparse_weights, first, count, local_weights);
+      sum_chunk(all, uncompressed, local_weights, first << shift, count << shift, length << shift, averaged);
+      scatter_records(weights.sparse_weights, first, count, local_weights);
+    }
+    else
+      sum_chunk(all, uncompressed, weights.dense_weights.first() + (first << shift),
+                first << shift, count << shift, length << shift, averaged);
+  }
+  print_traffic(all, weighting);
+  print_traffic(all, averaged);
 }
-
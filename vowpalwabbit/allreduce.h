@@ -41,6 +41,8 @@ typedef int socket_t;
 #endif
 #include "vw_exception.h"
 #include <assert.h>
+#include <errno.h>
+#include <cstring>
 
 const size_t ar_buf_size = 1<<16;
 
@@ -48,6 +50,8 @@ struct node_socks
 { std::string current_master;
   socket_t parent;
   socket_t children[2];
+  socket_t ring_next; // the nodes after and before this one in the ring, with --allreduce_ring
+  socket_t ring_prev;
   ~node_socks()
   { if(current_master != "")
     { if(parent != -1)
@@ -56,13 +60,29 @@ struct node_socks
         CLOSESOCK(this->children[0]);
       if(children[1] != -1)
         CLOSESOCK(this->children[1]);
+      if(ring_next != -1)
+        CLOSESOCK(this->ring_next);
+      if(ring_prev != -1)
+        CLOSESOCK(this->ring_prev);
     }
   }
   node_socks ()
   { current_master = "";
+    ring_next = -1;
+    ring_prev = -1;
   }
 };
 
+// whether a socket operation failed because the socket is nonblocking and it would have blocked
+inline bool would_block()
+{
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
 template <class T, void(*f)(T&, const T&)> void addbufs(T* buf1, const T* buf2, const size_t n)
 { for (size_t i = 0; i < n; i++)
     f(buf1[i], buf2[i]);
@@ -174,6 +194,8 @@ private:
   node_socks socks;
   std::string span_server;
   size_t unique_id; //unique id for each node in the network, id == 0 means extra io.
+  bool ring; // allreduce large buffers around the ring rather than through the tree
+  size_t ring_position;
 
   void all_reduce_init();
 
@@ -261,9 +283,96 @@ private:
   void pass_down(char* buffer, const size_t parent_read_pos, size_t& children_sent_pos);
   void broadcast(char* buffer, const size_t n);
 
+  // the first byte of segment k of the total segments of n bytes of T
+  template <class T> size_t segment_start(size_t k, const size_t n)
+  { return n / sizeof(T) * k / total * sizeof(T);
+  }
+
+  /* Reduce-scatter then allgather around the ring. The buffer is split into a segment per node, and in
+     each of 2(total-1) steps a node sends a segment to the next node and receives another from the
+     previous one: in the first total-1 steps it adds those to its own, so it ends up with a segment summed
+     over all the nodes, which the last total-1 steps pass around. What a step sends is what the step
+     before received, so the bytes go on as soon as the ones at the same place in the previous segment
+     have been received and added, at most ar_buf_size at a time: the transfers of the whole ring overlap
+     with each other and with the additions. Every link carries 2(total-1)/total times the buffer instead
+     of the root links carrying it 4 times. */
+  template <class T, void(*f)(T&, const T&)> void ring_reduce(char* buffer, const size_t n)
+  { const size_t steps = 2 * (total - 1);
+    // the segment received in step s, in step s + 1 it's sent. step 0 sends the node's own segment.
+    auto received_segment = [&](size_t s) { return (ring_position + 2 * total - s - 1) % total; };
+    auto sent_segment = [&](size_t s) { return s == 0 ? ring_position : received_segment(s - 1); };
+    auto segment_size = [&](size_t k) { return segment_start<T>(k + 1, n) - segment_start<T>(k, n); };
+
+    char read_buf[ar_buf_size + sizeof(T) - 1];
+    size_t unprocessed = 0; // bytes of an incomplete T at the start of read_buf
+    size_t read_step = 0, read_pos = 0; // in the segment of the step, including the unprocessed bytes
+    size_t sent_step = 0, sent_pos = 0;
+
+    while (read_step < steps || sent_step < steps)
+    { // segments can be empty with fewer Ts than nodes
+      while (read_step < steps && read_pos == segment_size(received_segment(read_step)))
+      { read_step++;
+        read_pos = 0;
+      }
+      while (sent_step < steps && sent_pos == segment_size(sent_segment(sent_step)))
+      { sent_step++;
+        sent_pos = 0;
+      }
+      if (read_step == steps && sent_step == steps)
+        break;
+
+      size_t sendable = 0;
+      if (sent_step < steps)
+      { if (sent_step == 0 || read_step >= sent_step)
+          sendable = segment_size(sent_segment(sent_step)) - sent_pos;
+        else if (read_step == sent_step - 1)
+          sendable = read_pos - unprocessed - sent_pos;
+      }
+
+      fd_set read_fds, write_fds;
+      FD_ZERO(&read_fds);
+      FD_ZERO(&write_fds);
+      if (read_step < steps)
+        FD_SET(socks.ring_prev, &read_fds);
+      if (sendable > 0)
+        FD_SET(socks.ring_next, &write_fds);
+      if (select((int)(std::max)(socks.ring_prev, socks.ring_next) + 1, &read_fds, &write_fds, nullptr, nullptr) == -1)
+        THROWERRNO("select");
+
+      if (FD_ISSET(socks.ring_next, &write_fds))
+      { char* start = buffer + segment_start<T>(sent_segment(sent_step), n) + sent_pos;
+        int write_size = send(socks.ring_next, start, (int)(std::min)(sendable, ar_buf_size), 0);
+        if (write_size < 0 && !would_block())
+          THROWERRNO("send to the next node of the ring");
+        if (write_size > 0)
+          sent_pos += write_size;
+      }
+
+      if (FD_ISSET(socks.ring_prev, &read_fds))
+      { char* start = buffer + segment_start<T>(received_segment(read_step), n);
+        size_t count = (std::min)(ar_buf_size, segment_size(received_segment(read_step)) - read_pos);
+        bool add = read_step < total - 1;
+        // allgathered bytes go straight to their place
+        int read_size = recv(socks.ring_prev, add ? read_buf + unprocessed : start + read_pos, (int)count, 0);
+        if (read_size == 0)
+          THROW("the previous node of the ring closed the connection");
+        if (read_size < 0 && !would_block())
+          THROWERRNO("recv from the previous node of the ring");
+        if (read_size > 0 && add)
+        { size_t complete = (unprocessed + read_size) / sizeof(T);
+          addbufs<T, f>((T*)(start + read_pos - unprocessed), (T*)read_buf, complete);
+          unprocessed = (unprocessed + read_size) % sizeof(T);
+          memmove(read_buf, read_buf + complete * sizeof(T), unprocessed);
+        }
+        if (read_size > 0)
+          read_pos += read_size;
+      }
+    }
+  }
+
 public:
-  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode)
-    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id)
+  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode, bool pring = false)
+    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id), ring(pring), ring_position(0)
   {
   }
 
@@ -274,7 +383,12 @@ public:
   template <class T, void(*f)(T&, const T&)> void all_reduce(T* buffer, const size_t n)
   { if (span_server != socks.current_master)
       all_reduce_init();
-    reduce<T, f>((char*)buffer, n*sizeof(T));
-    broadcast((char*)buffer, n*sizeof(T));
+    // small buffers take the tree, 2 log(total) hops instead of 2 (total-1)
+    if (ring && total > 1 && n * sizeof(T) >= total * ar_buf_size)
+      ring_reduce<T, f>((char*)buffer, n*sizeof(T));
+    else
+    { reduce<T, f>((char*)buffer, n*sizeof(T));
+      broadcast((char*)buffer, n*sizeof(T));
+    }
   }
 };
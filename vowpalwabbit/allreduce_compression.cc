@@ -0,0 +1,297 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+#include "allreduce_compression.h"
+#include "global_data.h"
+#include "vw_allreduce.h"
+#include "memory.h"
+
+using namespace std;
+
+namespace
+{
+enum allreduce_codec { FP16, BF16, INT8 };
+
+// values are encoded and summed by blocks of this many
+const size_t block_values = 32;
+
+struct fp16_block { uint16_t values[block_values]; };
+struct bf16_block { uint16_t values[block_values]; };
+struct int8_block
+{ float scale; // of the values, the largest is +-127
+  int8_t values[block_values];
+};
+
+inline uint32_t bits_of(float f)
+{ uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  return x;
+}
+
+inline float float_of(uint32_t x)
+{ float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// rounded to the nearest half float, ties to even
+inline uint16_t float_to_half(float f)
+{ uint32_t x = bits_of(f);
+  uint16_t sign = (x >> 16) & 0x8000;
+  uint32_t magnitude = x & 0x7fffffff;
+  if (magnitude > 0x7f800000) // NaN
+    return sign | 0x7e00;
+  if (magnitude >= 0x47800000) // 65536 and more
+    return sign | 0x7c00;
+  uint32_t exponent = magnitude >> 23;
+  if (exponent < 113) // a subnormal half, the mantissa with its leading 1 shifted into place
+  { uint32_t shift = 126 - exponent;
+    if (shift > 24)
+      return sign;
+    uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+    uint32_t h = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+    h += rest > halfway || (rest == halfway && (h & 1));
+    return sign | (uint16_t)h;
+  }
+  uint32_t h = (magnitude >> 13) - (112 << 10);
+  uint32_t rest = magnitude & 0x1fff;
+  h += rest > 0x1000 || (rest == 0x1000 && (h & 1)); // carries into the exponent, up to infinity
+  return sign | (uint16_t)h;
+}
+
+inline float half_to_float(uint16_t h)
+{ uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+  if (exponent == 0)
+  { float f = mantissa * (1.f / 16777216.f);
+    return sign ? -f : f;
+  }
+  if (exponent == 31)
+    return float_of(sign | 0x7f800000 | (mantissa << 13));
+  return float_of(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+void encode(const float* x, fp16_block& b)
+{
+#if defined(__F16C__)
+  for (size_t i = 0; i < block_values; i += 8)
+    _mm_storeu_si128((__m128i*)(b.values + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+#else
+  for (size_t i = 0; i < block_values; i++)
+    b.values[i] = float_to_half(x[i]);
+#endif
+}
+
+void decode(const fp16_block& b, float* x)
+{
+#if defined(__F16C__)
+  for (size_t i = 0; i < block_values; i += 8)
+    _mm256_storeu_ps(x + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(b.values + i))));
+#else
+  for (size_t i = 0; i < block_values; i++)
+    x[i] = half_to_float(b.values[i]);
+#endif
+}
+
+// the top half of a float rounded to nearest, ties to even
+void encode(const float* x, bf16_block& b)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128i rounding = _mm_set1_epi32(0x7fff), one = _mm_set1_epi32(1);
+  for (size_t i = 0; i < block_values; i += 8)
+  { __m128i low = _mm_castps_si128(_mm_loadu_ps(x + i)), high = _mm_castps_si128(_mm_loadu_ps(x + i + 4));
+    low = _mm_add_epi32(low, _mm_add_epi32(rounding, _mm_and_si128(_mm_srli_epi32(low, 16), one)));
+    high = _mm_add_epi32(high, _mm_add_epi32(rounding, _mm_and_si128(_mm_srli_epi32(high, 16), one)));
+    // shifted with the sign the top halves fit the signed saturation of packs
+    _mm_storeu_si128((__m128i*)(b.values + i), _mm_packs_epi32(_mm_srai_epi32(low, 16), _mm_srai_epi32(high, 16)));
+  }
+#else
+  for (size_t i = 0; i < block_values; i++)
+  { uint32_t bits = bits_of(x[i]);
+    b.values[i] = (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+  }
+#endif
+}
+
+void decode(const bf16_block& b, float* x)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128i zero = _mm_setzero_si128();
+  for (size_t i = 0; i < block_values; i += 8)
+  { __m128i h = _mm_loadu_si128((const __m128i*)(b.values + i));
+    _mm_storeu_ps(x + i, _mm_castsi128_ps(_mm_unpacklo_epi16(zero, h)));
+    _mm_storeu_ps(x + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(zero, h)));
+  }
+#else
+  for (size_t i = 0; i < block_values; i++)
+    x[i] = float_of((uint32_t)b.values[i] << 16);
+#endif
+}
+
+void encode(const float* x, int8_block& b)
+{ float largest = 0.f;
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 m = _mm_setzero_ps();
+  for (size_t i = 0; i < block_values; i += 4)
+    m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(x + i), magnitude));
+  m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  largest = _mm_cvtss_f32(m);
+#else
+  for (size_t i = 0; i < block_values; i++)
+    largest = max(largest, fabsf(x[i]));
+#endif
+  b.scale = largest / 127.f;
+  float inverse = largest > 0.f ? 127.f / largest : 0.f;
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128 s = _mm_set1_ps(inverse);
+  for (size_t i = 0; i < block_values; i += 16)
+  { __m128i q0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x + i), s));
+    __m128i q1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x + i + 4), s));
+    __m128i q2 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x + i + 8), s));
+    __m128i q3 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(x + i + 12), s));
+    _mm_storeu_si128((__m128i*)(b.values + i), _mm_packs_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+  }
+#else
+  for (size_t i = 0; i < block_values; i++)
+    b.values[i] = (int8_t)nearbyintf(x[i] * inverse);
+#endif
+}
+
+void decode(const int8_block& b, float* x)
+{
+#if defined(__SSE2__) || defined(_M_X64)
+  const __m128 s = _mm_set1_ps(b.scale);
+  for (size_t i = 0; i < block_values; i += 16)
+  { __m128i q = _mm_loadu_si128((const __m128i*)(b.values + i));
+    // sign extended by shifting a byte duplicated into the top of a wider lane
+    __m128i low = _mm_srai_epi16(_mm_unpacklo_epi8(q, q), 8), high = _mm_srai_epi16(_mm_unpackhi_epi8(q, q), 8);
+    __m128i q0 = _mm_srai_epi32(_mm_unpacklo_epi16(low, low), 16), q1 = _mm_srai_epi32(_mm_unpackhi_epi16(low, low), 16);
+    __m128i q2 = _mm_srai_epi32(_mm_unpacklo_epi16(high, high), 16), q3 = _mm_srai_epi32(_mm_unpackhi_epi16(high, high), 16);
+    _mm_storeu_ps(x + i, _mm_mul_ps(_mm_cvtepi32_ps(q0), s));
+    _mm_storeu_ps(x + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(q1), s));
+    _mm_storeu_ps(x + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(q2), s));
+    _mm_storeu_ps(x + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(q3), s));
+  }
+#else
+  for (size_t i = 0; i < block_values; i++)
+    x[i] = b.values[i] * b.scale;
+#endif
+}
+
+template<class B> void add_blocks(B& b1, const B& b2)
+{ float x1[block_values], x2[block_values];
+  decode(b1, x1);
+  decode(b2, x2);
+  for (size_t i = 0; i < block_values; i++)
+    x1[i] += x2[i];
+  encode(x1, b1);
+}
+
+struct compressed_sum
+{ float* share; // the last sum over the nodes divided by their number, the same on all of them
+  float* residual; // of the changes of this node, what the encoding lost
+  uint64_t length;
+};
+}
+
+struct allreduce_compression
+{ allreduce_codec codec;
+  compressed_sum sums[COMPRESSED_BUFFERS];
+};
+
+namespace
+{
+template<class B> size_t all_reduce_blocks(vw& all, compressed_sum& s, float* values, uint64_t offset, uint64_t count, uint64_t length)
+{ if (s.length != length)
+  { free(s.share);
+    free(s.residual);
+    s.share = calloc_or_throw<float>(length);
+    s.residual = calloc_or_throw<float>(length);
+    s.length = length;
+  }
+  float* share = s.share + offset;
+  float* residual = s.residual + offset;
+
+  uint64_t blocks = (count + block_values - 1) / block_values;
+  B* encoded = calloc_or_throw<B>(blocks);
+  float change[block_values], sent[block_values];
+  for (uint64_t b = 0; b < blocks; b++)
+  { uint64_t first = b * block_values;
+    size_t n = (size_t)min((uint64_t)block_values, count - first);
+    for (size_t i = 0; i < n; i++)
+      change[i] = values[first + i] - share[first + i] + residual[first + i];
+    for (size_t i = n; i < block_values; i++)
+      change[i] = 0.f;
+    encode(change, encoded[b]);
+    decode(encoded[b], sent);
+    for (size_t i = 0; i < n; i++)
+      residual[first + i] = change[i] - sent[i];
+  }
+
+  all_reduce<B, add_blocks<B> >(all, encoded, blocks);
+
+  float total = (float)all.all_reduce->total;
+  for (uint64_t b = 0; b < blocks; b++)
+  { uint64_t first = b * block_values;
+    size_t n = (size_t)min((uint64_t)block_values, count - first);
+    decode(encoded[b], sent);
+    for (size_t i = 0; i < n; i++)
+    { values[first + i] = share[first + i] * total + sent[i];
+      share[first + i] = values[first + i] / total;
+    }
+  }
+  free(encoded);
+  return blocks * sizeof(B);
+}
+}
+
+allreduce_compression* new_allreduce_compression(string codec)
+{ allreduce_compression* compression = new allreduce_compression();
+  if (codec == "fp16")
+    compression->codec = FP16;
+  else if (codec == "bf16")
+    compression->codec = BF16;
+  else if (codec == "int8")
+    compression->codec = INT8;
+  else
+  { delete compression;
+    THROW("--allreduce_compression must be fp16, bf16 or int8, not " << codec);
+  }
+  return compression;
+}
+
+void free_allreduce_compression(allreduce_compression* compression)
+{ if (compression == nullptr)
+    return;
+  for (compressed_sum& s : compression->sums)
+  { free(s.share);
+    free(s.residual);
+  }
+  delete compression;
+}
+
+size_t all_reduce_compressed(vw& all, compressed_buffer buffer, float* values, uint64_t offset, uint64_t count, uint64_t length)
+{ compressed_sum& s = all.compression->sums[buffer];
+  switch (all.compression->codec)
+  { case FP16:
+      return all_reduce_blocks<fp16_block>(all, s, values, offset, count, length);
+    case BF16:
+      return all_reduce_blocks<bf16_block>(all, s, values, offset, count, length);
+    case INT8:
+      return all_reduce_blocks<int8_block>(all, s, values, offset, count, length);
+  }
+  return 0;
+}
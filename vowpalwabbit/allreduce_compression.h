@@ -0,0 +1,32 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/* --allreduce_compression fp16|bf16|int8: the allreduces of model averaging (accumulate_avg and
+   accumulate_weighted_avg) send blocks of 32 values as half floats, bfloat16s, or bytes with a float
+   scale per block, instead of floats. A node sends how its values changed since the last sum of the
+   same buffer, which all the nodes share, plus what the encoding of its earlier changes lost (error
+   feedback), so encoding errors don't add up over the passes. Every hop adds the decoded blocks and
+   encodes the sum again, so the sum has h rounding errors of the codec (2^-11 of a value in fp16, 2^-8
+   in bf16, 1/254 of the largest value of its block in int8), h the hops: the depth of the spanning tree,
+   about log2 of the nodes, or the nodes - 1 around --allreduce_ring. Feedback only covers what a node
+   lost itself, the hop errors are shared by all the nodes and stay in the averaged model. They are
+   relative to the changes summed, not to the weights. */
+
+struct vw;
+struct allreduce_compression;
+
+allreduce_compression* new_allreduce_compression(std::string codec);
+void free_allreduce_compression(allreduce_compression* compression);
+
+// the buffers summed, each keeps what it was last time
+enum compressed_buffer { AVERAGED_WEIGHTS, WEIGHTED_AVERAGED_WEIGHTS, COMPRESSED_BUFFERS };
+
+// sums values over the nodes like all_reduce<float, add_float>, compressed. They are the count values of
+// the buffer of length values starting at offset. Returns the bytes each link carried each way.
+size_t all_reduce_compressed(vw& all, compressed_buffer buffer, float* values, uint64_t offset, uint64_t count, uint64_t length);
@@ -22,6 +22,7 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <io.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #endif
 #include <sys/timeb.h>
@@ -75,6 +76,22 @@ socket_t sock_connect(const uint32_t ip, const int port)
   return sock;
 }
 
+// the ring is driven with select, a send or recv mustn't wait for the other nodes
+void set_nonblocking(socket_t sock)
+{
+#ifdef _WIN32
+  u_long on = 1;
+  if (ioctlsocket(sock, FIONBIO, &on) != 0)
+#else
+  if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == -1)
+#endif
+    THROWERRNO("nonblocking ring socket");
+}
+
+// with --allreduce_ring, what a connection to the port of a node is for
+const char tree_connection = 't';
+const char ring_connection = 'r';
+
 socket_t getsock()
 { socket_t sock = socket(PF_INET, SOCK_STREAM, 0);
   if (sock < 0)
@@ -96,6 +113,11 @@ socket_t getsock()
   return sock;
 }
 
+void fail_send_tag(socket_t sock, char tag)
+{ if (send(sock, &tag, sizeof(tag), 0) < (int)sizeof(tag))
+    THROWERRNO("send of the connection type");
+}
+
 void AllReduceSockets::all_reduce_init()
 {
 #ifdef _WIN32
@@ -141,9 +163,11 @@ void AllReduceSockets::all_reduce_init()
     cerr << "read kid_count from span server failed" << endl;
   else cerr << "read kid_count=" << kid_count << endl;
 
+  // the previous node of the ring connects too
+  int connections = kid_count + (ring && total > 1 ? 1 : 0);
   socket_t sock = -1;
   short unsigned int netport = htons(26544);
-  if(kid_count > 0)
+  if(connections > 0)
   { sock = getsock();
     sockaddr_in address;
     address.sin_family = AF_INET;
@@ -166,7 +190,7 @@ void AllReduceSockets::all_reduce_init()
           THROWERRNO("bind");
       }
       else
-      { if (listen(sock, kid_count) < 0)
+      { if (listen(sock, connections) < 0)
         { cerr << "listen: " << strerror(errno) << endl;
           CLOSESOCK(sock);
           sock = getsock();
@@ -195,16 +219,36 @@ void AllReduceSockets::all_reduce_init()
     cerr << "read parent_port failed!" << endl;
   else cerr << "read parent_port=" << parent_port << endl;
 
+  uint32_t next_ip;
+  uint16_t next_port;
+  if (ring)
+  { uint32_t position;
+    if (recv(master_sock, (char*)&position, sizeof(position), 0) < (int)sizeof(position)
+        || recv(master_sock, (char*)&next_ip, sizeof(next_ip), 0) < (int)sizeof(next_ip)
+        || recv(master_sock, (char*)&next_port, sizeof(next_port), 0) < (int)sizeof(next_port))
+      THROW("read of the ring from the span server failed, --allreduce_ring needs a spanning_tree which gives it out");
+    ring_position = position;
+    cerr << "read ring_position=" << ring_position << endl;
+  }
+
   CLOSESOCK(master_sock);
 
   if(parent_ip != (uint32_t)-1)
   { socks.parent = sock_connect(parent_ip, parent_port);
+    if (ring)
+      fail_send_tag(socks.parent, tree_connection);
   }
   else
     socks.parent = -1;
 
+  if (ring && total > 1)
+  { socks.ring_next = sock_connect(next_ip, next_port);
+    fail_send_tag(socks.ring_next, ring_connection);
+  }
+
   socks.children[0] = -1; socks.children[1] = -1;
-  for (int i = 0; i < kid_count; i++)
+  int kids = 0;
+  for (int i = 0; i < connections; i++)
   { sockaddr_in child_address;
     socklen_t size = sizeof(child_address);
     socket_t f = accept(sock,(sockaddr*)&child_address,&size);
@@ -215,11 +259,21 @@ void AllReduceSockets::all_reduce_init()
     // char servInfo[NI_MAXSERV];
     // getnameinfo((sockaddr *) &child_address, sizeof(sockaddr), hostname, NI_MAXHOST, servInfo, NI_MAXSERV, NI_NUMERICSERV);
     // cerr << "connected to " << hostname << ':' << ntohs(port) << endl;
-    socks.children[i] = f;
+    char tag = tree_connection;
+    if (ring && recv(f, &tag, sizeof(tag), 0) < (int)sizeof(tag))
+      THROWERRNO("recv of the connection type");
+    if (tag == ring_connection)
+      socks.ring_prev = f;
+    else
+      socks.children[kids++] = f;
   }
 
-  if (kid_count > 0)
+  if (connections > 0)
     CLOSESOCK(sock);
+  if (ring && total > 1)
+  { set_nonblocking(socks.ring_next);
+    set_nonblocking(socks.ring_prev);
+  }
 }
 
 
@@ -1,6 +1,8 @@
 #pragma once
 #include <string.h>
-#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include "weight_allocation.h"
 #ifndef _WIN32
 #include <sys/mman.h>
 #endif
@@ -15,7 +17,6 @@ typedef float weight;
 
 class dense_parameters;
 class sparse_parameters;
-typedef std::unordered_map<uint64_t, weight*> weight_map;
 
 class weight_iterator_iterator
 {
@@ -94,24 +95,27 @@ private:
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
+	weight_allocation _allocation; // policy in effect for _begin
+	bool _mapped; // _begin is released with munmap instead of free
 
  public:
 	typedef dense_iterator<weight> iterator;
 	typedef dense_iterator<const weight> const_iterator;
- dense_parameters(size_t length, uint32_t stride_shift=0)
-   : _begin(calloc_mergable_or_throw<weight>(length << stride_shift)),
-	  _weight_mask((length << stride_shift) - 1),
+ // lazy: the weights are about to be loaded, see allocate_weights
+ dense_parameters(size_t length, uint32_t stride_shift=0, weight_allocation allocation=WEIGHTS_DEFAULT, bool lazy=false)
+   : _weight_mask((length << stride_shift) - 1),
 	  _stride_shift(stride_shift),
-	  _seeded(false)
-	    { }
+	  _seeded(false),
+	  _allocation(allocation)
+	    { _begin = allocate_weights(length << stride_shift, _allocation, false, lazy, _mapped); }
 
  dense_parameters()
-	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false)
+	 : _begin(nullptr), _weight_mask(0), _stride_shift(0),_seeded(false), _allocation(WEIGHTS_DEFAULT), _mapped(false)
 	  {}
 
 	bool not_null() { return (_weight_mask > 0 && _begin != nullptr);}
 
-	dense_parameters(const dense_parameters &other) { shallow_copy(other); }
+	dense_parameters(const dense_parameters &other) : _begin(nullptr), _seeded(false), _mapped(false) { shallow_copy(other); }
 	dense_parameters(dense_parameters &&) = delete;
 
 	weight* first() { return _begin; } //TODO: Temporary fix for allreduce.
@@ -128,8 +132,10 @@ private:
 	void shallow_copy(const dense_parameters& input)
 	{
 	  if (!_seeded)
-		  free(_begin);
+		  free_weights(_begin, _weight_mask + 1, _allocation, _mapped);
 	  _begin = input._begin;
+	  _allocation = input._allocation;
+	  _mapped = input._mapped;
 	  _weight_mask = input._weight_mask;
 	  _stride_shift = input._stride_shift;
 	  _seeded = true;
@@ -167,34 +173,76 @@ private:
 
 	void stride_shift(uint32_t stride_shift) { _stride_shift = stride_shift; }
 
+	weight_allocation allocation() { return _allocation; }
+
+	// replaces the weights by a copy-on-write mapping of a model file, its pages are shared with the page
+	// cache and every other process mapping the same model until they are written
+	bool map_file(int fd, uint64_t offset)
+	{ weight* mapped = map_weights_file(fd, _weight_mask + 1, offset);
+	  if (mapped == nullptr)
+	    return false;
+	  free_weights(_begin, _weight_mask + 1, _allocation, _mapped);
+	  _begin = mapped;
+	  _allocation = WEIGHTS_DEFAULT;
+	  _mapped = true;
+	  return true;
+	}
+
 	#ifndef _WIN32
+	// moves the weights to memory shared with forked children, keeping the allocation policy if possible
 	void share(size_t length)
 	{
-	  float* shared_weights = (float*)mmap(0, (length << _stride_shift) * sizeof(float),
-			                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
           size_t float_count = length << _stride_shift;
-      	  weight* dest = shared_weights;
+	  weight_allocation allocation = _allocation;
+	  bool mapped;
+      	  weight* dest = allocate_weights(float_count, allocation, true, false, mapped);
 		  memcpy(dest, _begin, float_count*sizeof(float));
-      	  free(_begin);
+      	  free_weights(_begin, float_count, _allocation, _mapped);
       	  _begin = dest;
+	  _allocation = allocation;
+	  _mapped = mapped;
 	}
 	#endif
 
 	~dense_parameters()
 	{  if (_begin != nullptr && !_seeded)  // don't free weight vector if it is shared with another instance
-	   {  free(_begin);
+	   {  free_weights(_begin, _weight_mask + 1, _allocation, _mapped);
 	      _begin = nullptr;
 	   }
 	}
 };
 
+// the weights of sparse_parameters: an open addressing table (linear probing, at most half full) from the
+// index of each stride to its weights. The strides are carved from slabs which are neither moved nor freed
+// before the table is, so a weight& stays valid while other weights are added.
+struct sparse_slot
+{ uint64_t index;
+  weight* weights; // nullptr if the slot is empty
+};
+
+struct sparse_table
+{ sparse_slot* slots;
+  uint64_t slot_mask;
+  uint32_t slot_shift; // 64 - log2 of the number of slots, to take the top bits of the hashed index
+  size_t size; // of the strides in the table
+  std::vector<weight*> slabs;
+  weight* slab_next; // free weights left in the last slab
+  size_t slab_left;
+};
+
+const size_t sparse_min_slots = 64;
+const size_t sparse_max_slab = (size_t)1 << 18; // weights
+
 template <typename T>
 class sparse_iterator
 {
 private:
-	weight_map::iterator _iter;
+	sparse_slot* _slot;
+	sparse_slot* _end;
 	uint32_t _stride;
 
+	void skip_empty() { while (_slot != _end && _slot->weights == nullptr) ++_slot; }
+
 public:
 	typedef std::forward_iterator_tag iterator_category;
 	typedef T value_type;
@@ -204,107 +252,189 @@ public:
 
 	typedef weight_iterator_iterator w_iter;
 
-	sparse_iterator(weight_map::iterator& iter, uint32_t stride)
-		: _iter(iter), _stride(stride)
-	{ }
+	sparse_iterator(sparse_slot* slot, sparse_slot* end, uint32_t stride)
+		: _slot(slot), _end(end), _stride(stride)
+	{ skip_empty(); }
 
-	sparse_iterator& operator=(const sparse_iterator& other)
-	{
-		_iter = other._iter;
-		_stride = other._stride;
-		return *this;
-
-	}
-	uint64_t index() { return _iter->first; }
+	uint64_t index() { return _slot->index; }
 
-	T& operator*() { return *(_iter->second); }
+	T& operator*() { return *(_slot->weights); }
 
 	sparse_iterator& operator++()
 	{
-		_iter++;
+		++_slot;
+		skip_empty();
 		return *this;
 	}
 
-	bool operator==(const sparse_iterator& rhs) const { return _iter == rhs._iter; }
-	bool operator!=(const sparse_iterator& rhs) const { return _iter != rhs._iter; }
+	bool operator==(const sparse_iterator& rhs) const { return _slot == rhs._slot; }
+	bool operator!=(const sparse_iterator& rhs) const { return _slot != rhs._slot; }
 
 	//to iterate within a bucket
-	w_iter begin() { return w_iter(_iter->second);}
-	w_iter end() { return w_iter(_iter->second + _stride); }
-	w_iter end(size_t offset) { return w_iter(_iter->second + offset);}
+	w_iter begin() { return w_iter(_slot->weights);}
+	w_iter end() { return w_iter(_slot->weights + _stride); }
+	w_iter end(size_t offset) { return w_iter(_slot->weights + offset);}
 };
 
 
 class sparse_parameters
 {
 private:
-	weight_map _map;
+	sparse_table* _table; // of this instance, seeded ones point at the weights of the instance they copied
 	uint64_t _weight_mask;  // (stride*(1 << num_bits) -1)
 	uint32_t _stride_shift;
 	bool _seeded; // whether the instance is sharing model state with others
-	bool _delete;
 	void* default_data;
 public:
 	typedef sparse_iterator<weight> iterator;
 	typedef sparse_iterator<const weight> const_iterator;
  private:
 	void(*fun)(iterator&, void*);
+
+	static sparse_table* new_table()
+	{ sparse_table* t = new sparse_table();
+	  t->slots = calloc_or_throw<sparse_slot>(sparse_min_slots);
+	  t->slot_mask = sparse_min_slots - 1;
+	  t->slot_shift = 64 - 6;
+	  return t;
+	}
+
+	// a table of the strides of from, whose weights it points at, without from's slabs: strides it adds go
+	// in its own slots and slabs, so instances seeded from one model can each add strides in their own thread.
+	static sparse_table* copy_table(const sparse_table& from)
+	{ sparse_table* t = new sparse_table();
+	  t->slots = calloc_or_throw<sparse_slot>(from.slot_mask + 1);
+	  memcpy(t->slots, from.slots, (from.slot_mask + 1) * sizeof(sparse_slot));
+	  t->slot_mask = from.slot_mask;
+	  t->slot_shift = from.slot_shift;
+	  t->size = from.size;
+	  return t;
+	}
+
+	// frees the slots of t and the slabs it added strides to
+	static void free_table(sparse_table* t)
+	{ if (t == nullptr)
+	    return;
+	  for (weight* slab : t->slabs)
+	    free(slab);
+	  free(t->slots);
+	  delete t;
+	}
+
+	// the first slot to probe for index, by Fibonacci hashing as the low bits of indices are mostly 0
+	inline sparse_slot* home(uint64_t index) const
+	{ return _table->slots + ((index * 0x9E3779B97F4A7C15ULL) >> _table->slot_shift); }
+
+	// index, which is not in the table yet, is added in the empty slot s
+	weight& insert(sparse_slot* s, uint64_t index)
+	{ sparse_table& t = *_table;
+	  if (t.slab_left < stride())
+	  { size_t slab = std::min(std::max(t.size, (size_t)sparse_min_slots) << _stride_shift, sparse_max_slab);
+	    slab = std::max(slab, (size_t)stride());
+	    t.slabs.push_back(calloc_mergable_or_throw<weight>(slab));
+	    t.slab_next = t.slabs.back();
+	    t.slab_left = slab;
+	  }
+	  s->index = index;
+	  s->weights = t.slab_next;
+	  t.slab_next += stride();
+	  t.slab_left -= stride();
+	  t.size++;
+	  weight* w = s->weights;
+	  if (fun != nullptr)
+	  { iterator i(s, s + 1, stride());
+	    fun(i, default_data);
+	  }
+	  if (2 * t.size > t.slot_mask + 1)
+	    grow();
+	  return *w;
+	}
+
+	void grow()
+	{ sparse_table& t = *_table;
+	  sparse_slot* old = t.slots;
+	  size_t old_slots = t.slot_mask + 1;
+	  t.slots = calloc_or_throw<sparse_slot>(2 * old_slots);
+	  t.slot_mask = 2 * old_slots - 1;
+	  t.slot_shift--;
+	  for (sparse_slot* o = old; o != old + old_slots; ++o)
+	    if (o->weights != nullptr)
+	    { sparse_slot* s = home(o->index);
+	      while (s->weights != nullptr)
+	        s = t.slots + ((s - t.slots + 1) & t.slot_mask);
+	      *s = *o;
+	    }
+	  free(old);
+	}
+
  public:
 
 	sparse_parameters(size_t length, uint32_t stride_shift = 0)
-		: _map(),
+		: _table(new_table()),
 		_weight_mask((length << stride_shift) - 1),
 		_stride_shift(stride_shift),
-		_seeded(false), _delete(false), default_data(nullptr),
+		_seeded(false), default_data(nullptr),
 		fun(nullptr)
 	{}
 
 	sparse_parameters()
-		: _map(), _weight_mask(0), _stride_shift(0), _seeded(false), _delete(false), default_data(nullptr), fun(nullptr)
+		: _table(nullptr), _weight_mask(0), _stride_shift(0), _seeded(false), default_data(nullptr), fun(nullptr)
 	{}
 
-	bool not_null() { return (_weight_mask > 0 && !_map.empty()); }
+	bool not_null() { return (_weight_mask > 0 && _table != nullptr && _table->size > 0); }
 
-	sparse_parameters(const sparse_parameters &other) { shallow_copy(other); }
+	sparse_parameters(const sparse_parameters &other)
+		: _table(nullptr), _seeded(true), default_data(nullptr), fun(nullptr)
+	{ shallow_copy(other); }
 	sparse_parameters(sparse_parameters &&) = delete;
 
 	weight* first() { throw 1; } //TODO: Throw better exceptions. Allreduce currently not supported in sparse.
 
-	//iterator with stride
-	iterator begin() { weight_map::iterator i = _map.begin(); return iterator(i, stride()); }
-	iterator end() { weight_map::iterator i = _map.end(); return iterator(i, stride()); }
+	//iterator with stride, over the slots of the table
+	iterator begin() { return iterator(_table->slots, _table->slots + _table->slot_mask + 1, stride()); }
+	iterator end() { sparse_slot* e = _table->slots + _table->slot_mask + 1; return iterator(e, e, stride()); }
 
 	//const iterator
-	const_iterator cbegin() { weight_map::iterator i = _map.begin(); return const_iterator(i,  stride()); }
-	const_iterator cend() { weight_map::iterator i = _map.begin(); return const_iterator(i, stride()); }
+	const_iterator cbegin() { return const_iterator(_table->slots, _table->slots + _table->slot_mask + 1, stride()); }
+	const_iterator cend() { sparse_slot* e = _table->slots + _table->slot_mask + 1; return const_iterator(e, e, stride()); }
 
 	inline weight& operator[](size_t i)
-	{   uint64_t index = i & _weight_mask;
-		weight_map::iterator iter = _map.find(index);
-		if (iter == _map.end())
-		  {     _map.insert(std::make_pair(index, calloc_mergable_or_throw<weight>(stride())));
-			iter = _map.find(index);
-			if (fun != nullptr)
-			  {
-			    iterator i(iter,stride());
-			    fun(i, default_data);
-			  }
-			iter = _map.find(index);
-		}
-		return *(iter->second);
+	{ uint64_t index = i & _weight_mask;
+	  sparse_slot* s = home(index);
+	  while (s->weights != nullptr)
+	  { if (s->index == index)
+	      return *(s->weights);
+	    s = _table->slots + ((s - _table->slots + 1) & _table->slot_mask);
+	  }
+	  return insert(s, index);
+	}
+
+	// the weights at i, nullptr if they were never touched. unlike operator[] this doesn't add them.
+	inline weight* find(size_t i) const
+	{ uint64_t index = i & _weight_mask;
+	  for (sparse_slot* s = home(index); s->weights != nullptr; s = _table->slots + ((s - _table->slots + 1) & _table->slot_mask))
+	    if (s->index == index)
+	      return s->weights;
+	  return nullptr;
+	}
+
+	// whether weights which aren't in the table yet are 0, false when adding them initializes them
+	inline bool defaults_zero() const { return fun == nullptr; }
+
+	// starts loading the slot of i, which a later operator[] probes first
+	inline void prefetch(size_t i) const
+	{
+#ifdef __GNUC__
+	  __builtin_prefetch(home(i & _weight_mask));
+#endif
 	}
 
 	inline weight& strided_index(size_t index) { return operator[](index << _stride_shift); }
 
 	void shallow_copy(const sparse_parameters& input)
 	{
-		// TODO: this is level-1 copy (weight* are stilled shared)
-		if (!_seeded)
-		{
-			for (auto& pair : _map)
-				free(pair.second);
-		}
-		_map = input._map;
+		free_table(_table);
+		_table = copy_table(*input._table);
 		_weight_mask = input._weight_mask;
 		_stride_shift = input._stride_shift;
 		_seeded = true;
@@ -322,11 +452,11 @@ public:
 
 	void set_zero(size_t offset)
 	{
-		for (weight_map::iterator iter = _map.begin(); iter != _map.end(); ++iter)
-			(&(*(iter->second)))[offset] = 0;
+		for (iterator iter = begin(); iter != end(); ++iter)
+			(&(*iter))[offset] = 0;
 	}
 
-	uint64_t mask()	{ return _weight_mask; }
+	uint64_t mask() { return _weight_mask; }
 
 	uint64_t seeded() { return _seeded; }
 
@@ -343,15 +473,12 @@ public:
 #endif
 
 	~sparse_parameters()
-	{if (!_delete && !_seeded)  // don't free weight vector if it is shared with another instance
-		{
-		for (auto& pair : _map)
-			free(pair.second);
-		 _map.clear();
-		 _delete = true;
-		}
-    if (default_data != nullptr)
-      free(default_data);
+	{ free_table(_table); // the weights of the instance it was seeded from are in that one's slabs
+	  _table = nullptr;
+	  if (default_data != nullptr)
+	  { free(default_data);
+	    default_data = nullptr;
+	  }
 	}
 };
 
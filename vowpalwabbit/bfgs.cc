@@ -19,6 +19,7 @@ Implementation by Miro Dudik.
 #include "accumulate.h"
 #include "gd.h"
 #include "vw_exception.h"
+#include "weight_threads.h"
 
 using namespace std;
 using namespace LEARNER;
@@ -44,8 +45,8 @@ class curv_exception: public exception {} curv_ex;
 /********************************************************************/
 /* mem & w definition ***********************************************/
 /********************************************************************/
-// mem[2*i] = y_t
-// mem[2*i+1] = s_t
+// mem[(2*j+origin)%mem_stride*length + i] = y_t of record i, j steps back
+// mem[(2*j+1+origin)%mem_stride*length + i] = s_t of record i, j steps back
 //
 // w[0] = weight
 // w[1] = accumulated first derivative
@@ -164,20 +165,78 @@ float dot_with_direction(vw& all, example& ec)
   return temp;
 }
 
+// a vector of the history, origin rotates the slots: a float per record, which the sweeps below stream through
+inline float* mem_vector(vw& all, bfgs& b, float* mem, int slot, int origin)
+{ return mem + (size_t)((slot + origin) % b.mem_stride) * all.length();
+}
+
+/* The sweeps over all the weights call f(i, w) on the weights w of every record i. Dense weights are split
+   among --weight_threads threads in contiguous ranges. */
+template<class F> void for_records(vw& all, dense_parameters& weights, F f)
+{ float* first = weights.first();
+  uint32_t shift = weights.stride_shift();
+  for_weight_ranges(all, all.weight_threads, all.length(), [=](uint64_t begin, uint64_t end)
+  { for (uint64_t i = begin; i < end; i++)
+      f(i, first + (i << shift));
+  });
+}
+
+template<class F> void for_records(vw& all, sparse_parameters& weights, F f)
+{ for (sparse_parameters::iterator w = weights.begin(); w != weights.end(); ++w)
+    f(w.index() >> weights.stride_shift(), &(*w));
+}
+
+/* Sums what f(i, w, sums) adds to sums over the records. Dense weights are summed in 4 interleaved lanes,
+   which the compiler can keep in vector registers, a block of weight_block records at a time, then the
+   blocks are added in order: the sums don't depend on the number of threads. */
+template<size_t n, class F> void sum_records(vw& all, dense_parameters& weights, double (&sums)[n], F f)
+{ float* first = weights.first();
+  uint32_t shift = weights.stride_shift();
+  uint64_t length = all.length();
+  vector<double> blocks(n * ((length + weight_block - 1) / weight_block));
+  for_weight_ranges(all, all.weight_threads, length, [&](uint64_t begin, uint64_t end)
+  { for (uint64_t block = begin; block < end; block += weight_block)
+    { double lanes[4][n] = {};
+      uint64_t block_end = min(end, block + weight_block);
+      uint64_t i = block;
+      for (; i + 4 <= block_end; i += 4)
+      { f(i, first + (i << shift), lanes[0]);
+        f(i + 1, first + ((i + 1) << shift), lanes[1]);
+        f(i + 2, first + ((i + 2) << shift), lanes[2]);
+        f(i + 3, first + ((i + 3) << shift), lanes[3]);
+      }
+      for (; i < block_end; i++)
+        f(i, first + (i << shift), lanes[i & 3]);
+      for (size_t k = 0; k < n; k++)
+        blocks[block / weight_block * n + k] = (lanes[0][k] + lanes[1][k]) + (lanes[2][k] + lanes[3][k]);
+    }
+  });
+  for (size_t k = 0; k < n; k++)
+    sums[k] = 0.;
+  for (size_t b = 0; b < blocks.size(); b += n)
+    for (size_t k = 0; k < n; k++)
+      sums[k] += blocks[b + k];
+}
+
+template<size_t n, class F> void sum_records(vw& all, sparse_parameters& weights, double (&sums)[n], F f)
+{ for (size_t k = 0; k < n; k++)
+    sums[k] = 0.;
+  for (sparse_parameters::iterator w = weights.begin(); w != weights.end(); ++w)
+    f(w.index() >> weights.stride_shift(), &(*w), sums);
+}
+
 template<class T>
 double regularizer_direction_magnitude(vw& all, bfgs& b, float regularizer, T& weights)
 {
-	double ret = 0.;
-	if (b.regularizers == nullptr)
-		for (typename T::iterator iter = weights.begin(); iter != weights.end(); ++iter)
-			ret += regularizer* (&(*iter))[W_DIR] * (&(*iter))[W_DIR];
-
+	double ret[1];
+	float* regularizers = b.regularizers;
+	if (regularizers == nullptr)
+		sum_records(all, weights, ret, [=](uint64_t, float* w, double* s)
+		{ s[0] += regularizer * w[W_DIR] * w[W_DIR]; });
 	else
-	{
-		for (typename T::iterator iter = weights.begin(); iter != weights.end(); ++iter)
-		  ret += b.regularizers[2 * (iter.index() >> weights.stride_shift())] * (&(*iter))[W_DIR] * (&(*iter))[W_DIR];
-	}
-	return ret;
+		sum_records(all, weights, ret, [=](uint64_t i, float* w, double* s)
+		{ s[0] += regularizers[2 * i] * w[W_DIR] * w[W_DIR]; });
+	return ret[0];
 }
 
 double regularizer_direction_magnitude(vw& all, bfgs& b, float regularizer)
@@ -196,11 +255,9 @@ double regularizer_direction_magnitude(vw& all, bfgs& b, float regularizer)
 template<class T>
 float direction_magnitude(vw& all, T& weights)
 { //compute direction magnitude
-	double ret = 0.;
-	for (typename T::iterator iter = weights.begin(); iter != weights.end(); ++iter)
-		ret += (&(*iter))[W_DIR] * (&(*iter))[W_DIR];
-
-	return (float)ret;
+	double ret[1];
+	sum_records(all, weights, ret, [](uint64_t, float* w, double* s) { s[0] += w[W_DIR] * w[W_DIR]; });
+	return (float)ret[0];
 }
 
 float direction_magnitude(vw& all)
@@ -214,26 +271,24 @@ float direction_magnitude(vw& all)
 template<class T>
 void bfgs_iter_start(vw& all, bfgs& b, float* mem, int& lastj, double importance_weight_sum, int&origin, T& weights)
 {
-	double g1_Hg1 = 0.;
-	double g1_g1 = 0.;
-
 	origin = 0;
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  float* mem1 = mem + (w.index() >> weights.stride_shift()) * b.mem_stride;
-	  if (b.m>0)
-	    mem1[(MEM_XT + origin) % b.mem_stride] = (&(*w))[W_XT];
-	  mem1[(MEM_GT + origin) % b.mem_stride] = (&(*w))[W_GT];
-	  g1_Hg1 += ((&(*w))[W_GT]) * ((&(*w))[W_GT]) * ((&(*w))[W_COND]);
-	  g1_g1 += ((&(*w))[W_GT]) * ((&(*w))[W_GT]);
-	  (&(*w))[W_DIR] = -(&(*w))[W_COND] * ((&(*w))[W_GT]);
-	  ((&(*w))[W_GT]) = 0;
-	}
+	float* mem_xt = b.m > 0 ? mem_vector(all, b, mem, MEM_XT, origin) : nullptr;
+	float* mem_gt = mem_vector(all, b, mem, MEM_GT, origin);
+	double g1[2]; // g1_Hg1, g1_g1
+	sum_records(all, weights, g1, [=](uint64_t i, float* w, double* s)
+	{ if (mem_xt != nullptr)
+	    mem_xt[i] = w[W_XT];
+	  mem_gt[i] = w[W_GT];
+	  s[0] += w[W_GT] * w[W_GT] * w[W_COND];
+	  s[1] += w[W_GT] * w[W_GT];
+	  w[W_DIR] = -w[W_COND] * w[W_GT];
+	  w[W_GT] = 0;
+	});
 	lastj = 0;
 	if (!all.quiet)
 		fprintf(stderr, "%-10.5f\t%-10.5f\t%-10s\t%-10s\t%-10s\t",
-		g1_g1 / (importance_weight_sum*importance_weight_sum),
-		g1_Hg1 / importance_weight_sum, "", "", "");
+		g1[1] / (importance_weight_sum*importance_weight_sum),
+		g1[0] / importance_weight_sum, "", "", "");
 }
 
 void bfgs_iter_start(vw& all, bfgs& b, float* mem, int& lastj, double importance_weight_sum, int&origin)
@@ -246,43 +301,31 @@ void bfgs_iter_start(vw& all, bfgs& b, float* mem, int& lastj, double importance
 template<class T>
 void bfgs_iter_middle(vw& all, bfgs& b, float* mem, double* rho, double* alpha, int& lastj, int &origin, T& weights)
 {
-	float* mem0 = mem;
-	uint32_t length = 1 << all.num_bits;
 	// implement conjugate gradient
 	if (b.m == 0)
 	{
-		double g_Hy = 0.;
-		double g_Hg = 0.;
-		double y = 0.;
-
-
-		for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-		{
-		  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-			y = (&(*w))[W_GT] - mem[(MEM_GT + origin) % b.mem_stride];
-			g_Hy += ((&(*w))[W_GT]) * ((&(*w))[W_COND]) * y;
-			g_Hg += mem[(MEM_GT + origin) % b.mem_stride] * ((&(*w))[W_COND]) * mem[(MEM_GT + origin) % b.mem_stride];
-		}
+		float* mem_gt = mem_vector(all, b, mem, MEM_GT, origin);
+		double g[2]; // g_Hy, g_Hg
+		sum_records(all, weights, g, [=](uint64_t i, float* w, double* s)
+		{ double y = w[W_GT] - mem_gt[i];
+		  s[0] += w[W_GT] * w[W_COND] * y;
+		  s[1] += mem_gt[i] * w[W_COND] * mem_gt[i];
+		});
 
-		float beta = (float)(g_Hy / g_Hg);
+		float beta = (float)(g[0] / g[1]);
 
 		if (beta<0.f || nanpattern(beta))
 			beta = 0.f;
 
-		for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-		{
-		  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-			mem[(MEM_GT + origin) % b.mem_stride] = (&(*w))[W_GT];
-
-			(&(*w))[W_DIR] *= beta;
-			(&(*w))[W_DIR] -= ((&(*w))[W_COND])*((&(*w))[W_GT]);
-			(&(*w))[W_GT] = 0;
-		}
+		for_records(all, weights, [=](uint64_t i, float* w)
+		{ mem_gt[i] = w[W_GT];
+		  w[W_DIR] *= beta;
+		  w[W_DIR] -= w[W_COND] * w[W_GT];
+		  w[W_GT] = 0;
+		});
 		if (!all.quiet)
 			fprintf(stderr, "%f\t", beta);
 		return;
-
-		mem = mem0 + (length - 1)* b.mem_stride;
 	}
 	else
 	{
@@ -290,21 +333,19 @@ void bfgs_iter_middle(vw& all, bfgs& b, float* mem, double* rho, double* alpha,
 			fprintf(stderr, "%-10s\t", "");
 	}
 
-	// implement bfgs
-	double y_s = 0.;
-	double y_Hy = 0.;
-	double s_q = 0.;
-
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  float* mem1 = mem + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		mem1[(MEM_YT + origin) % b.mem_stride] = (&(*w))[W_GT] - mem1[(MEM_GT + origin) % b.mem_stride];
-		mem1[(MEM_ST + origin) % b.mem_stride] = (&(*w))[W_XT] - mem1[(MEM_XT + origin) % b.mem_stride];
-		(&(*w))[W_DIR] = (&(*w))[W_GT];
-		y_s += mem1[(MEM_YT + origin) % b.mem_stride] * mem1[(MEM_ST + origin) % b.mem_stride];
-		y_Hy += mem1[(MEM_YT + origin) % b.mem_stride] * mem1[(MEM_YT + origin) % b.mem_stride] * ((&(*w))[W_COND]);
-		s_q += mem1[(MEM_ST + origin) % b.mem_stride] * ((&(*w))[W_GT]);
-	}
+	// implement bfgs, y_t and s_t replace the g and x they are computed from
+	float* mem_yt = mem_vector(all, b, mem, MEM_YT, origin);
+	float* mem_st = mem_vector(all, b, mem, MEM_ST, origin);
+	double ys[3]; // y_s, y_Hy, s_q
+	sum_records(all, weights, ys, [=](uint64_t i, float* w, double* s)
+	{ mem_yt[i] = w[W_GT] - mem_yt[i];
+	  mem_st[i] = w[W_XT] - mem_st[i];
+	  w[W_DIR] = w[W_GT];
+	  s[0] += mem_yt[i] * mem_st[i];
+	  s[1] += mem_yt[i] * mem_yt[i] * w[W_COND];
+	  s[2] += mem_st[i] * w[W_GT];
+	});
+	double y_s = ys[0], y_Hy = ys[1], s_q = ys[2];
 
 	if (y_s <= 0. || y_Hy <= 0.)
 		throw curv_ex;
@@ -312,50 +353,51 @@ void bfgs_iter_middle(vw& all, bfgs& b, float* mem, double* rho, double* alpha,
 
 	float gamma = (float)(y_s / y_Hy);
 
+	double sums[1];
 	for (int j = 0; j<lastj; j++)
 	{
 		alpha[j] = rho[j] * s_q;
-		s_q = 0.;
-		for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-		{
-		  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-			(&(*w))[W_DIR] -= (float)alpha[j] * mem[(2 * j + MEM_YT + origin) % b.mem_stride];
-			s_q += mem[(2 * j + 2 + MEM_ST + origin) % b.mem_stride] * ((&(*w))[W_DIR]);
-		}
+		float alpha_j = (float)alpha[j];
+		float* y_j = mem_vector(all, b, mem, 2 * j + MEM_YT, origin);
+		float* s_next = mem_vector(all, b, mem, 2 * j + 2 + MEM_ST, origin);
+		sum_records(all, weights, sums, [=](uint64_t i, float* w, double* s)
+		{ w[W_DIR] -= alpha_j * y_j[i];
+		  s[0] += s_next[i] * w[W_DIR];
+		});
+		s_q = sums[0];
 	}
 
 	alpha[lastj] = rho[lastj] * s_q;
-	double y_r = 0.;
-
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		(&(*w))[W_DIR] -= (float)alpha[lastj] * mem[(2 * lastj + MEM_YT + origin) % b.mem_stride];
-		(&(*w))[W_DIR] *= gamma*((&(*w))[W_COND]);
-		y_r += mem[(2 * lastj + MEM_YT + origin) % b.mem_stride] * ((&(*w))[W_DIR]);
-	}
+	float alpha_last = (float)alpha[lastj];
+	float* y_last = mem_vector(all, b, mem, 2 * lastj + MEM_YT, origin);
+	sum_records(all, weights, sums, [=](uint64_t i, float* w, double* s)
+	{ w[W_DIR] -= alpha_last * y_last[i];
+	  w[W_DIR] *= gamma * w[W_COND];
+	  s[0] += y_last[i] * w[W_DIR];
+	});
+	double y_r = sums[0];
 
 	double coef_j;
 
 	for (int j = lastj; j>0; j--)
 	{
 		coef_j = alpha[j] - rho[j] * y_r;
-		y_r = 0.;
-		for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-		{
-		  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-			(&(*w))[W_DIR] += (float)coef_j*mem[(2 * j + MEM_ST + origin) % b.mem_stride];
-			y_r += mem[(2 * j - 2 + MEM_YT + origin) % b.mem_stride] * ((&(*w))[W_DIR]);
-		}
+		float coef = (float)coef_j;
+		float* s_j = mem_vector(all, b, mem, 2 * j + MEM_ST, origin);
+		float* y_prev = mem_vector(all, b, mem, 2 * j - 2 + MEM_YT, origin);
+		sum_records(all, weights, sums, [=](uint64_t i, float* w, double* s)
+		{ w[W_DIR] += coef * s_j[i];
+		  s[0] += y_prev[i] * w[W_DIR];
+		});
+		y_r = sums[0];
 	}
 
 
 	coef_j = alpha[0] - rho[0] * y_r;
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		(&(*w))[W_DIR] = -(&(*w))[W_DIR] - (float)coef_j*mem[(MEM_ST + origin) % b.mem_stride];
-	}
+	float coef_0 = (float)coef_j;
+	for_records(all, weights, [=](uint64_t i, float* w)
+	{ w[W_DIR] = -w[W_DIR] - coef_0 * mem_st[i];
+	});
 
 	/*********************
 	** shift
@@ -364,13 +406,13 @@ void bfgs_iter_middle(vw& all, bfgs& b, float* mem, double* rho, double* alpha,
 	lastj = (lastj<b.m - 1) ? lastj + 1 : b.m - 1;
 	origin = (origin + b.mem_stride - 2) % b.mem_stride;
 
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  mem = mem0 + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		mem[(MEM_GT + origin) % b.mem_stride] = (&(*w))[W_GT];
-		mem[(MEM_XT + origin) % b.mem_stride] = (&(*w))[W_XT];
-		(&(*w))[W_GT] = 0;
-	}
+	float* mem_gt = mem_vector(all, b, mem, MEM_GT, origin);
+	float* mem_xt = mem_vector(all, b, mem, MEM_XT, origin);
+	for_records(all, weights, [=](uint64_t i, float* w)
+	{ mem_gt[i] = w[W_GT];
+	  mem_xt[i] = w[W_XT];
+	  w[W_GT] = 0;
+	});
 	for (int j = lastj; j>0; j--)
 		rho[j] = rho[j - 1];
 }
@@ -386,20 +428,15 @@ void bfgs_iter_middle(vw& all, bfgs& b, float* mem, double* rho, double* alpha,
 template<class T>
 double wolfe_eval(vw& all, bfgs& b, float* mem, double loss_sum, double previous_loss_sum, double step_size, double importance_weight_sum, int &origin, double& wolfe1, T& weights)
 {
-	double g0_d = 0.;
-	double g1_d = 0.;
-	double g1_Hg1 = 0.;
-	double g1_g1 = 0.;
-
-
-	for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-	{
-	  float* mem1 = mem + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		g0_d += mem1[(MEM_GT + origin) % b.mem_stride] * ((&(*w))[W_DIR]);
-		g1_d += (&(*w))[W_GT] * (&(*w))[W_DIR];
-		g1_Hg1 += (&(*w))[W_GT] * (&(*w))[W_GT] * ((&(*w))[W_COND]);
-		g1_g1 += (&(*w))[W_GT] * (&(*w))[W_GT];
-	}
+	float* mem_gt = mem_vector(all, b, mem, MEM_GT, origin);
+	double g[4]; // g0_d, g1_d, g1_Hg1, g1_g1
+	sum_records(all, weights, g, [=](uint64_t i, float* w, double* s)
+	{ s[0] += mem_gt[i] * w[W_DIR];
+	  s[1] += w[W_GT] * w[W_DIR];
+	  s[2] += w[W_GT] * w[W_GT] * w[W_COND];
+	  s[3] += w[W_GT] * w[W_GT];
+	});
+	double g0_d = g[0], g1_d = g[1], g1_Hg1 = g[2], g1_g1 = g[3];
 
 	wolfe1 = (loss_sum - previous_loss_sum) / (step_size*g0_d);
 	double wolfe2 = g1_d / g0_d;
@@ -420,22 +457,21 @@ double wolfe_eval(vw& all, bfgs& b, float* mem, double loss_sum, double previous
 
 template <class T> double add_regularization(vw& all, bfgs& b, float regularization, T& weights)
 { //compute the derivative difference
-  double ret = 0.;
-
-  if (b.regularizers == nullptr)
-    for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-      {
-	(&(*w))[W_GT] += regularization*(*w);
-	ret += 0.5*regularization*(*w)*(*w);
-      }
+  double sums[1];
+  float* regularizers = b.regularizers;
+
+  if (regularizers == nullptr)
+    sum_records(all, weights, sums, [=](uint64_t, float* w, double* s)
+    { w[W_GT] += regularization * w[W_XT];
+      s[0] += 0.5 * regularization * w[W_XT] * w[W_XT];
+    });
   else
-    for (typename T::iterator w = weights.begin(); w != weights.end(); ++w)
-      {
-	uint64_t i = w.index() >> weights.stride_shift();
-	weight delta_weight = *w - b.regularizers[2 * i + 1];
-	(&(*w))[W_GT] += b.regularizers[2 * i] * delta_weight;
-	ret += 0.5*b.regularizers[2 * i] * delta_weight*delta_weight;
-      }
+    sum_records(all, weights, sums, [=](uint64_t i, float* w, double* s)
+    { weight delta_weight = w[W_XT] - regularizers[2 * i + 1];
+      w[W_GT] += regularizers[2 * i] * delta_weight;
+      s[0] += 0.5 * regularizers[2 * i] * delta_weight * delta_weight;
+    });
+  double ret = sums[0];
 
   // if we're not regularizing the intercept term, then subtract it off from the result above
   if (all.no_bias)
@@ -573,13 +609,10 @@ void zero_state(vw& all)
 template<class T>
 double derivative_in_direction(vw& all, bfgs& b, float* mem, int &origin, T& weights)
 {
-	double ret = 0.;
-	for (typename T::iterator w = weights.begin(); w != weights.end();  ++w)
-	{
-	  float* mem1 = mem + (w.index() >> weights.stride_shift()) * b.mem_stride;
-		ret += mem1[(MEM_GT + origin) % b.mem_stride] * (&(*w))[W_DIR];
-	}
-	return ret;
+	float* mem_gt = mem_vector(all, b, mem, MEM_GT, origin);
+	double ret[1];
+	sum_records(all, weights, ret, [=](uint64_t i, float* w, double* s) { s[0] += mem_gt[i] * w[W_DIR]; });
+	return ret[0];
 }
 
 double derivative_in_direction(vw& all, bfgs& b, float* mem, int &origin)
@@ -592,10 +625,9 @@ double derivative_in_direction(vw& all, bfgs& b, float* mem, int &origin)
 }
 
 template<class T>
-void update_weight(vw& all, float step_size, T& w)
+void update_weight(vw& all, float step_size, T& weights)
 {
-	for (typename T::iterator iter = w.begin(); iter != w.end(); ++iter)
-		(&(*iter))[W_XT] += step_size * (&(*iter))[W_DIR];
+	for_records(all, weights, [=](uint64_t, float* w) { w[W_XT] += step_size * w[W_DIR]; });
 }
 
 void update_weight(vw& all, float step_size)
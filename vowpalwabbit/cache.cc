@@ -7,6 +7,7 @@ license as described in the file LICENSE.
 #include "unique_sort.h"
 #include "global_data.h"
 #include "vw.h"
+#include "lz_block.h"
 
 using namespace std;
 
@@ -58,8 +59,12 @@ __attribute__((packed))
 #endif
 ;
 
+int read_cached_block_features(vw* all, example* ae);
+
 int read_cached_features(vw* all, v_array<example*>& examples)
 { example* ae = examples[0];
+  if (all->p->blocks != nullptr)
+    return read_cached_block_features(all, ae);
   ae->sorted = all->p->sorted_cache;
   io_buf* input = all->p->input;
 
@@ -191,3 +196,357 @@ void cache_features(io_buf& cache, example* ae, uint64_t mask)
   for (namespace_index ns : ae->indices)
     output_features(cache, ns, ae->feature_space[ns], mask);
 }
+
+void block_buf::flush()
+{ // called by buf_write when the next write doesn't fit: keep everything written and grow.
+  // resize zeroes past end(), which writing leaves at begin()
+  size_t used = head - space.begin();
+  space.end() = head;
+  space.resize(2 * (space.end_array - space.begin()));
+  head = space.begin() + used;
+}
+
+cache_blocks* new_cache_blocks(bool compress)
+{ cache_blocks* b = new cache_blocks;
+  b->stored = v_init<char>();
+  b->deltas = v_init<uint64_t>();
+  b->examples = 0;
+  memset(b->namespaces, 0, sizeof(b->namespaces));
+  b->compress = compress;
+  return b;
+}
+
+void free_cache_blocks(cache_blocks* b)
+{ if (b == nullptr)
+    return;
+  b->stored.delete_v();
+  b->deltas.delete_v();
+  delete b;
+}
+
+const unsigned char block_raw = 0;
+const unsigned char block_lz = 1;
+
+// feature values of a namespace: all 1, or 2 bits per feature followed by the general values
+const unsigned char values_ones = 0;
+const unsigned char values_coded = 1;
+const unsigned char value_one = 0;
+const unsigned char value_minus_one = 1;
+const unsigned char value_general = 2;
+
+inline unsigned bit_width(uint64_t v)
+{ unsigned bits = 0;
+  for (; v != 0; v >>= 1)
+    bits++;
+  return bits;
+}
+
+void output_block_features(io_buf& cache, unsigned char index, features& fs, uint64_t mask, v_array<uint64_t>& deltas)
+{ size_t n = fs.size();
+  // deltas and their width first, to know the size of the packed ones
+  if ((size_t)(deltas.end_array - deltas.begin()) < n)
+    deltas.resize(n);
+  uint64_t last = 0, any = 0;
+  bool ones = true;
+  for (size_t i = 0; i < n; i++)
+  { uint64_t fi = fs.indicies[i] & mask;
+    deltas[i] = ZigZagEncode((int64_t)(fi - last));
+    any |= deltas[i];
+    last = fi;
+    ones &= fs.values[i] == 1.f;
+  }
+  unsigned width = bit_width(any);
+  if (width > 56)  // keeps every value within one unaligned 8 byte load when decoding
+    width = 64;
+  size_t packed = (n * width + 7) / 8;
+
+  char* c;
+  size_t storage = sizeof(index) + int_size + 1 + packed + 1 + (ones ? 0 : (n + 3) / 4 + n * sizeof(feature_value));
+  buf_write(cache, c, storage);
+  *c++ = (char)index;
+  c = run_len_encode(c, n);
+  *c++ = (char)width;
+  if (width == 64)
+  { memcpy(c, deltas.begin(), n * sizeof(uint64_t));
+    c += n * sizeof(uint64_t);
+  }
+  else if (width > 0)
+  { memset(c, 0, packed);
+    for (size_t i = 0, bit = 0; i < n; i++, bit += width)
+    { uint64_t v = deltas[i] << (bit & 7);
+      for (size_t byte = bit >> 3; v != 0; byte++, v >>= 8)
+        c[byte] |= (char)(v & 255);
+    }
+    c += packed;
+  }
+
+  *c++ = (char)(ones ? values_ones : values_coded);
+  if (!ones)
+  { char* kinds = c;
+    memset(kinds, 0, (n + 3) / 4);
+    c += (n + 3) / 4;
+    for (size_t i = 0; i < n; i++)
+    { feature_value v = fs.values[i];
+      unsigned char kind = v == 1.f ? value_one : v == -1.f ? value_minus_one : value_general;
+      kinds[i >> 2] |= kind << (2 * (i & 3));
+      if (kind == value_general)
+      { memcpy(c, &v, sizeof(v));
+        c += sizeof(v);
+      }
+    }
+  }
+  cache.set(c);
+}
+
+void cache_block_example(vw& all, cache_blocks& b, example* ae)
+{ block_buf& data = b.data;
+  all.p->lp.cache_label(&ae->l, data);
+
+  char* c;
+  buf_write(data, c, int_size + ae->tag.size() + 1);
+  c = run_len_encode(c, ae->tag.size());
+  memcpy(c, ae->tag.begin(), ae->tag.size());
+  c += ae->tag.size();
+  *c++ = (char)ae->indices.size();
+  data.set(c);
+
+  for (namespace_index ns : ae->indices)
+  { b.namespaces[ns] = true;
+    output_block_features(data, ns, ae->feature_space[ns], all.parse_mask, b.deltas);
+  }
+
+  b.examples++;
+  if ((size_t)(data.head - data.space.begin()) >= all.p->cache_block_bytes)
+    flush_cache_block(b, *all.p->output);
+}
+
+void flush_cache_block(cache_blocks& b, io_buf& cache)
+{ block_buf& data = b.data;
+  uint32_t raw = (uint32_t)(data.head - data.space.begin());
+  if (b.examples > 0)
+  { const char* payload = data.space.begin();
+    uint32_t stored = raw;
+    unsigned char compression = block_raw;
+    if (b.compress)
+    { b.stored.resize(lz_compress_bound(raw));
+      size_t size = lz_compress(data.space.begin(), raw, b.stored.begin());
+      if (size < raw)
+      { payload = b.stored.begin();
+        stored = (uint32_t)size;
+        compression = block_lz;
+      }
+    }
+
+    uint16_t namespaces = 0;
+    for (size_t ns = 0; ns < 256; ns++)
+      namespaces += b.namespaces[ns];
+
+    char* c;
+    buf_write(cache, c, cache_block_header_size + namespaces);
+    memcpy(c, &b.examples, sizeof(b.examples));
+    c += sizeof(b.examples);
+    memcpy(c, &raw, sizeof(raw));
+    c += sizeof(raw);
+    memcpy(c, &stored, sizeof(stored));
+    c += sizeof(stored);
+    *c++ = (char)compression;
+    memcpy(c, &namespaces, sizeof(namespaces));
+    c += sizeof(namespaces);
+    for (size_t ns = 0; ns < 256; ns++)
+      if (b.namespaces[ns])
+        *c++ = (char)ns;
+    cache.set(c);
+    bin_write_fixed(cache, payload, stored);
+  }
+
+  data.head = data.space.begin();
+  data.space.end() = data.space.begin();
+  b.examples = 0;
+  memset(b.namespaces, 0, sizeof(b.namespaces));
+}
+
+inline const char* read_varint(const char* p, const char* end, uint64_t& v)
+{ v = 0;
+  for (unsigned shift = 0; p != end && shift < 64; shift += 7)
+  { v |= (uint64_t)(*p & 127) << shift;
+    if (!(*p++ & 128))
+      return p;
+  }
+  return nullptr;
+}
+
+// unpacks n deltas of width bits. width <= 56 keeps every one within an unaligned 8 byte load.
+const char* unpack_deltas(const char* p, const char* end, size_t n, unsigned width, uint64_t* out)
+{ if (width == 64)
+  { if ((size_t)(end - p) < n * sizeof(uint64_t))
+      return nullptr;
+    memcpy(out, p, n * sizeof(uint64_t));
+    return p + n * sizeof(uint64_t);
+  }
+  size_t packed = (n * width + 7) / 8;
+  if (width > 56 || (size_t)(end - p) < packed)
+    return nullptr;
+  uint64_t mask = ((uint64_t)1 << width) - 1;
+  size_t i = 0, bit = 0;
+  for (; i < n && (bit >> 3) + sizeof(uint64_t) <= packed; i++, bit += width)
+  { uint64_t w;
+    memcpy(&w, p + (bit >> 3), sizeof(w));
+    out[i] = (w >> (bit & 7)) & mask;
+  }
+  for (; i < n; i++, bit += width)  // the last few, whose 8 bytes would reach past the packed ones
+  { uint64_t w = 0;
+    memcpy(&w, p + (bit >> 3), packed - (bit >> 3));
+    out[i] = (w >> (bit & 7)) & mask;
+  }
+  return p + packed;
+}
+
+inline const char* read_block_header(const char* c, uint32_t& examples, uint32_t& raw, uint32_t& stored,
+                                     unsigned char& compression, uint16_t& namespaces)
+{ memcpy(&examples, c, sizeof(examples));
+  c += sizeof(examples);
+  memcpy(&raw, c, sizeof(raw));
+  c += sizeof(raw);
+  memcpy(&stored, c, sizeof(stored));
+  c += sizeof(stored);
+  compression = *c++;
+  memcpy(&namespaces, c, sizeof(namespaces));
+  return c + sizeof(namespaces);
+}
+
+uint64_t cache_block_extent(const char* header, uint32_t& examples)
+{ uint32_t raw, stored;
+  unsigned char compression;
+  uint16_t namespaces;
+  read_block_header(header, examples, raw, stored, compression, namespaces);
+  return cache_block_header_size + namespaces + stored;
+}
+
+bool read_cache_block(vw& all, cache_blocks& b, io_buf& input)
+{ char* c;
+  if (buf_read(input, c, cache_block_header_size) < cache_block_header_size)
+    return false;
+  uint32_t examples, raw, stored;
+  unsigned char compression;
+  uint16_t namespaces;
+  read_block_header(c, examples, raw, stored, compression, namespaces);
+
+  if (buf_read(input, c, namespaces) < namespaces)
+  { all.trace_message << "truncated cache block!" << endl;
+    return false;
+  }
+  memset(b.namespaces, 0, sizeof(b.namespaces));
+  for (size_t i = 0; i < namespaces; i++)
+    b.namespaces[(unsigned char)c[i]] = true;
+
+  if (buf_read(input, c, stored) < stored)
+  { all.trace_message << "truncated cache block! wanted: " << stored << " bytes" << endl;
+    return false;
+  }
+  block_buf& data = b.data;
+  data.space.end() = data.space.begin();
+  if ((size_t)(data.space.end_array - data.space.begin()) < raw)
+    data.space.resize(raw);
+  if (compression == block_lz)
+  { if (!lz_decompress(c, stored, data.space.begin(), raw))
+      THROW("cache block can't be decompressed, the cache file is corrupt");
+  }
+  else if (compression == block_raw && stored == raw)
+    memcpy(data.space.begin(), c, raw);
+  else
+    THROW("unknown cache block compression " << (int)compression << ", the cache file is corrupt");
+
+  data.space.end() = data.space.begin() + raw;
+  data.head = data.space.begin();
+  data.current = 0;
+  b.examples = examples;
+  return true;
+}
+
+int read_cached_block_features(vw* all, example* ae)
+{ cache_blocks& b = *all->p->blocks;
+  if (b.examples == 0 && !read_cache_block(*all, b, *all->p->input))
+    return 0;
+  return read_block_example(*all, b, ae);
+}
+
+int read_block_example(vw& all, cache_blocks& b, example* ae)
+{ b.examples--;
+
+  block_buf& data = b.data;
+  ae->sorted = all.p->sorted_cache;
+  const char* start = data.head;
+  if (all.p->lp.read_cached_label(all.sd, &ae->l, data) == 0)
+    THROW("truncated label in cache block, the cache file is corrupt");
+
+  const char* p = data.head;
+  const char* end = data.space.end();
+  uint64_t tag_size;
+  if ((p = read_varint(p, end, tag_size)) == nullptr || (uint64_t)(end - p) < tag_size + 1)
+    THROW("truncated tag in cache block, the cache file is corrupt");
+  ae->tag.erase();
+  push_many(ae->tag, p, tag_size);
+  p += tag_size;
+
+  for (unsigned char num_indices = *p++; num_indices > 0; num_indices--)
+  { uint64_t n;
+    if (p == end || !b.namespaces[(unsigned char)*p])
+      THROW("bad namespace in cache block, the cache file is corrupt");
+    unsigned char index = (unsigned char)*p++;
+    if ((p = read_varint(p, end, n)) == nullptr || p == end || n > UINT32_MAX)
+      THROW("bad feature count in cache block, the cache file is corrupt");
+    unsigned width = (unsigned char)*p++;
+    if ((n * width + 7) / 8 > (uint64_t)(end - p))  // before allocating for them
+      THROW("truncated features in cache block, the cache file is corrupt");
+    ae->indices.push_back((size_t)index);
+    features& fs = ae->feature_space[index];
+    size_t old = fs.size();
+    if ((size_t)(fs.values.end_array - fs.values.begin()) < old + n)
+      fs.values.resize(old + n);
+    if ((size_t)(fs.indicies.end_array - fs.indicies.begin()) < old + n)
+      fs.indicies.resize(old + n);
+
+    feature_index* indices = fs.indicies.begin() + old;
+    if ((p = unpack_deltas(p, end, n, width, indices)) == nullptr || p == end)
+      THROW("truncated features in cache block, the cache file is corrupt");
+    uint64_t last = 0;
+    for (size_t i = 0; i < n; i++)
+    { int64_t s_diff = ZigZagDecode(indices[i]);
+      if (s_diff < 0)
+        ae->sorted = false;
+      last += s_diff;
+      indices[i] = last;
+    }
+
+    feature_value* values = fs.values.begin() + old;
+    if (*p++ == values_ones)
+    { for (size_t i = 0; i < n; i++)
+        values[i] = 1.f;
+      fs.sum_feat_sq += n;
+    }
+    else
+    { const unsigned char* kinds = (const unsigned char*)p;
+      if ((size_t)(end - p) < (n + 3) / 4)
+        THROW("truncated features in cache block, the cache file is corrupt");
+      p += (n + 3) / 4;
+      for (size_t i = 0; i < n; i++)
+      { unsigned char kind = (kinds[i >> 2] >> (2 * (i & 3))) & 3;
+        if (kind == value_one)
+          values[i] = 1.f;
+        else if (kind == value_minus_one)
+          values[i] = -1.f;
+        else
+        { if ((size_t)(end - p) < sizeof(feature_value))
+            THROW("truncated features in cache block, the cache file is corrupt");
+          memcpy(&values[i], p, sizeof(feature_value));
+          p += sizeof(feature_value);
+        }
+        fs.sum_feat_sq += values[i] * values[i];
+      }
+    }
+    fs.values.end() += n;
+    fs.indicies.end() += n;
+  }
+  data.head = (char*)p;
+  return (int)(p - start);
+}
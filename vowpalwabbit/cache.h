@@ -17,3 +17,44 @@ void cache_features(io_buf& cache, example* ae, uint64_t mask);
 void output_byte(io_buf& cache, unsigned char s);
 void output_features(io_buf& cache, unsigned char index, features& fs, uint64_t mask);
 
+/* Cache format 2 (--cache_format 2) frames examples into blocks of about cache_block_size bytes, or
+   --cache_block_size. A block
+   starts with its example count, its raw and stored size, its compression and the table of namespaces
+   its examples use, followed by the examples, optionally compressed with lz_compress. Feature indices
+   are delta coded like in format 1, but bit packed with one width per namespace instead of varints,
+   so they are decoded without branching on every byte, and a block is decoded from memory. */
+const size_t cache_block_size = 1 << 18;
+
+// an io_buf over one block in memory: writing grows it instead of flushing, reading stops at its end
+class block_buf : public io_buf
+{
+public:
+  block_buf() { files.push_back(-1); }  // buf_read refills from files[current]
+  virtual ssize_t read_file(int, void*, size_t) { return 0; }
+  virtual void flush();
+};
+
+struct cache_blocks
+{ block_buf data; // examples of the block being written, or of the block being read
+  v_array<char> stored; // compressed block
+  v_array<uint64_t> deltas; // index deltas of the namespace being written
+  uint32_t examples; // examples written to data, or left to read from it
+  bool namespaces[256]; // namespaces used by the examples of the block
+  bool compress; // lz compress written blocks
+};
+
+// examples, raw size, stored size, compression, namespace count
+const size_t cache_block_header_size = 3 * sizeof(uint32_t) + sizeof(unsigned char) + sizeof(uint16_t);
+
+cache_blocks* new_cache_blocks(bool compress);
+void free_cache_blocks(cache_blocks* b);
+void cache_block_example(vw& all, cache_blocks& b, example* ae);
+// writes the examples cached so far as a block, and prepares b for reading
+void flush_cache_block(cache_blocks& b, io_buf& cache);
+// the example count and the size of the whole block whose header is at header
+uint64_t cache_block_extent(const char* header, uint32_t& examples);
+// reads the next block of a format 2 cache into b.data, false at the end of the cache
+bool read_cache_block(vw& all, cache_blocks& b, io_buf& input);
+// decodes the next of the b.examples examples left in b.data
+int read_block_example(vw& all, cache_blocks& b, example* ae);
+
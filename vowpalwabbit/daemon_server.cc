@@ -0,0 +1,524 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "daemon_server.h"
+#include "parse_example.h"
+#include "hash_memo.h"
+#include "global_data.h"
+#include "vw_exception.h"
+#include "vw.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+const char framed_protocol = 1;
+const char cache_protocol = 0;
+const uint32_t max_frame_size = 1 << 26;
+const size_t max_line = max_frame_size; // of a text example
+const size_t max_pending_output = 1 << 20; // bytes, past which the connection isn't read until its client catches up
+const size_t read_chunk = 1 << 16;
+const int max_events = 256;
+
+struct daemon_connection
+{ int fd;
+  bool known; // the protocol has been read from the first byte
+  bool framed;
+  bool eof; // the client is done sending, close once its predictions are written
+  uint32_t bad_frame; // the length of a frame too large to read, 0 if there is none
+  v_array<char> input; // received bytes, parsing starts at head
+  size_t head;
+  uint64_t last_example; // ring sequence number after the last example read from this connection
+
+  // guarded by the server's output_lock: the learner adds predictions, the parse thread sends them
+  v_array<char> output; // predictions the socket hasn't taken yet, sending starts at output_head
+  size_t output_head;
+  bool write_failed; // the client is gone, its predictions are dropped
+  uint32_t events; // the epoll events the connection is registered for, 0 if it isn't
+};
+
+struct daemon_server
+{ vw* all;
+  int epoll_fd;
+  int sigterm_pipe[2]; // written by the SIGTERM handler to wake up epoll_wait
+  size_t sink_index; // the entry of final_prediction_sink that follows the current example
+  daemon_connection** slot_connection; // per ring slot, the connection the example came from
+  daemon_connection* current; // of the example the learner is finishing, guarded by output_lock
+  std::mutex output_lock;
+  vector<daemon_connection*> connections;
+  size_t turn; // connection to take the next examples from
+  bool in_block; // the current connection is in the middle of an empty line terminated group of examples
+  v_array<char> frame; // framed examples are copied here to be newline terminated for the parser
+  bool stopping;
+};
+
+int sigterm_fd = -1;
+daemon_server* server = nullptr; // of queue_prediction
+
+void daemon_sigterm(int)
+{ char c = 0;
+  if (write(sigterm_fd, &c, 1) < 0) {}
+}
+
+bool next_record(daemon_connection& c, size_t& pos, char*& begin, size_t& len)
+{ char* p = c.input.begin() + pos;
+  size_t available = c.input.size() - pos;
+  if (c.framed)
+  { if (available < sizeof(uint32_t))
+      return false;
+    uint32_t n;
+    memcpy(&n, p, sizeof(n));
+    n = ntohl(n);
+    if (n > max_frame_size)
+    { c.bad_frame = n;
+      return false;
+    }
+    if (available < sizeof(uint32_t) + n)
+      return false;
+    begin = p + sizeof(uint32_t);
+    len = n;
+    pos += sizeof(uint32_t) + n;
+  }
+  else
+  { char* nl = (char*)memchr(p, '\n', available);
+    if (nl == nullptr)
+      return false;
+    begin = p;
+    len = nl - p;
+    if (len > 0 && begin[len-1] == '\r')
+      len--;
+    pos += nl - p + 1;
+  }
+  return true;
+}
+
+// with multiline examples, only hand out groups which have been received completely
+bool has_complete_block(daemon_connection& c)
+{ if (c.eof)
+    return true;
+  size_t pos = c.head;
+  char* begin;
+  size_t len;
+  while (next_record(c, pos, begin, len))
+    if (len == 0)
+      return true;
+  return false;
+}
+
+void close_connection(daemon_server& s, size_t i)
+{ daemon_connection* c = s.connections[i];
+  { std::lock_guard<std::mutex> lock(s.output_lock);
+    if (s.current == c)
+      s.current = nullptr;
+  }
+  close(c->fd);
+  c->input.delete_v();
+  c->output.delete_v();
+  delete c;
+  s.connections.erase(s.connections.begin() + i);
+  if (s.turn > i)
+    s.turn--;
+}
+
+size_t pending_output(daemon_connection& c) { return c.write_failed ? 0 : c.output.size() - c.output_head; }
+
+// c is read unless its input ended or its client is behind reading its predictions, and written while
+// predictions wait for the socket. Called with output_lock held.
+void update_events(daemon_server& s, daemon_connection& c)
+{ size_t pending = pending_output(c);
+  uint32_t events = (c.eof || pending > max_pending_output ? 0 : EPOLLIN) | (pending > 0 ? EPOLLOUT : 0);
+  if (events == c.events)
+    return;
+  epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = &c;
+  int op = c.events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+  if (epoll_ctl(s.epoll_fd, op, c.fd, &ev) < 0)
+    s.all->trace_message << "epoll_ctl: " << strerror(errno) << endl;
+  c.events = events;
+}
+
+// sends what the socket takes of the predictions of c without waiting. Called with output_lock held.
+void send_output(daemon_server& s, daemon_connection& c)
+{ while (pending_output(c) > 0)
+  { ssize_t w = send(c.fd, c.output.begin() + c.output_head, pending_output(c), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (w <= 0)
+    { cerr << "daemon: write error: " << strerror(errno) << ", dropping the predictions of a connection" << endl;
+      c.write_failed = true;
+      break;
+    }
+    c.output_head += w;
+  }
+  if (pending_output(c) == 0)
+  { c.output.erase();
+    c.output_head = 0;
+  }
+  update_events(s, c);
+}
+
+// the predictions written to the connection of the current example are queued, so a client which doesn't
+// read them holds up neither the learner nor the other clients
+bool queue_prediction(int f, const void* buf, size_t nbytes)
+{ daemon_server& s = *server;
+  std::lock_guard<std::mutex> lock(s.output_lock);
+  if (s.current == nullptr || f != s.current->fd)
+    return false;
+  daemon_connection& c = *s.current;
+  if (c.write_failed)
+    return true;
+  bool idle = pending_output(c) == 0;
+  push_many(c.output, (const char*)buf, nbytes);
+  if (idle)
+    send_output(s, c);
+  else
+    update_events(s, c);
+  return true;
+}
+
+void close_finished_connections(daemon_server& s)
+{ uint64_t finished = finished_examples(*s.all->p);
+  for (size_t i = 0; i < s.connections.size();)
+  { daemon_connection& c = *s.connections[i];
+    bool sent;
+    { std::lock_guard<std::mutex> lock(s.output_lock);
+      sent = pending_output(c) == 0;
+    }
+    if (c.eof && c.head == c.input.size() && finished >= c.last_example && sent && !(s.in_block && s.turn == i))
+      close_connection(s, i);
+    else
+      i++;
+  }
+}
+
+void accept_connections(daemon_server& s)
+{ while (true)
+  { int fd = accept(s.all->p->bound_sock, nullptr, nullptr);
+    if (fd < 0)
+    { if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        s.all->trace_message << "accept: " << strerror(errno) << endl;
+      return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char*)&on, sizeof(on));
+
+    daemon_connection* c = new daemon_connection;
+    c->fd = fd;
+    c->known = false;
+    c->framed = false;
+    c->eof = false;
+    c->bad_frame = 0;
+    c->input = v_init<char>();
+    c->head = 0;
+    c->last_example = 0;
+    c->output = v_init<char>();
+    c->output_head = 0;
+    c->write_failed = false;
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(s.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    { s.all->trace_message << "epoll_ctl: " << strerror(errno) << endl;
+      close(fd);
+      c->input.delete_v();
+      c->output.delete_v();
+      delete c;
+      continue;
+    }
+    c->events = EPOLLIN;
+    s.connections.push_back(c);
+  }
+}
+
+void end_of_input(daemon_server& s, daemon_connection& c)
+{ { std::lock_guard<std::mutex> lock(s.output_lock);
+    c.eof = true;
+    update_events(s, c);
+  }
+  if (c.head == c.input.size())
+    return;
+  if (!c.framed)
+  { if (c.input.last() != '\n')
+      c.input.push_back('\n');
+  }
+  else
+  { size_t pos = c.head;
+    char* begin;
+    size_t len;
+    while (next_record(c, pos, begin, len)) {}
+    if (pos != c.input.size() && c.bad_frame == 0)
+    { s.all->trace_message << "daemon: dropping a truncated frame" << endl;
+      c.input.end() = c.input.begin() + pos;
+    }
+  }
+}
+
+// a client which sent what can't be parsed gets the predictions of the examples before it, then its
+// connection is closed. The other connections are served on.
+void drop_input(daemon_server& s, daemon_connection& c, const string& reason)
+{ s.all->trace_message << "daemon: " << reason << ", closing the connection" << endl;
+  c.input.end() = c.input.begin() + c.head;
+  end_of_input(s, c);
+}
+
+void receive(daemon_server& s, daemon_connection& c)
+{ if ((size_t)(c.input.end_array - c.input.end()) < read_chunk)
+  { if (c.head > 0)
+    { // drop the bytes which have already been parsed before growing the buffer
+      size_t remaining = c.input.size() - c.head;
+      memmove(c.input.begin(), c.input.begin() + c.head, remaining);
+      c.input.end() = c.input.begin() + remaining;
+      c.head = 0;
+    }
+    if ((size_t)(c.input.end_array - c.input.end()) < read_chunk)
+      c.input.resize(c.input.size() + read_chunk);
+  }
+
+  ssize_t r = read(c.fd, c.input.end(), c.input.end_array - c.input.end());
+  if (r < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (r <= 0)
+  { end_of_input(s, c);
+    return;
+  }
+  c.input.end() += r;
+  if (!c.framed && c.input.size() - c.head > max_line && memchr(c.input.begin() + c.head, '\n', c.input.size() - c.head) == nullptr)
+  { drop_input(s, c, "line too long");
+    return;
+  }
+
+  if (!c.known)
+  { c.known = true;
+    if (c.input[c.head] == framed_protocol)
+    { c.framed = true;
+      c.head++;
+    }
+    else if (c.input[c.head] == cache_protocol)
+    { s.all->trace_message << "daemon: cache format clients are not supported with --multiplex, closing connection" << endl;
+      c.input.erase();
+      c.head = 0;
+      end_of_input(s, c);
+    }
+  }
+}
+
+void wait_for_input(daemon_server& s, bool closing)
+{ epoll_event events[max_events];
+  // poll while connections wait for the learner to finish their last examples
+  int n = epoll_wait(s.epoll_fd, events, max_events, closing ? 1 : -1);
+  if (n < 0)
+  { if (errno == EINTR)
+      return;
+    THROWERRNO("epoll_wait");
+  }
+  for (int i = 0; i < n; i++)
+  { daemon_connection* c = (daemon_connection*)events[i].data.ptr;
+    if (c == nullptr)
+      accept_connections(s);
+    else if (c == (daemon_connection*)&s)
+      s.stopping = true;
+    else
+    { if (events[i].events & EPOLLOUT)
+      { std::lock_guard<std::mutex> lock(s.output_lock);
+        send_output(s, *c);
+      }
+      if ((events[i].events & ~EPOLLOUT) && !c->eof)
+        receive(s, *c);
+    }
+  }
+}
+
+size_t take_examples(daemon_server& s, v_array<example*>& examples, size_t batch_size)
+{ vw& all = *s.all;
+  bool blocks = all.p->emptylines_separate_examples;
+  size_t total = 0;
+  size_t n = 0;
+  for (size_t visited = 0; visited < s.connections.size() && n < batch_size; visited++)
+  { if (s.turn >= s.connections.size())
+      s.turn = 0;
+    daemon_connection& c = *s.connections[s.turn];
+    if (!s.in_block && blocks && !has_complete_block(c))
+    { if (c.bad_frame != 0 && !c.eof) // with the group it ends
+        drop_input(s, c, "frame of " + to_string(c.bad_frame) + " bytes is too large");
+      s.turn++;
+      continue;
+    }
+
+    char* begin;
+    size_t len;
+    size_t pos = c.head;
+    while (n < batch_size && next_record(c, pos, begin, len))
+    { if (c.framed)
+      { s.frame.erase();
+        push_many(s.frame, begin, len);
+        s.frame.push_back('\n');
+        begin = s.frame.begin();
+      }
+      if (n > 0)
+        examples.push_back(&VW::get_unused_example(&all));
+      example* ae = examples[n++];
+      substring example = { begin, begin + len };
+      substring_to_example(&all, ae, example, parse_thread_memo(*all.p, 0));
+
+      size_t slot = ae - all.p->examples;
+      s.slot_connection[slot] = &c;
+      c.last_example = all.p->begin_parsed_examples;
+      total += pos - c.head;
+      c.head = pos;
+      if (blocks)
+      { s.in_block = len > 0;
+        if (!s.in_block && !has_complete_block(c))
+          break;
+      }
+    }
+    // the records before it were taken
+    if (c.bad_frame != 0 && !c.eof && !blocks && n < batch_size)
+      drop_input(s, c, "frame of " + to_string(c.bad_frame) + " bytes is too large");
+    if (c.head == c.input.size())
+    { c.input.erase();
+      c.head = 0;
+    }
+    // a group of multiline examples must not be interleaved with other connections
+    if (!s.in_block || c.eof)
+    { s.in_block = false;
+      s.turn++;
+    }
+  }
+  return total;
+}
+
+int read_features_daemon(vw* all, v_array<example*>& examples)
+{ daemon_server& s = *all->p->server;
+  size_t batch_size = max((size_t)1, min(all->p->ring_size / 2, all->p->reader_budget));
+  while (true)
+  { close_finished_connections(s);
+    size_t total = take_examples(s, examples, batch_size);
+    if (total > 0)
+      return (int)total;
+    if (s.stopping)
+    { mark_done(*all->p);
+      return 0;
+    }
+    bool closing = false;
+    for (daemon_connection* c : s.connections)
+      closing |= c->eof;
+    wait_for_input(s, closing);
+  }
+}
+
+void select_daemon_output(daemon_server& s, size_t ring_index)
+{ vw& all = *s.all;
+  daemon_connection* c = s.slot_connection[ring_index];
+  { std::lock_guard<std::mutex> lock(s.output_lock);
+    s.current = c;
+  }
+  all.final_prediction_sink[s.sink_index] = c->fd;
+  all.print = c->framed ? binary_print_result : print_result;
+}
+
+void init_daemon_server(vw& all)
+{ daemon_server* s = new daemon_server;
+  s->all = &all;
+  s->turn = 0;
+  s->in_block = false;
+  s->stopping = false;
+  s->frame = v_init<char>();
+  s->slot_connection = calloc_or_throw<daemon_connection*>(all.p->ring_size);
+  s->current = nullptr;
+
+  s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (s->epoll_fd < 0)
+    THROWERRNO("epoll_create1");
+
+  int flags = fcntl(all.p->bound_sock, F_GETFL, 0);
+  if (flags < 0 || fcntl(all.p->bound_sock, F_SETFL, flags | O_NONBLOCK) < 0)
+    THROWERRNO("fcntl");
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, all.p->bound_sock, &ev) < 0)
+    THROWERRNO("epoll_ctl");
+
+  // SIGTERM ends the daemon through the parser, so that the model is saved like with the forking daemon
+  if (pipe(s->sigterm_pipe) < 0)
+    THROWERRNO("pipe");
+  ev.data.ptr = s;
+  if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->sigterm_pipe[0], &ev) < 0)
+    THROWERRNO("epoll_ctl");
+  sigterm_fd = s->sigterm_pipe[1];
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = daemon_sigterm;
+  sigaction(SIGTERM, &sa, nullptr);
+  // a client which disconnects early must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+
+  s->sink_index = all.final_prediction_sink.size();
+  all.final_prediction_sink.push_back(-1);
+  all.print = print_result;
+  all.p->reader = read_features_daemon;
+  all.p->server = s;
+  server = s;
+  io_buf::queue_write = queue_prediction;
+}
+
+void free_daemon_server(parser* p)
+{ daemon_server* s = p->server;
+  if (s == nullptr)
+    return;
+  io_buf::queue_write = nullptr;
+  server = nullptr;
+  // the learner is done, the predictions still queued are written out before the connections are closed
+  for (daemon_connection* c : s->connections)
+    for (ssize_t w = 0; pending_output(*c) > 0; c->output_head += w)
+    { w = send(c->fd, c->output.begin() + c->output_head, pending_output(*c), MSG_NOSIGNAL);
+      if (w <= 0)
+        break;
+    }
+  while (!s->connections.empty())
+    close_connection(*s, s->connections.size() - 1);
+  // the connections are closed here, not with the prediction files
+  s->all->final_prediction_sink[s->sink_index] = -1;
+  close(s->epoll_fd);
+  close(s->sigterm_pipe[0]);
+  close(s->sigterm_pipe[1]);
+  sigterm_fd = -1;
+  free(s->slot_connection);
+  s->frame.delete_v();
+  delete s;
+  p->server = nullptr;
+}
+
+#else
+
+void init_daemon_server(vw&)
+{ THROW("--multiplex is only supported on Linux");
+}
+
+void free_daemon_server(parser*) {}
+
+int read_features_daemon(vw*, v_array<example*>&)
+{ return 0;
+}
+
+void select_daemon_output(daemon_server&, size_t) {}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include "v_array.h"
+
+struct vw;
+struct parser;
+struct example;
+
+/* --daemon --multiplex: a single process serves every client connection from one epoll loop in the
+   parse thread, instead of forking --num_children processes which serve one connection each.
+   Complete requests from all readable connections are batched into the example ring, and the
+   prediction of every example is written back to the connection it came from.
+
+   A connection speaks one of two protocols, chosen by its first byte:
+   - text: newline terminated examples, answered by one text prediction line per example, as with
+     the forking daemon.
+   - framed (first byte 0x01): every example is sent as a 4 byte big-endian length followed by the
+     example in text format, answered by the 8 byte binary prediction of binary_print_result.
+   The unframed cache format sent by --sendto (first byte 0x00) can't be split into examples without
+   parsing them, such clients have to use the forking daemon.
+
+   Predictions are queued per connection and sent as its socket takes them, a connection with more
+   than a megabyte of them unsent isn't read until its client catches up. A connection which sends a
+   frame or a text line over 64 MB is answered up to it, then closed. */
+struct daemon_server;
+
+void init_daemon_server(vw& all);
+void free_daemon_server(parser* p);
+int read_features_daemon(vw* all, v_array<example*>& examples);
+// called by the learner when it takes the example in ring_index, points the prediction output at its client
+void select_daemon_output(daemon_server& s, size_t ring_index);
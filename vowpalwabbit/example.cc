@@ -5,6 +5,7 @@ license as described in the file LICENSE.
  */
 #include <stdint.h>
 #include "gd.h"
+#include "example_arena.h"
 
 float collision_cleanup(features& fs)
 { uint64_t last_index = (uint64_t)-1;
@@ -183,6 +184,9 @@ void dealloc_example(void(*delete_label)(void*), example&ec, void(*delete_predic
 
   for (size_t j = 0; j < 256; j++)
     ec.feature_space[j].delete_v();
+  ec.interactions.delete_v();
+  free_example_arena(ec.arena);
+  ec.arena = nullptr;
 
   ec.indices.delete_v();
 }
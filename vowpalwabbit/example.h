@@ -51,6 +51,7 @@ typedef union
 } polyprediction;
 
 typedef unsigned char namespace_index;
+struct example_arena;
 
 struct example // core example datatype.
 { class iterator
@@ -97,6 +98,9 @@ struct example // core example datatype.
   float total_sum_feat_sq;//precomputed, cause it's kind of fast & easy.
   float confidence;
   features* passthrough; // if a higher-up reduction wants access to internal state of lower-down reductions, they go here
+  features interactions; // interaction features expanded without ft_offset, with --interaction_cache
+  uint64_t interactions_key; // of the features interactions were expanded from, 0 if they weren't
+  example_arena* arena; // of the audit strings of the parsed features, nullptr until a parser needs it, see example_arena.h
 
   bool test_only;
   bool end_pass;//special example indicating end of pass.
@@ -0,0 +1,58 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <deque>
+#include <memory>
+#include "example_arena.h"
+
+using namespace std;
+
+struct audit_pool
+{ deque<audit_strings> strings; // a deque doesn't move them as it grows
+  size_t used;
+};
+
+struct example_arena
+{ shared_ptr<audit_pool> audit;
+};
+
+example_arena* new_example_arena()
+{ return new example_arena();
+}
+
+void free_example_arena(example_arena* a)
+{ delete a;
+}
+
+example_arena& arena_of(example& ec)
+{ if (ec.arena == nullptr)
+    ec.arena = new_example_arena();
+  return *ec.arena;
+}
+
+audit_strings_ptr arena_audit_strings(example_arena& a, const char* space, const char* feature, size_t length)
+{ if (!a.audit)
+  { a.audit = make_shared<audit_pool>();
+    a.audit->used = 0;
+  }
+  audit_pool& pool = *a.audit;
+  if (pool.used == pool.strings.size())
+    pool.strings.emplace_back();
+  audit_strings& s = pool.strings[pool.used++];
+  // assigning reuses the capacity of the strings of an earlier example
+  s.first.assign(space);
+  s.second.assign(feature, length);
+  return audit_strings_ptr(a.audit, &s);
+}
+
+void reset_example_arena(example& ec)
+{ if (ec.arena == nullptr || !ec.arena->audit)
+    return;
+  shared_ptr<audit_pool>& audit = ec.arena->audit;
+  if (audit.use_count() > 1)
+    audit.reset();
+  else
+    audit->used = 0;
+}
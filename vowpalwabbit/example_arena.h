@@ -0,0 +1,29 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include "example.h"
+
+/* The audit strings the parsers add to an example. They are kept in a pool of the example and handed out
+   as shared pointers sharing the pool's count, so a feature costs no allocation once the pool is warm and
+   its strings have the capacity of those of earlier examples. The pool is reused by the next example
+   unless audit strings of this one are still referenced elsewhere, then it's left to them: the strings
+   live as long as any pointer to them, like strings allocated one by one. The values and indices of the
+   features stay in the v_arrays of their groups. */
+
+struct example_arena;
+
+example_arena* new_example_arena();
+void free_example_arena(example_arena* arena);
+
+// the arena of ec, for the features a parser is about to add
+example_arena& arena_of(example& ec);
+
+// the strings space and feature, the first length bytes of feature, held by the arena
+audit_strings_ptr arena_audit_strings(example_arena& arena, const char* space, const char* feature, size_t length);
+
+// called once the features of ec were erased, its audit strings are reused by the next example
+void reset_example_arena(example& ec);
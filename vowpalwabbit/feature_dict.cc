@@ -0,0 +1,230 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "feature_dict.h"
+#include "example.h"
+#include "vw_exception.h"
+#include "memory.h"
+#include <fstream>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+struct dict_builder
+{ vector<dict_entry> entries;
+  string words;
+  vector<uint64_t> indices;
+  vector<float> values;
+  vector<uint64_t> table; // 1 + index of the entry in each slot, 0 if empty
+};
+
+dict_builder* new_dict_builder()
+{ dict_builder* b = new dict_builder;
+  b->table.resize(1024);
+  return b;
+}
+
+// the slot of word in table, or the empty slot where it belongs
+uint64_t builder_slot(dict_builder& b, const char* word, size_t length, uint64_t hash)
+{ uint64_t mask = b.table.size() - 1;
+  uint64_t i = hash & mask;
+  for (; b.table[i] != 0; i = (i + 1) & mask)
+  { dict_entry& e = b.entries[b.table[i] - 1];
+    if (e.hash == hash && e.word_length == length && b.words.compare(e.word, length, word, length) == 0)
+      break;
+  }
+  return i;
+}
+
+bool dict_contains(dict_builder& b, const char* word, size_t length, uint64_t hash)
+{ return b.table[builder_slot(b, word, length, hash)] != 0;
+}
+
+void dict_add(dict_builder& b, const char* word, size_t length, uint64_t hash, features& fs)
+{ dict_entry e;
+  e.hash = hash;
+  e.word = b.words.size();
+  e.first = b.indices.size();
+  e.word_length = (uint32_t)length;
+  e.count = (uint32_t)fs.size();
+  e.sum_feat_sq = fs.sum_feat_sq;
+  e.unused = 0;
+  b.words.append(word, length);
+  b.indices.insert(b.indices.end(), fs.indicies.begin(), fs.indicies.end());
+  b.values.insert(b.values.end(), fs.values.begin(), fs.values.end());
+  b.entries.push_back(e);
+  b.table[builder_slot(b, word, length, hash)] = b.entries.size();
+
+  if (b.entries.size() * 2 > b.table.size())
+  { b.table.assign(b.table.size() * 2, 0);
+    for (size_t j = 0; j < b.entries.size(); j++)
+    { dict_entry& f = b.entries[j];
+      b.table[builder_slot(b, b.words.data() + f.word, f.word_length, f.hash)] = j + 1;
+    }
+  }
+}
+
+namespace
+{
+size_t padded(size_t bytes) { return (bytes + 7) / 8 * 8; }
+
+size_t block_bytes(const dict_header& h)
+{ return sizeof(dict_header) + h.slots * sizeof(dict_entry) + h.word_bytes + h.features * (sizeof(uint64_t) + sizeof(float));
+}
+
+// whether the entries of a table point into its words and features, and it has an empty slot ending
+// every probe of dict_find
+bool slots_valid(const dict_header& h, const dict_entry* slots)
+{ uint64_t entries = 0;
+  for (uint64_t i = 0; i < h.slots; i++)
+  { const dict_entry& e = slots[i];
+    if (e.word_length == 0)
+      continue;
+    if (e.word > h.word_bytes || e.word_length > h.word_bytes - e.word
+        || e.count == 0 || e.first > h.features || e.count > h.features - e.first)
+      return false;
+    entries++;
+  }
+  return entries == h.entries && entries < h.slots;
+}
+
+void release(void* block, size_t bytes, bool mapped)
+{
+#ifndef _WIN32
+  if (mapped)
+  { munmap(block, bytes);
+    return;
+  }
+#endif
+  free(block);
+}
+
+// points the arrays of dict into its block
+feature_dict* locate(void* block, size_t bytes, bool mapped)
+{ feature_dict* dict = calloc_or_throw<feature_dict>(1);
+  dict->block = block;
+  dict->bytes = bytes;
+  dict->mapped = mapped;
+  dict->header = (const dict_header*)block;
+  dict->slots = (const dict_entry*)(dict->header + 1);
+  dict->words = (const char*)(dict->slots + dict->header->slots);
+  dict->indices = (const uint64_t*)(dict->words + dict->header->word_bytes);
+  dict->values = (const float*)(dict->indices + dict->header->features);
+  return dict;
+}
+}
+
+feature_dict* dict_build(dict_builder* b, bool hash_all)
+{ dict_header h;
+  memcpy(h.magic, dict_magic, sizeof(h.magic));
+  h.byte_order = dict_byte_order;
+  h.hash_all = hash_all;
+  h.entries = b->entries.size();
+  h.slots = 1;
+  while (h.slots < 2 * h.entries)
+    h.slots <<= 1;
+  h.word_bytes = padded(b->words.size());
+  h.features = b->indices.size();
+
+  size_t bytes = block_bytes(h);
+  char* block = calloc_or_throw<char>(bytes);
+  memcpy(block, &h, sizeof(h));
+  dict_entry* slots = (dict_entry*)(block + sizeof(h));
+  uint64_t mask = h.slots - 1;
+  for (dict_entry& e : b->entries)
+  { uint64_t i = e.hash & mask;
+    while (slots[i].word_length != 0)
+      i = (i + 1) & mask;
+    slots[i] = e;
+  }
+  char* words = (char*)(slots + h.slots);
+  memcpy(words, b->words.data(), b->words.size());
+  uint64_t* indices = (uint64_t*)(words + h.word_bytes);
+  if (h.features > 0)
+  { memcpy(indices, b->indices.data(), h.features * sizeof(uint64_t));
+    memcpy(indices + h.features, b->values.data(), h.features * sizeof(float));
+  }
+  delete b;
+  return locate(block, bytes, false);
+}
+
+bool is_compiled_dict(const string& file)
+{ ifstream in(file.c_str(), ios::binary);
+  char magic[sizeof(dict_magic)];
+  return in.read(magic, sizeof(magic)) && memcmp(magic, dict_magic, sizeof(magic)) == 0;
+}
+
+feature_dict* map_compiled_dict(const string& file, bool hash_all)
+{ void* block = nullptr;
+  size_t bytes = 0;
+  bool mapped = false;
+#ifndef _WIN32
+  int fd = open(file.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(dict_header))
+  { bytes = (size_t)st.st_size;
+    block = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    mapped = block != MAP_FAILED;
+    if (!mapped)
+      block = nullptr;
+  }
+  if (fd >= 0)
+    close(fd);
+#endif
+  if (block == nullptr)
+  { // read it into memory where it can't be mapped
+    ifstream in(file.c_str(), ios::binary | ios::ate);
+    if (!in)
+      THROW("error: cannot read compiled dictionary '" << file << "'");
+    bytes = (size_t)in.tellg();
+    block = calloc_or_throw<char>(bytes + 1);
+    in.seekg(0);
+    if (!in.read((char*)block, bytes))
+    { free(block);
+      THROW("error: cannot read compiled dictionary '" << file << "'");
+    }
+  }
+
+  const dict_header& h = *(const dict_header*)block;
+  const char* problem = nullptr;
+  if (bytes < sizeof(dict_magic) || memcmp(h.magic, dict_magic, sizeof(dict_magic)) != 0)
+    problem = "is not a compiled dictionary";
+  else if (bytes < sizeof(dict_header))
+    problem = "is truncated or corrupt";
+  else if (h.byte_order != dict_byte_order)
+    problem = "was compiled on a machine of a different byte order";
+  else if (h.slots == 0 || (h.slots & (h.slots - 1)) != 0 || h.entries >= h.slots || h.word_bytes % 8 != 0
+           || h.slots > bytes / sizeof(dict_entry) || h.word_bytes > bytes || h.features > bytes
+           || block_bytes(h) != bytes)
+    problem = "is truncated or corrupt";
+  else if (!slots_valid(h, (const dict_entry*)(&h + 1)))
+    problem = "is corrupt";
+  else if ((h.hash_all != 0) != hash_all)
+    problem = hash_all ? "was compiled with --hash strings, not --hash all" : "was compiled with --hash all, not --hash strings";
+  if (problem != nullptr)
+  { release(block, bytes, mapped);
+    THROW("error: dictionary '" << file << "' " << problem);
+  }
+  return locate(block, bytes, mapped);
+}
+
+void write_compiled_dict(const feature_dict& dict, const string& file)
+{ ofstream out(file.c_str(), ios::binary | ios::trunc);
+  if (!out.write((const char*)dict.block, dict.bytes) || !out.flush())
+    THROW("error: cannot write compiled dictionary '" << file << "'");
+}
+
+void free_feature_dict(feature_dict* dict)
+{ if (dict == nullptr)
+    return;
+  release(dict->block, dict->bytes, dict->mapped);
+  free(dict);
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+/* The features of --dictionary words, added by the parser for every feature of the namespaces the
+   dictionary is attached to. A dictionary is one contiguous block: a header, an open addressing table
+   on the uniform_hash of the words (linear probing, at most half full), the word bytes and the feature
+   indices and values of all words. The block is the same in memory and on disk, so a dictionary
+   compiled with --dictionary_compile is memory mapped read only and looked up in place, without
+   parsing or allocating per word; processes mapping the same file share its pages.
+
+   Feature indices are hashed with the hash function the dictionary was compiled with (--hash), they
+   don't depend on -b. A dictionary is never modified once built, lookups need no lock. */
+
+struct features;
+
+const char dict_magic[8] = { 'V', 'W', 'D', 'I', 'C', 'T', '1', '\0' };
+const uint64_t dict_byte_order = 0x0102030405060708ULL;
+
+struct dict_header
+{ char magic[8];
+  uint64_t byte_order; // dict_byte_order as written, files of the other byte order are rejected
+  uint64_t hash_all; // 1 if the feature indices were hashed with --hash all, 0 with --hash strings
+  uint64_t slots; // size of the table, a power of 2
+  uint64_t entries;
+  uint64_t word_bytes; // padded to a multiple of 8
+  uint64_t features;
+};
+
+struct dict_entry
+{ uint64_t hash; // uniform_hash of the word with quadratic_constant
+  uint64_t word; // offset of the word in the word bytes
+  uint64_t first; // of its features in the indices and values
+  uint32_t word_length; // 0 if the slot is empty
+  uint32_t count; // of its features, never 0
+  float sum_feat_sq;
+  uint32_t unused;
+};
+
+struct feature_dict
+{ const dict_header* header;
+  const dict_entry* slots;
+  const char* words;
+  const uint64_t* indices;
+  const float* values;
+  void* block; // the header and everything after it
+  size_t bytes;
+  bool mapped; // block is a read only mapping of a compiled dictionary, otherwise malloc'ed
+};
+
+// the entry of word, nullptr if it's not in the dictionary
+inline const dict_entry* dict_find(const feature_dict& dict, const char* word, size_t length, uint64_t hash)
+{ uint64_t mask = dict.header->slots - 1;
+  for (uint64_t i = hash & mask;; i = (i + 1) & mask)
+  { const dict_entry& e = dict.slots[i];
+    if (e.word_length == 0)
+      return nullptr;
+    if (e.hash == hash && e.word_length == length && memcmp(dict.words + e.word, word, length) == 0)
+      return &e;
+  }
+}
+
+// collects the words of a text dictionary
+struct dict_builder;
+dict_builder* new_dict_builder();
+bool dict_contains(dict_builder& b, const char* word, size_t length, uint64_t hash);
+// adds a word which isn't in the dictionary yet, with at least one feature
+void dict_add(dict_builder& b, const char* word, size_t length, uint64_t hash, features& fs);
+// the dictionary of the words added, b is freed
+feature_dict* dict_build(dict_builder* b, bool hash_all);
+
+bool is_compiled_dict(const std::string& file);
+// maps a compiled dictionary, throws if it's malformed or was compiled with a different --hash
+feature_dict* map_compiled_dict(const std::string& file, bool hash_all);
+void write_compiled_dict(const feature_dict& dict, const std::string& file);
+void free_feature_dict(feature_dict* dict);
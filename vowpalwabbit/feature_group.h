@@ -290,39 +290,8 @@ struct features
     sum_feat_sq += v*v;
   }
 
-  bool sort(uint64_t parse_mask)
-  { if (indicies.size() == 0)
-      return false;
-
-    if (space_names.size() != 0)
-    { v_array<feature_slice> slice = v_init<feature_slice>();
-      for (size_t i = 0; i < indicies.size(); i++)
-      { feature_slice temp = { values[i], indicies[i] & parse_mask, *space_names[i].get()};
-        slice.push_back(temp);
-      }
-      qsort(slice.begin(), slice.size(), sizeof(feature_slice), order_features<feature_slice>);
-      for (size_t i = 0; i < slice.size(); i++)
-      { values[i] = slice[i].x;
-        indicies[i] = slice[i].weight_index;
-        *space_names[i].get() = slice[i].space_name;
-      }
-      slice.delete_v();
-    }
-    else
-    { v_array<feature> slice = v_init<feature>();
-      for (size_t i = 0; i < indicies.size(); i++)
-      { feature temp = { values[i], indicies[i] & parse_mask};
-        slice.push_back(temp);
-      }
-      qsort(slice.begin(), slice.size(), sizeof(feature), order_features<feature>);
-      for (size_t i = 0; i < slice.size(); i++)
-      { values[i] = slice[i].x;
-        indicies[i] = slice[i].weight_index;
-      }
-      slice.delete_v();
-    }
-    return true;
-  }
+  // sorts by the masked index, equal indices by value, see unique_sort.cc. false if there's nothing to sort.
+  bool sort(uint64_t parse_mask);
 
   void deep_copy_from(const features& src)
   { copy_array(values, src.values);
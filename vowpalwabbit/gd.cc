@@ -44,14 +44,15 @@ struct gd
   float neg_norm_power;
   float neg_power_t;
   float sparse_l2;
-  float update_multiplier;
   void (*predict)(gd&, base_learner&, example&);
   void (*learn)(gd&, base_learner&, example&);
   void (*update)(gd&, base_learner&, example&);
   float (*sensitivity)(gd&, base_learner&, example&);
   void (*multipredict)(gd&, base_learner&, example&, size_t, size_t, polyprediction*, bool);
+  void (*predict_batch)(gd&, base_learner&, example**, size_t);
   bool normalized;
   bool adaptive;
+  hogwild_state* hogwild; // while threads learn, nullptr otherwise
 
   vw* all; //parallel, features, parameters
 };
@@ -108,26 +109,32 @@ inline void update_feature(float& update, float x, float& fw)
 
 //this deals with few nonzero features vs. all nonzero features issues.
 template<bool sqrt_rate, size_t adaptive, size_t normalized>
-float average_update(gd& g)
+float average_update(gd& g, double total_weight, double normalized_sum_norm_x)
 { if (normalized)
   { if (sqrt_rate)
-    { float avg_norm = (float) g.total_weight / (float) g.all->normalized_sum_norm_x;
+    { float avg_norm = (float) total_weight / (float) normalized_sum_norm_x;
       if (adaptive)
         return sqrt(avg_norm);
       else
         return avg_norm;
     }
     else
-      return powf( (float) g.all->normalized_sum_norm_x / (float) g.total_weight, g.neg_norm_power);
+      return powf( (float) normalized_sum_norm_x / (float) total_weight, g.neg_norm_power);
   }
   return 1.f;
 }
 
+// adds x to a, returns the sum
+inline double atomic_add(std::atomic<double>& a, double x)
+{ double old = a.load(std::memory_order_relaxed);
+  while (!a.compare_exchange_weak(old, old + x, std::memory_order_relaxed))
+    ;
+  return old + x;
+}
+
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
 void train(gd& g, example& ec, float update)
-{ if (normalized)
-    update *= g.update_multiplier;
-  foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
+{ foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
 }
 
 void end_pass(gd& g)
@@ -347,6 +354,12 @@ void predict(gd& g, base_learner&, example& ec)
     print_audit_features(all, ec);
 }
 
+template<bool l1, bool audit>
+void predict_batch(gd& g, base_learner& base, example** ecs, size_t count)
+{ for (size_t i=0; i<count; i++)
+    predict<l1, audit>(g, base, *ecs[i]);
+}
+
   template <class T> inline void vec_add_trunc_multipredict(multipredict_info<T>& mp, const float fx, uint64_t fi)
 {
 	size_t index = fi;
@@ -467,7 +480,7 @@ inline void pred_per_update_feature(norm_data& nd, float x, float& fw)
 
 bool global_print_features = false;
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float get_pred_per_update(gd& g, example& ec)
+float get_pred_per_update(gd& g, example& ec, float& update_multiplier)
 { //We must traverse the features in _precisely_ the same order as during training.
   label_data& ld = ec.l.simple;
   vw& all = *g.all;
@@ -478,20 +491,36 @@ float get_pred_per_update(gd& g, example& ec)
   foreach_feature<norm_data,pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless> >(all, ec, nd);
  
   if(normalized)
-  { if(!stateless)
-    { g.all->normalized_sum_norm_x += ec.weight * nd.norm_x;
-      g.total_weight += ec.weight;
+  { double total_weight, normalized_sum_norm_x;
+    if (g.hogwild != nullptr)
+    { hogwild_state& h = *g.hogwild;
+      if (!stateless)
+      { normalized_sum_norm_x = atomic_add(h.normalized_sum_norm_x, ec.weight * nd.norm_x);
+        total_weight = atomic_add(h.total_weight, ec.weight);
+      }
+      else
+      { normalized_sum_norm_x = h.normalized_sum_norm_x.load(std::memory_order_relaxed);
+        total_weight = h.total_weight.load(std::memory_order_relaxed);
+      }
     }
-    g.update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g);
-    nd.pred_per_update *= g.update_multiplier;
+    else
+    { if(!stateless)
+      { g.all->normalized_sum_norm_x += ec.weight * nd.norm_x;
+        g.total_weight += ec.weight;
+      }
+      normalized_sum_norm_x = g.all->normalized_sum_norm_x;
+      total_weight = g.total_weight;
+    }
+    update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g, total_weight, normalized_sum_norm_x);
+    nd.pred_per_update *= update_multiplier;
   }
   return nd.pred_per_update;
 }
 
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare, bool stateless>
-float sensitivity(gd& g, example& ec)
+float sensitivity(gd& g, example& ec, float& update_multiplier)
 { if(adaptive || normalized)
-    return get_pred_per_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless>(g,ec);
+    return get_pred_per_update<sqrt_rate, feature_mask_off, adaptive, normalized, spare, stateless>(g,ec,update_multiplier);
   else
     return ec.total_sum_feat_sq;
 }
@@ -500,7 +529,9 @@ template<size_t adaptive>
 float get_scale(gd& g, example& ec, float weight)
 { float update_scale = g.all->eta * weight;
   if(!adaptive)
-  { float t = (float)(g.all->sd->t+weight - g.all->sd->weighted_holdout_examples);
+  { double learned = g.hogwild != nullptr ? g.hogwild->t.load(std::memory_order_relaxed)
+                     : g.all->sd->t - g.all->sd->weighted_holdout_examples;
+    float t = (float)(learned + weight);
     update_scale *= powf(t, g.neg_power_t);
   }
   return update_scale;
@@ -508,12 +539,13 @@ float get_scale(gd& g, example& ec, float weight)
 
 template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
 float sensitivity(gd& g, base_learner& base, example& ec)
-{ return get_scale<adaptive>(g, ec, 1.)
-         * sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, true>(g,ec);
+{ float update_multiplier;
+  return get_scale<adaptive>(g, ec, 1.)
+         * sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, true>(g,ec,update_multiplier);
 }
 
 template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
-float compute_update(gd& g, example& ec)
+float compute_update(gd& g, example& ec, float& update_multiplier)
 { //invariant: not a test label, importance weight > 0
   label_data& ld = ec.l.simple;
   vw& all = *g.all;
@@ -521,7 +553,7 @@ float compute_update(gd& g, example& ec)
   float update = 0.;
   ec.updated_prediction = ec.pred.scalar;
   if (all.loss->getLoss(all.sd, ec.pred.scalar, ld.label) > 0.)
-  { float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g, ec);
+  { float pred_per_update = sensitivity<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(g, ec, update_multiplier);
     float update_scale = get_scale<adaptive>(g, ec, ec.weight);
     if(invariant)
       update = all.loss->getUpdate(ec.pred.scalar, ld.label, update_scale, pred_per_update);
@@ -550,8 +582,9 @@ template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off,
 void update(gd& g, base_learner&, example& ec)
 { //invariant: not a test label, importance weight > 0
   float update;
-  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare> (g, ec)) != 0.)
-    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, update);
+  float update_multiplier = 1.f; // per example rather than in g, as learner threads update concurrently
+  if ( (update = compute_update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare> (g, ec, update_multiplier)) != 0.)
+    train<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g, ec, normalized ? update * update_multiplier : update);
 
   if (g.all->sd->contraction < 1e-10)  // updating weights now to avoid numerical instability
     sync_weights(*g.all);
@@ -583,6 +616,87 @@ void sync_weights(vw& all)
 	all.sd->contraction = 1.;
 }
 
+// --aligned_model writes all weights as one array instead of index/value pairs of the non-zero ones.
+// The array follows an index no weight can have, its length and padding which puts it at a multiple of
+// aligned_model_alignment in the file, so that a model loaded with stride 1 (-t) can map it.
+const uint64_t aligned_model_alignment = 1 << 16;
+const size_t aligned_model_chunk = 1 << 14;
+
+void save_aligned_weights(vw& all, io_buf& model_file, dense_parameters& weights)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  if (all.num_bits < 31)
+  { uint32_t marker = UINT32_MAX;
+    bin_write_fixed(model_file, (char*)&marker, sizeof(marker));
+  }
+  else
+  { uint64_t marker = UINT64_MAX;
+    bin_write_fixed(model_file, (char*)&marker, sizeof(marker));
+  }
+  bin_write_fixed(model_file, (char*)&length, sizeof(length));
+
+  int64_t offset = model_file.file_offset();
+  uint32_t padding = 0;
+  if (offset >= 0)  // unknown for compressed or in memory models, which can't be mapped anyway
+    padding = (uint32_t)((aligned_model_alignment - (offset + sizeof(padding)) % aligned_model_alignment) % aligned_model_alignment);
+  bin_write_fixed(model_file, (char*)&padding, sizeof(padding));
+  vector<char> zeros(padding, 0);
+  bin_write_fixed(model_file, zeros.data(), padding);
+
+  vector<weight> chunk(aligned_model_chunk);
+  for (uint64_t i = 0; i < length; i += chunk.size())
+  { size_t count = (size_t)min<uint64_t>(chunk.size(), length - i);
+    for (size_t j = 0; j < count; j++)
+      chunk[j] = weights.strided_index(i + j);
+    bin_write_fixed(model_file, (char*)chunk.data(), count * sizeof(weight));
+  }
+}
+
+bool map_aligned_weights(vw&, io_buf&, sparse_parameters&, uint64_t) { return false; }
+
+bool map_aligned_weights(vw& all, io_buf& model_file, dense_parameters& weights, uint64_t length)
+{ // a mapping replaces every weight, loading leaves the initial value of weights saved as 0
+  if (weights.stride_shift() != 0 || weights.seeded() || all.initial_weight != 0. || all.random_weights
+      || all.random_positive_weights)
+    return false;
+  int64_t offset = model_file.file_offset();
+  weight initial_constant = weights.strided_index(constant);
+  if (offset < 0 || !weights.map_file(model_file.files[model_file.current], offset))
+    return false;
+  model_file.seek_file(offset + length * sizeof(weight));
+  if (initial_constant != 0. && weights.strided_index(constant) == 0.)
+    weights.strided_index(constant) = initial_constant;
+  if (!all.quiet)
+    all.trace_message << "weights mapped from model file" << endl;
+  return true;
+}
+
+template<class T>
+void load_aligned_weights(vw& all, io_buf& model_file, T& weights)
+{ uint64_t length = (uint64_t)1 << all.num_bits;
+  uint64_t saved_length = 0;
+  uint32_t padding = 0;
+  bin_read_fixed(model_file, (char*)&saved_length, sizeof(saved_length), "");
+  if (saved_length != length)
+    THROW("Model content is corrupted, aligned weight vector length " << saved_length << " must be total vector length " << length);
+  if (bin_read_fixed(model_file, (char*)&padding, sizeof(padding), "") != sizeof(padding) || padding >= aligned_model_alignment)
+    THROW("Model content is corrupted, bad aligned weight vector padding");
+  vector<char> zeros(padding);
+  bin_read_fixed(model_file, zeros.data(), padding, "");
+
+  if (map_aligned_weights(all, model_file, weights, length))
+    return;
+
+  vector<weight> chunk(aligned_model_chunk);
+  for (uint64_t i = 0; i < length; i += chunk.size())
+  { size_t count = (size_t)min<uint64_t>(chunk.size(), length - i);
+    if (bin_read_fixed(model_file, (char*)chunk.data(), count * sizeof(weight), "") != count * sizeof(weight))
+      THROW("Model content is corrupted, aligned weight vector is truncated");
+    for (size_t j = 0; j < count; j++)
+      if (chunk[j] != 0.)
+        weights.strided_index(i + j) = chunk[j];
+  }
+}
+
 template<class T>
 void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text, T& weights)
 {
@@ -625,12 +739,18 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text, T& w
 		brw = bin_read_fixed(model_file, (char*)&i, sizeof(i), "");
 	      if (brw > 0)
 		{
+		  if (i == (all.num_bits < 31 ? UINT32_MAX : UINT64_MAX))
+		    { load_aligned_weights(all, model_file, weights);
+		      continue;
+		    }
 		  if (i >= length)
 		    THROW("Model content is corrupted, weight vector index " << i << " must be less than total vector length " << length);
 		  weight* v = &weights.strided_index(i);
 		  brw += bin_read_fixed(model_file, (char*)&(*v), sizeof(*v), "");
 		}
 	    } while (brw >0);
+	else if (all.aligned_model && !text && !all.weights.sparse)
+	  save_aligned_weights(all, model_file, all.weights.dense_weights);
 	else // write
 	  for (typename T::iterator v = weights.begin(); v != weights.end(); ++v)
 	    if (*v != 0.)
@@ -942,6 +1062,47 @@ uint64_t ceil_log_2(uint64_t v)
     return 1 + ceil_log_2(v >> 1);
 }
 
+const char* hogwild_unsupported(vw& all)
+{ if (all.gd == nullptr || all.l != all.scorer || all.scorer->reduces_to() != all.gd)
+    return "only the default linear learner is supported";
+  if (all.weights.sparse)
+    return "not supported with --sparse_weights";
+  if (all.l1_lambda > 0 || all.l2_lambda > 0)
+    return "not supported with --l1 or --l2";
+  if (all.audit || all.hash_inv)
+    return "not supported with --audit or --invert_hash";
+  if (all.final_prediction_sink.size() > 0 || all.raw_prediction > 0)
+    return "predictions are written in example order";
+  if (all.all_reduce != nullptr || all.daemon)
+    return "not supported with --span_server or --daemon";
+  if (all.profile != nullptr)
+    return "the reductions are profiled by a single thread";
+  return nullptr;
+}
+
+void start_hogwild(vw& all, hogwild_state& h)
+{ gd& g = *(gd*)all.gd->learn_functions().data;
+  h.t = all.sd->t - all.sd->weighted_holdout_examples;
+  h.normalized_sum_norm_x = all.normalized_sum_norm_x;
+  h.total_weight = g.total_weight;
+  h.set_minmax = all.set_minmax;
+  all.set_minmax = noop_mm;
+  g.hogwild = &h;
+}
+
+void hogwild_learned(hogwild_state& h, example& ec)
+{ if (!ec.test_only)
+    atomic_add(h.t, ec.weight);
+}
+
+void end_hogwild(vw& all, hogwild_state& h)
+{ gd& g = *(gd*)all.gd->learn_functions().data;
+  all.normalized_sum_norm_x = h.normalized_sum_norm_x;
+  g.total_weight = h.total_weight;
+  all.set_minmax = h.set_minmax;
+  g.hogwild = nullptr;
+}
+
 base_learner* setup(vw& all)
 { new_options(all, "Gradient Descent options")
   ("sgd", "use regular stochastic gradient descent update.")
@@ -1015,15 +1176,19 @@ base_learner* setup(vw& all)
   if (all.reg_mode % 2)
     if (all.audit || all.hash_inv)
     { g.predict = predict<true, true>;   g.multipredict = multipredict<true, true>;
+      g.predict_batch = predict_batch<true, true>;
     }
     else
     { g.predict = predict<true, false>;  g.multipredict = multipredict<true, false>;
+      g.predict_batch = predict_batch<true, false>;
     }
   else if (all.audit || all.hash_inv)
   { g.predict = predict<false, true>;    g.multipredict = multipredict<false, true>;
+    g.predict_batch = predict_batch<false, true>;
   }
   else
   { g.predict = predict<false, false>;   g.multipredict = multipredict<false, false>;
+    g.predict_batch = predict_batch<false, false>;
   }
 
   uint64_t stride;
@@ -1038,10 +1203,12 @@ base_learner* setup(vw& all)
   ret.set_predict(g.predict);
   ret.set_sensitivity(g.sensitivity);
   ret.set_multipredict(g.multipredict);
+  ret.set_predict_batch(g.predict_batch);
   ret.set_update(g.update);
   ret.set_save_load(save_load);
   ret.set_end_pass(end_pass);
-  return make_base(ret);
+  all.gd = make_base(ret);
+  return all.gd;
 }
 
 }
@@ -7,6 +7,8 @@
 #ifdef __FreeBSD__
 #include <sys/socket.h>
 #endif
+#include <float.h>
+#include <atomic>
 
 #include "parse_regressor.h"
 #include "constant.h"
@@ -23,6 +25,27 @@ float finalize_prediction(shared_data* sd, float ret);
 void print_audit_features(vw&, example& ec);
 void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text);
 void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, GD::gd *g = nullptr);
+// the reason threads can't learn with gd Hogwild style, updating the weights without locks, nullptr if they can
+const char* hogwild_unsupported(vw& all);
+
+/* Threads learning Hogwild style share what gd keeps between examples as atomics: the sums of
+   --normalized and the example count of the learning rate schedule, which advances by every example
+   learned as it does when one thread learns. The range of labels in all.sd isn't widened meanwhile,
+   an example with a label outside of it is learned between end_hogwild and start_hogwild, alone. */
+struct hogwild_state
+{ std::atomic<double> t; // all.sd->t less the holdout examples
+  std::atomic<double> normalized_sum_norm_x;
+  std::atomic<double> total_weight;
+  void (*set_minmax)(shared_data*, float); // of all while the threads learn
+};
+void start_hogwild(vw& all, hogwild_state& h);
+// once ec is learned by one of the threads
+void hogwild_learned(hogwild_state& h, example& ec);
+void end_hogwild(vw& all, hogwild_state& h);
+// whether a label widens the range of labels, so that the example can't be learned with the other threads
+inline bool widens_labels(hogwild_state& h, shared_data* sd, float label)
+{ return h.set_minmax != noop_mm && label != FLT_MAX && (label < sd->min_label || label > sd->max_label);
+}
 
  template <class T>
    struct multipredict_info { size_t count; size_t step; polyprediction* pred; T& weights; /* & for l1: */ float gravity; };
@@ -50,13 +73,33 @@ inline void vec_add_multipredict(multipredict_info<T>& mp, const float fx, uint6
 		}
 }
 
-// iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
-template <class R, void (*T)(R&, const float, float&), class W>
-inline void foreach_feature(W& weights, features& fs, R& dat, uint64_t offset = 0, float mult = 1.)
+template <class R, void (*T)(R&, const float, float&)>
+inline void foreach_weight(dense_parameters& weights, features& fs, R& dat, uint64_t offset, float mult)
 {
   for (features::iterator& f : fs)
       T(dat, mult*f.value(), weights[(f.index() + offset)]);
 }
+
+// sparse weights are found by probing a table, the slot of the feature prefetch_distance ahead is loaded meanwhile
+template <class R, void (*T)(R&, const float, float&)>
+inline void foreach_weight(sparse_parameters& weights, features& fs, R& dat, uint64_t offset, float mult)
+{ const feature_value* values = fs.values.begin();
+  const feature_index* indices = fs.indicies.begin();
+  const feature_index* end = fs.indicies.end();
+  const feature_index* prefetch_end = fs.size() > INTERACTIONS::prefetch_distance ? end - INTERACTIONS::prefetch_distance : indices;
+  for (; indices != prefetch_end; ++indices, ++values)
+  { weights.prefetch(indices[INTERACTIONS::prefetch_distance] + offset);
+    T(dat, mult * *values, weights[*indices + offset]);
+  }
+  for (; indices != end; ++indices, ++values)
+    T(dat, mult * *values, weights[*indices + offset]);
+}
+
+// iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
+template <class R, void (*T)(R&, const float, float&), class W>
+inline void foreach_feature(W& weights, features& fs, R& dat, uint64_t offset = 0, float mult = 1.)
+{ foreach_weight<R, T>(weights, fs, dat, offset, mult);
+}
   
  // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
 template <class R, void (*T)(R&, const float, float&)>
@@ -55,13 +55,7 @@ void get_prediction(int sock, float& res, float& weight)
 }
 
 void send_prediction(int sock, global_prediction p)
-{ if (
-#ifdef _WIN32
-    send(sock, reinterpret_cast<const char*>(&p), sizeof(p), 0)
-#else
-    write(sock, &p, sizeof(p))
-#endif
-    < (int)sizeof(p))
+{ if (io_buf::write_file_or_socket(sock, &p, sizeof(p)) < (int)sizeof(p))
     THROWERRNO("send_prediction write(" << sock << ")");
 }
 
@@ -439,11 +433,13 @@ vw::vw()
   l = nullptr;
   scorer = nullptr;
   cost_sensitive = nullptr;
+  gd = nullptr;
   loss = nullptr;
 
   reg_mode = 0;
   current_pass = 0;
   reduction_stack=v_init<LEARNER::base_learner* (*)(vw&)>();
+  reduction_names=v_init<const char*>();
 
   data_filename = "";
   delete_prediction = nullptr;
@@ -496,9 +492,21 @@ vw::vw()
 
   eta_decay_rate = 1.0;
   initial_weight = 0.0;
+  weight_policy = WEIGHTS_DEFAULT;
+  pass_threads = 1;
+  interaction_cache = false;
+  learner_threads = 1;
+  stats = nullptr;
+  profile = nullptr;
   initial_constant = 0.0;
 
   all_reduce = nullptr;
+  sparse_allreduce = 0.;
+  allreduce_stats = false;
+  compression = nullptr;
+  allreduce_staging = nullptr;
+  weight_threads = 1;
+  weight_workers = nullptr;
 
   for (size_t i = 0; i < 256; i++)
   { ngram[i] = 0;
@@ -524,6 +532,7 @@ vw::vw()
   passes_complete = 0;
 
   save_per_pass = false;
+  aligned_model = false;
 
   stdin_off = false;
   do_reset_source = false;
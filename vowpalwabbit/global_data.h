@@ -120,7 +120,11 @@ const version_struct version(PACKAGE_VERSION);
 
 typedef float weight;
 
-typedef v_hashmap< substring, features* > feature_dict;
+struct feature_dict; // feature_dict.h
+struct stats_dump; // stats_dump.h
+struct reduction_profile; // reduction_profile.h
+struct allreduce_compression; // allreduce_compression.h
+struct weight_pool; // weight_threads.h
 
 struct dictionary_info
 { char* name;
@@ -197,19 +201,82 @@ public:
   }
 };
 
-struct shared_data
-{ size_t queries;
-
-  uint64_t example_number;
+// the counts and losses summed over the examples learned, which threads learning examples on their own
+// sum separately and add to all.sd when progress is printed or the pass ends
+struct example_totals
+{ uint64_t example_number;
   uint64_t total_features;
 
   double t;
   double weighted_labeled_examples;
-  double old_weighted_labeled_examples;
   double weighted_unlabeled_examples;
   double weighted_labels;
   double sum_loss;
   double sum_loss_since_last_dump;
+
+  //for holdout
+  double weighted_holdout_examples;
+  double weighted_holdout_examples_since_last_dump;
+  double holdout_sum_loss_since_last_dump;
+  double holdout_sum_loss;
+  double weighted_holdout_examples_since_last_pass;//reserved for best predictor selection
+  double holdout_sum_loss_since_last_pass;
+
+  void update(bool test_example, bool labeled_example, float loss, float weight, size_t num_features)
+  { t += weight;
+    if(test_example)
+    { weighted_holdout_examples += weight;//test weight seen
+      weighted_holdout_examples_since_last_dump += weight;
+      weighted_holdout_examples_since_last_pass += weight;
+      holdout_sum_loss += loss;
+      holdout_sum_loss_since_last_dump += loss;
+      holdout_sum_loss_since_last_pass += loss;//since last pass
+    }
+    else
+      {
+	if (labeled_example)
+	  weighted_labeled_examples += weight;
+	else
+	  weighted_unlabeled_examples += weight;
+	sum_loss += loss;
+	sum_loss_since_last_dump += loss;
+	total_features += num_features;
+	example_number++;
+      }
+  }
+
+  void add_counts(const example_totals& other)
+  { t += other.t;
+    example_number += other.example_number;
+    total_features += other.total_features;
+    weighted_labeled_examples += other.weighted_labeled_examples;
+    weighted_unlabeled_examples += other.weighted_unlabeled_examples;
+    weighted_labels += other.weighted_labels;
+    sum_loss += other.sum_loss;
+    sum_loss_since_last_dump += other.sum_loss_since_last_dump;
+    weighted_holdout_examples += other.weighted_holdout_examples;
+    weighted_holdout_examples_since_last_dump += other.weighted_holdout_examples_since_last_dump;
+    weighted_holdout_examples_since_last_pass += other.weighted_holdout_examples_since_last_pass;
+    holdout_sum_loss += other.holdout_sum_loss;
+    holdout_sum_loss_since_last_dump += other.holdout_sum_loss_since_last_dump;
+    holdout_sum_loss_since_last_pass += other.holdout_sum_loss_since_last_pass;
+  }
+};
+
+const size_t cache_line_size = 64;
+
+// the example_totals of one thread, on cache lines no other thread writes whatever the alignment of the
+// memory holding it (new doesn't honor alignas before c++17)
+struct padded_totals
+{ char before[cache_line_size];
+  example_totals totals;
+  char after[cache_line_size - sizeof(example_totals) % cache_line_size];
+};
+
+struct shared_data : example_totals
+{ size_t queries;
+
+  double old_weighted_labeled_examples;
   float dump_interval;// when should I update for the user.
   double gravity;
   double contraction;
@@ -218,15 +285,8 @@ struct shared_data
 
   namedlabels* ldict;
 
-  //for holdout
-  double weighted_holdout_examples;
-  double weighted_holdout_examples_since_last_dump;
-  double holdout_sum_loss_since_last_dump;
-  double holdout_sum_loss;
   //for best model selection
   double holdout_best_loss;
-  double weighted_holdout_examples_since_last_pass;//reserved for best predictor selection
-  double holdout_sum_loss_since_last_pass;
   size_t holdout_best_pass;
   // for --probabilities
   bool report_multiclass_log_loss;
@@ -254,29 +314,6 @@ struct shared_data
   double weighted_examples()
   {return weighted_labeled_examples + weighted_unlabeled_examples;}
 
-  void update(bool test_example, bool labeled_example, float loss, float weight, size_t num_features)
-  { t += weight;
-    if(test_example)
-    { weighted_holdout_examples += weight;//test weight seen
-      weighted_holdout_examples_since_last_dump += weight;
-      weighted_holdout_examples_since_last_pass += weight;
-      holdout_sum_loss += loss;
-      holdout_sum_loss_since_last_dump += loss;
-      holdout_sum_loss_since_last_pass += loss;//since last pass
-    }
-    else
-      {
-	if (labeled_example)
-	  weighted_labeled_examples += weight;
-	else
-	  weighted_unlabeled_examples += weight;
-	sum_loss += loss;
-	sum_loss_since_last_dump += loss;
-	total_features += num_features;
-	example_number++;
-      }
-  }
-
   inline void update_dump_interval(bool progress_add, float progress_arg)
   { sum_loss_since_last_dump = 0.0;
     old_weighted_labeled_examples = weighted_labeled_examples;
@@ -456,10 +493,17 @@ struct vw
 #endif
   AllReduceType all_reduce_type;
   AllReduce* all_reduce;
+  float sparse_allreduce; // density of the nonzero weights below which only those are allreduced, 0 for never
+  bool allreduce_stats; // print the bytes of every weight allreduce
+  allreduce_compression* compression; // of model averaging with --allreduce_compression, nullptr without
+  float* allreduce_staging; // the weights of an allreduce are gathered here a chunk at a time, nullptr until the first
+  size_t weight_threads; // threads passing over all the weights, see --weight_threads
+  weight_pool* weight_workers; // the threads after the first, nullptr until a pass is split
 
   LEARNER::base_learner* l;//the top level learner
   LEARNER::base_learner* scorer;//a scoring function
   LEARNER::base_learner* cost_sensitive;//a cost sensitive learning algorithm.
+  LEARNER::base_learner* gd;//gd, when it is the base learning algorithm.
 
   void learn(example*);
 
@@ -483,6 +527,7 @@ struct vw
   bool hessian_on;
 
   bool save_resume;
+  bool aligned_model; // save dense weights as one page aligned array which loading can map
   bool preserve_performance_counters;
   std::string id;
 
@@ -517,6 +562,7 @@ struct vw
   size_t passes_complete;
   uint64_t parse_mask; // 1 << num_bits -1
   bool permutations; // if true - permutations of features generated instead of simple combinations. false by default
+  bool interaction_cache; // if true - interaction features are expanded once per example, see INTERACTIONS::cached_interactions
   v_array<v_string> interactions; // interactions of namespaces to cross.
   std::vector<std::string> pairs; // pairs of features to cross.
   std::vector<std::string> triples; // triples of features to cross.
@@ -570,6 +616,7 @@ struct vw
   size_t length () { return ((size_t)1) << num_bits; };
 
   v_array<LEARNER::base_learner* (*)(vw&)> reduction_stack;
+  v_array<const char*> reduction_names; // of the reductions in reduction_stack
 
   //Prediction output
   v_array<int> final_prediction_sink; // set to send global predictions to.
@@ -592,6 +639,11 @@ struct vw
   std::string final_regressor_name;
 
   parameters weights;
+  weight_allocation weight_policy; // requested placement of dense weights, see --weight_allocation
+  size_t pass_threads; // threads learning the passes over a format 2 cache, see --pass_threads
+  size_t learner_threads; // threads learning the parsed examples, see --learner_threads
+  stats_dump* stats; // progress statistics written to --stats_file, nullptr without
+  reduction_profile* profile; // timers of the reductions with --profile_reductions, nullptr without
   
   size_t max_examples; // for TLC
 
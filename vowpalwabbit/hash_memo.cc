@@ -0,0 +1,46 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "hash_memo.h"
+#include "parser.h"
+#include "memory.h"
+#include "vw_exception.h"
+
+void init_hash_memos(parser& p, size_t entries, size_t threads)
+{ if (entries == 0)
+    THROW("--hash_memo needs at least one entry");
+  uint64_t size = 1;
+  while (size < entries)
+    size <<= 1;
+  p.memos = calloc_or_throw<hash_memo>(threads);
+  p.memo_count = threads;
+  for (size_t i = 0; i < threads; i++)
+  { hash_memo& memo = p.memos[i];
+    memo.entries = calloc_or_throw<hash_memo_entry>(size);
+    memo.mask = size - 1;
+    for (size_t j = 0; j < size; j++)
+      memo.entries[j].length = (uint32_t)hash_memo_max_length + 1;
+  }
+}
+
+void free_hash_memos(parser& p)
+{ for (size_t i = 0; i < p.memo_count; i++)
+    free(p.memos[i].entries);
+  free(p.memos);
+  p.memos = nullptr;
+  p.memo_count = 0;
+}
+
+hash_memo* parse_thread_memo(parser& p, size_t worker)
+{ return worker < p.memo_count ? &p.memos[worker] : nullptr;
+}
+
+void hash_memo_stats(parser& p, uint64_t& hits, uint64_t& misses)
+{ hits = misses = 0;
+  for (size_t i = 0; i < p.memo_count; i++)
+  { hits += p.memos[i].hits;
+    misses += p.memos[i].misses;
+  }
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "parse_primitives.h"
+
+/* --hash_memo: a bounded, direct mapped table of the hashes of recently parsed feature and namespace
+   names, keyed by the name bytes and the namespace hash they were hashed with. Data with a small
+   vocabulary of frequent tokens then hashes most names with a table lookup instead of the hash
+   function. The memo stores what the hasher (--hash strings or all) returned, so hashes are the same
+   with or without it. Names longer than hash_memo_max_length are always hashed.
+
+   Every parse thread has its own memo, so lookups take no lock. */
+
+const size_t hash_memo_max_length = 24;
+
+struct hash_memo_entry
+{ uint64_t name[3]; // the name bytes, zero padded
+  uint64_t seed;
+  uint64_t hash;
+  uint32_t length; // of the name, or a value above hash_memo_max_length if the entry is unused
+};
+
+struct hash_memo
+{ hash_memo_entry* entries;
+  uint64_t mask; // entries - 1, a power of 2
+  uint64_t hits;
+  uint64_t misses;
+};
+
+// the bytes of a name of at most hash_memo_max_length bytes, zero padded. limit is the end of the
+// buffer holding the name, when it has room the name is read as 3 words which are then masked.
+inline void memo_key(uint64_t key[3], const char* name, size_t length, const char* limit)
+{
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  if (limit - name >= (ptrdiff_t)sizeof(uint64_t[3]))
+  { memcpy(key, name, sizeof(uint64_t[3]));
+    for (size_t i = 0; i < 3; i++)
+    { size_t bytes = length > 8 * i ? std::min(length - 8 * i, (size_t)8) : 0;
+      key[i] &= bytes == 8 ? ~(uint64_t)0 : ((uint64_t)1 << (8 * bytes)) - 1;
+    }
+    return;
+  }
+#endif
+  key[0] = key[1] = key[2] = 0;
+  memcpy(key, name, length);
+}
+
+// the hash of name hashed with seed, from the memo if it was hashed recently. limit as for memo_key.
+inline uint64_t memo_hash(hash_memo& memo, hash_func_t hasher, substring name, uint64_t seed, const char* limit)
+{ size_t length = name.end - name.begin;
+  if (length > hash_memo_max_length)
+  { memo.misses++;
+    return hasher(name, seed);
+  }
+  uint64_t key[3];
+  memo_key(key, name.begin, length, limit);
+  uint64_t slot = (key[0] ^ (key[1] << 1) ^ (key[2] << 2) ^ seed) * 0x9E3779B97F4A7C15ULL;
+  hash_memo_entry& e = memo.entries[(slot >> 32) & memo.mask];
+  if (e.length == length && e.name[0] == key[0] && e.name[1] == key[1] && e.name[2] == key[2] && e.seed == seed)
+  { memo.hits++;
+    return e.hash;
+  }
+  memo.misses++;
+  e.name[0] = key[0];
+  e.name[1] = key[1];
+  e.name[2] = key[2];
+  e.seed = seed;
+  e.length = (uint32_t)length;
+  e.hash = hasher(name, seed);
+  return e.hash;
+}
+
+struct parser;
+
+// one memo of at least entries entries for each of threads parse threads
+void init_hash_memos(parser& p, size_t entries, size_t threads);
+void free_hash_memos(parser& p);
+// the memo of parse thread worker, nullptr without --hash_memo. Callers outside the parse threads (the
+// library's VW::read_line) pass no memo, the memos aren't locked.
+hash_memo* parse_thread_memo(parser& p, size_t worker);
+// sums of the memo statistics of all parse threads
+void hash_memo_stats(parser& p, uint64_t& hits, uint64_t& misses);
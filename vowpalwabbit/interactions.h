@@ -2,6 +2,7 @@
 
 #include "global_data.h"
 #include "constant.h"
+#include <string.h>
 
 /*
  *  Interactions preprocessing and feature combinations generation
@@ -370,10 +371,103 @@ inline void generate_interactions(vw& all, example& ec, R& dat) // default value
 template <class R>
 inline void dummy_func(R&, const audit_strings*) {} // should never be called due to call_audit overload
 
+/*
+ *  Cached interactions (--interaction_cache): the interaction features of an example are expanded once,
+ *  without ec.ft_offset, into ec.interactions. Later calls, e.g. for every class of oaa or every rollout
+ *  of search, iterate that flat array while the features the interactions come from are unchanged.
+ */
+
+const uint64_t key_offset_basis = 14695981039346656037ULL;
+const uint64_t key_prime = 1099511628211ULL; // 64 bit FNV
+
+inline uint64_t mix_key(uint64_t key, uint64_t v) { return (key ^ v) * key_prime; }
+
+// identifies the interactions of ec from the features of the namespaces they are generated from: the
+// size of each namespace and every index and value in order, hashed in 4 interleaved lanes so that a
+// lane doesn't wait for the multiply of the previous feature. Every step of a lane is a bijection of
+// it, so changing any one index or value changes the key.
+inline uint64_t interactions_key(vw& all, example& ec)
+{ uint64_t key = mix_key(key_offset_basis, all.permutations);
+  uint64_t seen[4] = {0, 0, 0, 0};
+  for (v_string& ns : all.interactions)
+  { key = mix_key(key, ns.size());
+    for (namespace_index n : ns)
+    { key = mix_key(key, n);
+      if (seen[n >> 6] & (1ULL << (n & 63)))
+        continue;
+      seen[n >> 6] |= 1ULL << (n & 63);
+      features& fs = ec.feature_space[n];
+      uint64_t lanes[4] = {key, key + 1, key + 2, key + 3};
+      for (size_t i = 0; i < fs.size(); ++i)
+      { uint32_t value;
+        memcpy(&value, &fs.values[i], sizeof(value));
+        uint64_t& lane = lanes[i & 3];
+        lane = mix_key(mix_key(lane, fs.indicies[i]), value);
+      }
+      key = mix_key(key, fs.size());
+      for (uint64_t lane : lanes)
+        key = mix_key(key, lane);
+    }
+  }
+  return key != 0 ? key : 1;
+}
+
+inline void push_interaction(features& fs, float x, uint64_t index) { fs.push_back(x, index); }
+
+// the interaction features of ec, expanded unless they already were from the same features
+inline features& cached_interactions(vw& all, example& ec)
+{ uint64_t key = interactions_key(all, ec);
+  if (ec.interactions_key != key)
+  { uint64_t offset = ec.ft_offset;
+    ec.ft_offset = 0;
+    ec.interactions.erase();
+    generate_interactions<features, uint64_t, push_interaction, false, dummy_func<features> >(all, ec, ec.interactions);
+    ec.ft_offset = offset;
+    ec.interactions_key = key;
+  }
+  return ec.interactions;
+}
+
+// the weights of interaction features are spread over the whole table, those of the next few are requested
+// ahead as their indices are known
+const size_t prefetch_distance = 16;
+
+inline void prefetch_weight(dense_parameters& weights, uint64_t index)
+{
+#ifdef __GNUC__
+  __builtin_prefetch(&weights[index]);
+#endif
+}
+
+inline void prefetch_weight(sparse_parameters& weights, uint64_t index) { weights.prefetch(index); }
+
+template <class R, class S, void (*T)(R&, float, S), class W>
+inline void foreach_cached_interaction(W& weights, features& fs, R& dat, const uint64_t offset)
+{ // local pointers, as T may write through a float& the compiler can't tell from fs
+  const feature_value* values = fs.values.begin();
+  const feature_index* indices = fs.indicies.begin();
+  const feature_index* end = fs.indicies.end();
+  const feature_index* prefetch_end = fs.size() > prefetch_distance ? end - prefetch_distance : indices;
+  for (; indices != prefetch_end; ++indices, ++values)
+  { prefetch_weight(weights, indices[prefetch_distance] + offset);
+    call_T<R, T>(dat, weights, *values, *indices + offset);
+  }
+  for (; indices != end; ++indices, ++values)
+    call_T<R, T>(dat, weights, *values, *indices + offset);
+}
+
 // this code is for C++98/03 complience as I unable to pass null function-pointer as template argument in g++-4.6
 template <class R, class S, void (*T)(R&, float, S)>
 inline void generate_interactions(vw& all, example& ec, R& dat)
-{ generate_interactions<R, S, T, false, dummy_func<R> > (all, ec, dat);
+{ if (all.interaction_cache)
+  { features& fs = cached_interactions(all, ec);
+    if (all.weights.sparse)
+      foreach_cached_interaction<R, S, T>(all.weights.sparse_weights, fs, dat, ec.ft_offset);
+    else
+      foreach_cached_interaction<R, S, T>(all.weights.dense_weights, fs, dat, ec.ft_offset);
+  }
+  else
+    generate_interactions<R, S, T, false, dummy_func<R> > (all, ec, dat);
 }
 
 // C(n,k) = n!/(k!(n-k)!)
@@ -5,6 +5,7 @@ license as described in the file LICENSE.
  */
 #include "io_buf.h"
 #include <stdio.h>
+#include <typeinfo>
 #ifdef WIN32
 #include <winsock2.h>
 #endif
@@ -37,6 +38,31 @@ size_t buf_read(io_buf &i, char* &pointer, size_t n)
   }
 }
 
+int64_t io_buf::file_offset()
+{ if (typeid(*this) != typeid(io_buf) || current >= files.size())
+    return -1;
+#ifdef _WIN32
+  int64_t offset = _lseeki64(files[current], 0, SEEK_CUR);
+#else
+  int64_t offset = lseek(files[current], 0, SEEK_CUR);
+#endif
+  if (offset < 0)
+    return -1;
+  // when reading, the loaded bytes after head are still to be consumed, when writing head is past the unflushed bytes
+  return offset - (space.end() - head);
+}
+
+void io_buf::seek_file(int64_t offset)
+{
+#ifdef _WIN32
+  _lseeki64(files[current], offset, SEEK_SET);
+#else
+  lseek(files[current], offset, SEEK_SET);
+#endif
+  space.end() = space.begin();
+  head = space.begin();
+}
+
 bool isbinary(io_buf &i)
 { if (i.space.end() == i.head)
     if (i.fill(i.files[i.current]) <= 0)
@@ -122,8 +148,11 @@ ssize_t io_buf::read_file_or_socket(int f, void* buf, size_t nbytes)
 #endif
 }
 
+bool (*io_buf::queue_write)(int f, const void* buf, size_t nbytes) = nullptr;
+
 ssize_t io_buf::write_file_or_socket(int f, const void* buf, size_t nbytes)
-{
+{ if (queue_write != nullptr && queue_write(f, buf, nbytes))
+    return (ssize_t)nbytes;
 #ifdef _WIN32
   if (is_socket(f))
     return send(f, reinterpret_cast<const char*>(buf), static_cast<int>(nbytes), 0);
@@ -178,6 +178,10 @@ public:
 
   static ssize_t write_file_or_socket(int f, const void* buf, size_t nbytes);
 
+  // when set, takes the writes it returns true for instead of write_file_or_socket: the --multiplex daemon
+  // queues those to its clients
+  static bool (*queue_write)(int f, const void* buf, size_t nbytes);
+
   virtual void flush()
   { if (files.size() > 0)
     { if (write_file(files[0], space.begin(), head - space.begin()) != (int) (head - space.begin()))
@@ -196,6 +200,12 @@ public:
 
   virtual bool compressed() { return false; }
 
+  // byte offset of head in the current file, -1 unless the bytes come straight from a seekable file
+  // (not compressed, in memory or otherwise provided by a derived buffer)
+  int64_t file_offset();
+  // continues reading at offset of the current file
+  void seek_file(int64_t offset);
+
   static void close_file_or_socket(int f);
 
   void close_files()
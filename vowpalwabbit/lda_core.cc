@@ -68,6 +68,8 @@ struct lda
   v_array<float> digammas;
   v_array<float> v;
   std::vector<index_feature> sorted_features;
+  v_array<size_t> sorted_runs; // starts of the feature groups in sorted_features
+  bool unsorted_runs; // a group of the minibatch isn't sorted by index, see learn_batch
 
   bool compute_coherence_metrics;
 
@@ -757,6 +759,23 @@ void return_example(vw& all, example& ec)
   VW::finish_example(all,&ec);
 }
 
+// merges the sorted runs of features starting at runs pairwise until one is left
+void merge_runs(std::vector<index_feature>& features, v_array<size_t>& runs)
+{ runs.push_back(features.size());
+  while (runs.size() > 2)
+  { size_t count = runs.size() - 1;
+    size_t kept = 0;
+    for (size_t r = 0; r + 1 < count; r += 2)
+    { inplace_merge(features.begin() + runs[r], features.begin() + runs[r + 1], features.begin() + runs[r + 2]);
+      runs[kept++] = runs[r];
+    }
+    if (count % 2 == 1)
+      runs[kept++] = runs[count - 1];
+    runs[kept++] = features.size();
+    runs.end() = runs.begin() + kept;
+  }
+}
+
 void learn_batch(lda &l)
 {
   parameters& weights = l.all->weights;
@@ -776,6 +795,8 @@ void learn_batch(lda &l)
       return_example(*l.all, *l.examples[d]);
     }
     l.examples.erase();
+    l.sorted_runs.erase();
+    l.unsorted_runs = false;
     return;
   }
 
@@ -802,7 +823,11 @@ void learn_batch(lda &l)
 
   size_t batch_size = l.examples.size();
 
-  sort(l.sorted_features.begin(), l.sorted_features.end());
+  // the groups of sorted examples are merged, which is cheaper than sorting them all over again
+  if (l.unsorted_runs)
+    sort(l.sorted_features.begin(), l.sorted_features.end());
+  else
+    merge_runs(l.sorted_features, l.sorted_runs);
 
   eta = l.all->eta * l.powf((float)l.example_t, -l.all->power_t);
   minuseta = 1.0f - eta;
@@ -884,6 +909,8 @@ void learn_batch(lda &l)
 	  }
   }
   l.sorted_features.resize(0);
+  l.sorted_runs.erase();
+  l.unsorted_runs = false;
 
   l.examples.erase();
   l.doc_lengths.erase();
@@ -893,8 +920,10 @@ void learn(lda &l, LEARNER::base_learner &, example &ec)
 { uint32_t num_ex = (uint32_t)l.examples.size();
   l.examples.push_back(&ec);
   l.doc_lengths.push_back(0);
+  l.unsorted_runs |= !ec.sorted;
   for (features& fs : ec)
-  { for (features::iterator& f : fs)
+  { l.sorted_runs.push_back(l.sorted_features.size());
+    for (features::iterator& f : fs)
     { index_feature temp = {num_ex, feature(f.value(), f.index())};
       l.sorted_features.push_back(temp);
       l.doc_lengths[num_ex] += (int)f.value();
@@ -1159,6 +1188,7 @@ void finish_example(vw&, lda&, example &) {}
 
 void finish(lda &ld)
 { ld.sorted_features.~vector<index_feature>();
+  ld.sorted_runs.delete_v();
   ld.Elogtheta.delete_v();
   ld.decay_levels.delete_v();
   ld.total_new.delete_v();
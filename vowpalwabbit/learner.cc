@@ -1,6 +1,8 @@
 #include "parser.h"
 #include "vw.h"
 #include "parse_regressor.h"
+#include "learner_threads.h"
+#include "stats_dump.h"
 using namespace std;
 
 void dispatch_example(vw& all, example& ec)
@@ -60,7 +62,10 @@ template <class T, void(*f)(T, example*)> void generic_driver(vw& all, T context
 
   while ( all.early_terminate == false )
     if ((ec = VW::get_example(all.p)) != nullptr)
-      f(context, ec);
+    { f(context, ec);
+      if (all.stats != nullptr)
+        dump_stats(all);
+    }
     else
       break;
   if (all.early_terminate) //drain any extra examples from parser.
@@ -85,5 +90,22 @@ void generic_driver(vector<vw*> alls)
 }
 
 void generic_driver(vw& all)
-{ generic_driver<vw&, process_example>(all, all); }
+{ if (learn_with_threads(all))
+  { if (all.early_terminate) //drain any extra examples from parser.
+    { example* ec;
+      while ((ec = VW::get_example(all.p)) != nullptr)
+        VW::finish_example(all, ec);
+    }
+    all.l->end_examples();
+  }
+  else
+    generic_driver<vw&, process_example>(all, all);
+}
+}
+
+namespace VW
+{
+void predict_batch(vw& all, example** ecs, size_t count)
+{ all.l->predict_batch(ecs, count);
+}
 }
@@ -55,6 +55,7 @@ struct learn_data
   void (*predict_f)(void* data, base_learner& base, example&);
   void (*update_f)(void* data, base_learner& base, example&);
   void (*multipredict_f)(void* data, base_learner& base, example&, size_t count, size_t step, polyprediction*pred, bool finalize_predictions);
+  void (*predict_batch_f)(void* data, base_learner& base, example** ecs, size_t count);
 };
 
 struct sensitivity_data
@@ -74,6 +75,7 @@ struct finish_example_data
   void (*finish_example_f)(vw&, void* data, example&);
 };
 
+void process_example(vw& all, example* ec);
 void generic_driver(vw& all);
 void generic_driver(std::vector<vw*> alls);
 
@@ -84,6 +86,7 @@ inline float noop_sensitivity(void*, base_learner&, example&) { return 0.; }
 typedef void (*tlearn)(void* d, base_learner& base, example& ec);
 typedef float (*tsensitivity)(void* d, base_learner& base, example& ec);
 typedef void (*tmultipredict)(void* d, base_learner& base, example& ec, size_t, size_t, polyprediction*, bool);
+typedef void (*tpredict_batch)(void* d, base_learner& base, example** ecs, size_t count);
 typedef void (*tsl)(void* d, io_buf& io, bool read, bool text);
 typedef void (*tfunc)(void*d);
 typedef void (*tend_example)(vw& all, void* d, example& ec);
@@ -113,6 +116,7 @@ public:
   prediction_type::prediction_type_t pred_type;
   size_t weights; //this stores the number of "weight vectors" required by the learner.
   size_t increment;
+  const char* name; // of the reduction, set by setup_base
 
   //called once for each example.  Must work under reduction.
   inline void learn(example& ec, size_t i=0)
@@ -143,9 +147,32 @@ public:
       ec.ft_offset -= (uint32_t)(increment*lo);
     }
   }
+  //predicts count examples.  Reductions which set predict_batch are called once for the whole batch,
+  //below the first reduction which doesn't, the examples are predicted one at a time.
+  inline void predict_batch(example** ecs, size_t count, size_t i=0)
+  { if (learn_fd.predict_batch_f == nullptr)
+    { for (size_t e=0; e<count; e++)
+        predict(*ecs[e], i);
+    }
+    else
+    { for (size_t e=0; e<count; e++)
+        ecs[e]->ft_offset += (uint32_t)(increment*i);
+      learn_fd.predict_batch_f(learn_fd.data, *learn_fd.base, ecs, count);
+      for (size_t e=0; e<count; e++)
+        ecs[e]->ft_offset -= (uint32_t)(increment*i);
+    }
+  }
+  //the learner this one reduces to, nullptr for base algorithms.
+  inline base_learner* reduces_to() { return learn_fd.base; }
+  //the functions called by learn, predict, update, multipredict, predict_batch and finish_example, which
+  //--profile_reductions replaces by timed wrappers
+  inline learn_data& learn_functions() { return learn_fd; }
+  inline finish_example_data& finish_example_functions() { return finish_example_fd; }
+
   inline void set_predict(void (*u)(T& data, base_learner& base, example&)) { learn_fd.predict_f = (tlearn)u; }
   inline void set_learn(void (*u)(T&, base_learner&, example&)) { learn_fd.learn_f = (tlearn)u; }
   inline void set_multipredict(void (*u)(T&, base_learner&, example&, size_t, size_t, polyprediction*, bool)) { learn_fd.multipredict_f = (tmultipredict)u; }
+  inline void set_predict_batch(void (*u)(T&, base_learner&, example**, size_t)) { learn_fd.predict_batch_f = (tpredict_batch)u; }
 
   inline void update(example& ec, size_t i=0)
   { ec.ft_offset += (uint32_t)(increment*i);
@@ -245,6 +272,7 @@ learner<T>& init_learner(T* dat, void (*learn)(T&, base_learner&, example&),
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)learn;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.predict_batch_f = nullptr;
   ret.sensitivity_fd.sensitivity_f = (tsensitivity)noop_sensitivity;
   ret.finish_example_fd.data = dat;
   ret.finish_example_fd.finish_example_f = return_simple_example;
@@ -274,6 +302,7 @@ learner<T>& init_learner(T* dat, base_learner* base,
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)predict;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.predict_batch_f = nullptr;
   ret.learn_fd.base = base;
 
   ret.finisher_fd.data = dat;
@@ -0,0 +1,197 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <float.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include "learner_threads.h"
+#include "stats_dump.h"
+#include "global_data.h"
+#include "parser.h"
+#include "simple_label.h"
+#include "gd.h"
+#include "vw.h"
+
+using namespace std;
+
+namespace
+{
+const size_t examples_per_take = 16;
+
+struct learner_threads
+{ vw* all;
+
+  mutex take_lock; // taking examples from the parser
+  condition_variable resumed;
+  uint64_t taken; // examples taken from the parser
+  bool barrier; // a thread took an example to process alone, the others don't take more
+  bool done; // the parser has no more examples
+
+  mutex sd_lock; // adding thread totals to all.sd and printing progress
+  condition_variable caught_up;
+  uint64_t finished; // examples added to all.sd
+  atomic<bool> failed;
+
+  GD::hogwild_state hogwild; // of gd, ended while an example is processed alone
+};
+
+struct learner_thread
+{ learner_threads* shared;
+  padded_totals counts; // of the examples learned since they were added to all.sd
+  exception_ptr error;
+};
+
+// takes up to examples_per_take examples to learn. an example which isn't learned is returned in held,
+// with its position in the example sequence, and stops the other threads from taking examples.
+bool take_examples(learner_threads& s, v_array<example*>& batch, example*& held, uint64_t& held_position)
+{ vw& all = *s.all;
+  unique_lock<mutex> lock(s.take_lock);
+  s.resumed.wait(lock, [&] { return !s.barrier || s.failed; });
+  if (s.done || s.failed || all.early_terminate)
+    return false;
+  while (batch.size() < examples_per_take)
+  { example* ec = VW::get_example(all.p);
+    if (ec == nullptr)
+    { s.done = true;
+      break;
+    }
+    // 1+ nonconstant feature, as in LEARNER::process_example, and a label in the range learned so far
+    if (ec->indices.size() > 1 && !GD::widens_labels(s.hogwild, all.sd, ec->l.simple.label))
+      batch.push_back(ec);
+    else
+    { held = ec;
+      held_position = s.taken;
+      s.barrier = true;
+    }
+    s.taken++;
+    if (held != nullptr)
+      break;
+  }
+  return true;
+}
+
+// adds the totals of t to all.sd, prints progress and finishes the examples of the batch
+void finish_batch(learner_thread& t, v_array<example*>& batch)
+{ learner_threads& s = *t.shared;
+  vw& all = *s.all;
+  if (batch.size() == 0)
+    return;
+  { lock_guard<mutex> lock(s.sd_lock);
+    all.sd->add_counts(t.counts.totals);
+    print_update(all, *batch.last());
+    if (all.stats != nullptr)
+      dump_stats(all, batch.size());
+    s.finished += batch.size();
+  }
+  s.caught_up.notify_all();
+  t.counts.totals = example_totals();
+  for (example* ec : batch)
+    VW::finish_example(all, ec);
+  batch.erase();
+}
+
+// processes an example alone, once all the examples taken before it are finished
+void process_held(learner_threads& s, example* ec, uint64_t position)
+{ vw& all = *s.all;
+  { unique_lock<mutex> lock(s.sd_lock);
+    s.caught_up.wait(lock, [&] { return s.finished == position || s.failed; });
+  }
+  if (s.failed)
+  { VW::finish_example(all, ec);
+    return;
+  }
+  GD::end_hogwild(all, s.hogwild);
+  LEARNER::process_example(all, ec);
+  GD::start_hogwild(all, s.hogwild);
+  { lock_guard<mutex> lock(s.sd_lock);
+    s.finished++;
+  }
+  { lock_guard<mutex> lock(s.take_lock);
+    s.barrier = false;
+  }
+  s.resumed.notify_all();
+}
+
+void learn_examples(learner_thread& t)
+{ learner_threads& s = *t.shared;
+  vw& all = *s.all;
+  v_array<example*> batch = v_init<example*>();
+  example* held = nullptr;
+  uint64_t held_position = 0;
+  try
+  { while (take_examples(s, batch, held, held_position))
+    { for (example* ec : batch)
+      { all.learn(ec);
+        GD::hogwild_learned(s.hogwild, *ec);
+        label_data& ld = ec->l.simple;
+        t.counts.totals.update(ec->test_only, ld.label != FLT_MAX, ec->loss, ec->weight, ec->num_features);
+        if (ld.label != FLT_MAX && !ec->test_only)
+          t.counts.totals.weighted_labels += ld.label * ec->weight;
+      }
+      finish_batch(t, batch);
+      if (held != nullptr)
+      { example* ec = held;
+        held = nullptr;
+        process_held(s, ec, held_position);
+      }
+    }
+  }
+  catch (...)
+  { t.error = current_exception();
+    { lock_guard<mutex> take(s.take_lock);
+      lock_guard<mutex> sd(s.sd_lock);
+      s.failed = true;
+    }
+    s.resumed.notify_all();
+    s.caught_up.notify_all();
+    for (example* ec : batch)
+      VW::finish_example(all, ec);
+    if (held != nullptr)
+      VW::finish_example(all, held);
+  }
+  batch.delete_v();
+}
+}
+
+bool learn_with_threads(vw& all)
+{ if (all.learner_threads <= 1)
+    return false;
+  const char* reason = GD::hogwild_unsupported(all);
+  if (reason != nullptr)
+  { if (!all.quiet)
+      all.trace_message << "warning: --learner_threads ignored, " << reason << endl;
+    return false;
+  }
+
+  learner_threads s;
+  s.all = &all;
+  s.taken = 0;
+  s.barrier = false;
+  s.done = false;
+  s.finished = 0;
+  s.failed = false;
+
+  vector<learner_thread> threads(all.learner_threads);
+  vector<thread> workers;
+  for (learner_thread& t : threads)
+  { t.shared = &s;
+    t.counts.totals = example_totals();
+  }
+  GD::start_hogwild(all, s.hogwild);
+  for (size_t i = 1; i < threads.size(); i++)
+    workers.push_back(thread(learn_examples, ref(threads[i])));
+  learn_examples(threads[0]);
+  for (thread& w : workers)
+    w.join();
+  GD::end_hogwild(all, s.hogwild);
+
+  for (learner_thread& t : threads)
+    if (t.error)
+      rethrow_exception(t.error);
+  return true;
+}
@@ -0,0 +1,21 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+
+/* --learner_threads: several threads take the parsed examples from the parser's ring and learn them
+   Hogwild style, all updating the same weights without locks. Every thread takes a few examples at a
+   time and sums their loss and counts (sd->t included) in its own padded example_totals, added to all.sd
+   once they are learned, when progress is printed as well. Examples which aren't learned (end of pass,
+   save commands and empty examples) are processed alone, once every example before them is finished.
+
+   Only the default linear learner (gd under the scorer) with dense weights and without l1/l2
+   regularization is learned this way, other setups are learned by the driver's thread. */
+
+struct vw;
+
+// learns all the examples of the parser with --learner_threads threads, false if the setup can't be
+// learned this way and no example was taken
+bool learn_with_threads(vw& all);
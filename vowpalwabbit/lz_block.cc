@@ -0,0 +1,134 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "lz_block.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+const size_t min_match = 4;
+const size_t max_offset = 65535;
+const size_t last_literals = 5;  // matches end at least this many bytes before the end of the block
+const size_t match_limit = 12;   // and don't start in its last bytes
+const uint32_t hash_bits = 14;
+
+inline uint32_t read32(const char* p)
+{ uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - hash_bits); }
+
+inline char* write_length(char* op, size_t length)
+{ for (; length >= 255; length -= 255)
+    *op++ = (char)255;
+  *op++ = (char)length;
+  return op;
+}
+
+inline char* write_literals(char* op, const char* literals, size_t count, size_t match)
+{ *op++ = (char)((min<size_t>(count, 15) << 4) | min<size_t>(match, 15));
+  if (count >= 15)
+    op = write_length(op, count - 15);
+  memcpy(op, literals, count);
+  return op + count;
+}
+
+size_t lz_compress(const char* src, size_t n, char* dst)
+{ // positions of the last occurence of hashed 4 byte sequences. an unset entry points at the start of
+  // the block, which is a valid (if unlikely) match candidate as every candidate is verified.
+  uint32_t table[1 << hash_bits];
+  memset(table, 0, sizeof(table));
+
+  const char* ip = src;
+  const char* anchor = src;
+  const char* end = src + n;
+  char* op = dst;
+  if (n > match_limit)
+  { const char* match_end = end - last_literals;
+    const char* search_end = end - match_limit;
+    while (ip <= search_end)
+    { uint32_t sequence = read32(ip);
+      uint32_t& slot = table[hash4(sequence)];
+      const char* ref = src + slot;
+      slot = (uint32_t)(ip - src);
+      if (ref >= ip || (size_t)(ip - ref) > max_offset || read32(ref) != sequence)
+      { ip += 1 + ((ip - anchor) >> 6);  // skip faster through incompressible data
+        continue;
+      }
+
+      const char* mp = ip + min_match;
+      const char* rp = ref + min_match;
+      while (mp < match_end && *mp == *rp)
+      { mp++;
+        rp++;
+      }
+      size_t match = mp - ip - min_match;
+      op = write_literals(op, anchor, ip - anchor, match);
+      uint16_t offset = (uint16_t)(ip - ref);
+      *op++ = (char)(offset & 255);
+      *op++ = (char)(offset >> 8);
+      if (match >= 15)
+        op = write_length(op, match - 15);
+      ip = anchor = mp;
+    }
+  }
+  op = write_literals(op, anchor, end - anchor, 0);
+  return op - dst;
+}
+
+inline bool read_length(const unsigned char*& ip, const unsigned char* end, size_t& length)
+{ unsigned char b;
+  do
+  { if (ip == end)
+      return false;
+    b = *ip++;
+    length += b;
+  }
+  while (b == 255);
+  return true;
+}
+
+bool lz_decompress(const char* src, size_t n, char* dst, size_t raw)
+{ const unsigned char* ip = (const unsigned char*)src;
+  const unsigned char* end = ip + n;
+  char* op = dst;
+  char* out_end = dst + raw;
+  while (ip < end)
+  { unsigned token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !read_length(ip, end, literals))
+      return false;
+    if ((size_t)(end - ip) < literals || (size_t)(out_end - op) < literals)
+      return false;
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (ip == end)  // the last sequence has no match
+      break;
+
+    if (end - ip < 2)
+      return false;
+    size_t offset = ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    size_t match = token & 15;
+    if (match == 15 && !read_length(ip, end, match))
+      return false;
+    match += min_match;
+    if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(out_end - op) < match)
+      return false;
+    const char* ref = op - offset;
+    if (offset >= match)
+      memcpy(op, ref, match);
+    else  // overlapping copy repeats the last offset bytes
+      for (size_t i = 0; i < match; i++)
+        op[i] = ref[i];
+    op += match;
+  }
+  return op == out_end;
+}
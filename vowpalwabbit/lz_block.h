@@ -0,0 +1,22 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+
+/* Fast LZ77 compression of independent blocks, in the sequence format of LZ4 blocks: every sequence is
+   a token (literal length in the high nibble, match length - 4 in the low one, 15 meaning more length
+   bytes follow), the literals, a 2 byte little-endian offset back into the output and the remaining
+   match length. The last sequence has literals only. Trades compression ratio for decompression that
+   runs at memory speed, as a cache is decompressed on every pass. */
+
+// worst case size of the compressed form of n bytes
+inline size_t lz_compress_bound(size_t n) { return n + n / 255 + 16; }
+
+// compresses src into dst, which needs lz_compress_bound(n) bytes. returns the compressed size.
+size_t lz_compress(const char* src, size_t n, char* dst);
+
+// decompresses n bytes of src into exactly raw bytes of dst, false if the data is corrupt
+bool lz_decompress(const char* src, size_t n, char* dst, size_t raw);
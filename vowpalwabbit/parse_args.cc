@@ -60,6 +60,12 @@ license as described in the file LICENSE.
 #include "active_cover.h"
 #include "kernel_svm.h"
 #include "parse_example.h"
+#include "hash_memo.h"
+#include "feature_dict.h"
+#include "stats_dump.h"
+#include "reduction_profile.h"
+#include "allreduce_compression.h"
+#include "weight_threads.h"
 #include "best_constant.h"
 #include "interact.h"
 #include "vw_exception.h"
@@ -134,7 +140,7 @@ string find_in_path(vector<string> paths, string fname)
   */
 }
 
-void parse_dictionary_argument(vw&all, string str)
+void parse_dictionary_argument(vw&all, string str, bool compile)
 { if (str.length() == 0) return;
   // expecting 'namespace:file', for instance 'w:foo.txt'
   // in the case of just 'foo.txt' it's applied to the default namespace
@@ -150,6 +156,25 @@ void parse_dictionary_argument(vw&all, string str)
   if (fname == "")
     THROW("error: cannot find dictionary '" << s << "' in path; try adding --dictionary_path");
 
+  bool hash_all = all.p->hasher != hashstring;
+  if (is_compiled_dict(fname))
+  { // mapped without reading it through, a dictionary mapped twice shares its pages anyway
+    for (dictionary_info& info : all.loaded_dictionaries)
+      if (info.file_hash == 0 && info.name == fname)
+      { all.namespace_dictionaries[(size_t)ns].push_back(info.dict);
+        return;
+      }
+    feature_dict* dict = map_compiled_dict(fname, hash_all);
+    if (! all.quiet)
+      all.trace_message << "mapped compiled dictionary '" << s << "' from '" << fname << "', " << dict->header->entries
+                        << " item" << (dict->header->entries == 1 ? "" : "s") << endl;
+    all.namespace_dictionaries[(size_t)ns].push_back(dict);
+    dictionary_info info = { calloc_or_throw<char>(fname.size()+1), 0, dict };
+    strcpy(info.name, fname.c_str());
+    all.loaded_dictionaries.push_back(info);
+    return;
+  }
+
   bool is_gzip = ends_with(fname, ".gz");
   io_buf* io = is_gzip ? new comp_io_buf : new io_buf;
   int fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
@@ -177,7 +202,7 @@ void parse_dictionary_argument(vw&all, string str)
     THROW("error: cannot re-read dictionary from file '" << fname << "'" << ", opening failed");
   }
 
-  feature_dict* map = new feature_dict(1023, nullptr, substring_equal);
+  dict_builder* map = new_dict_builder();
   example *ec = VW::alloc_examples(all.p->lp.label_size, 1);
 
   size_t def = (size_t)' ';
@@ -196,7 +221,7 @@ void parse_dictionary_argument(vw&all, string str)
         if (buffer == nullptr)
         { free(ec);
           VW::dealloc_example(all.p->lp.delete_label, *ec);
-          delete map;
+          free_feature_dict(dict_build(map, hash_all));
           io->close_file();
           delete io;
           THROW("error: memory allocation failed in reading dictionary");
@@ -213,25 +238,17 @@ void parse_dictionary_argument(vw&all, string str)
     while (*d != ' ' && *d != '\t' && *d != '\n' && *d != '\0') ++d; // gobble up initial word
     if (d == c) continue; // no word
     if (*d != ' ' && *d != '\t') continue; // reached end of line
-    char* word = calloc_or_throw<char>(d-c);
-    memcpy(word, c, d-c);
-    substring ss = { word, word + (d - c) };
-    uint64_t hash = uniform_hash( ss.begin, ss.end-ss.begin, quadratic_constant);
-    if (map->get(ss, hash) != nullptr)   // don't overwrite old values!
-    { free(word);
+    string word(c, d-c);
+    uint64_t hash = uniform_hash(word.data(), word.size(), quadratic_constant);
+    if (dict_contains(*map, word.data(), word.size(), hash))   // don't overwrite old values!
       continue;
-    }
     d--;
     *d = '|';  // set up for parser::read_line
     VW::read_line(all, ec, d);
     // now we just need to grab stuff from the default namespace of ec!
     if (ec->feature_space[def].size() == 0)
-    { free(word);
       continue;
-    }
-    features* arr = new features;
-    arr->deep_copy_from(ec->feature_space[def]);
-    map->put(ss, hash, arr);
+    dict_add(*map, word.data(), word.size(), hash, ec->feature_space[def]);
 
     // clear up ec
     ec->tag.erase(); ec->indices.erase();
@@ -244,11 +261,18 @@ void parse_dictionary_argument(vw&all, string str)
   VW::dealloc_example(all.p->lp.delete_label, *ec);
   free(ec);
 
+  feature_dict* dict = dict_build(map, hash_all);
   if (! all.quiet)
-    all.trace_message << "dictionary " << s << " contains " << map->size() << " item" << (map->size() == 1 ? "" : "s") << endl;
+    all.trace_message << "dictionary " << s << " contains " << dict->header->entries << " item" << (dict->header->entries == 1 ? "" : "s") << endl;
+  if (compile)
+  { string compiled = fname + ".vwd";
+    write_compiled_dict(*dict, compiled);
+    if (! all.quiet)
+      all.trace_message << "compiled dictionary " << s << " to '" << compiled << "'" << endl;
+  }
 
-  all.namespace_dictionaries[(size_t)ns].push_back(map);
-  dictionary_info info = { calloc_or_throw<char>(strlen(s)+1), fd_hash, map };
+  all.namespace_dictionaries[(size_t)ns].push_back(dict);
+  dictionary_info info = { calloc_or_throw<char>(strlen(s)+1), fd_hash, dict };
   strcpy(info.name, s);
   all.loaded_dictionaries.push_back(info);
 }
@@ -302,6 +326,9 @@ void parse_diagnostics(vw& all, int argc)
   ("audit,a", "print weights of features")
   ("progress,P", po::value< string >(), "Progress update frequency. int: additive, float: multiplicative")
   ("quiet", "Don't output disgnostics and progress updates")
+  ("stats_file", po::value<string>(), "append a JSON line of progress statistics (examples/s, loss, parse and learn time, ring use) to this file every --stats_interval seconds")
+  ("stats_interval", po::value<float>()->default_value(1.f), "seconds between the lines of --stats_file")
+  ("profile_reductions", "time the learn, predict and finish_example calls of every reduction and print them at the end")
   ("help,h","Look here: http://hunch.net/~vw/ and click on Tutorial.");
   add_options(all);
 
@@ -313,6 +340,9 @@ void parse_diagnostics(vw& all, int argc)
     exit(0);
   }
 
+  if (vm.count("stats_file"))
+    open_stats_dump(all, vm["stats_file"].as<string>(), vm["stats_interval"].as<float>());
+
   if (vm.count("quiet"))
   { all.quiet = true;
     // --quiet wins over --progress
@@ -371,12 +401,18 @@ void parse_source(vw& all)
   ("foreground", "in persistent daemon mode, do not run in the background")
   ("port", po::value<size_t>(),"port to listen on; use 0 to pick unused port")
   ("num_children", po::value<size_t>(&(all.num_children)), "number of children for persistent daemon mode")
+  ("multiplex", "in persistent daemon mode, serve all connections from one process with epoll instead of forking children (Linux only)")
   ("pid_file", po::value< string >(), "Write pid file in persistent daemon mode")
   ("port_file", po::value< string >(), "Write port used in persistent daemon mode")
   ("cache,c", "Use a cache.  The default is <data>.cache")
   ("cache_file", po::value< vector<string> >(), "The location(s) of cache_file.")
+  ("cache_format", po::value<size_t>(&(all.p->cache_format)), "format of a created cache: 1 (default) one example at a time, 2 blocks of examples which are faster to read")
+  ("cache_compression", po::value<string>(), "compression of the blocks of a format 2 cache: none (default) or lz")
+  ("cache_block_size", po::value<size_t>(&(all.p->cache_block_bytes)), "bytes of examples in a block of a format 2 cache, 262144 by default")
   ("json", "Enable JSON parsing.")
   ("dsjson", "Enable Decision Service JSON parsing.")
+  ("parse_threads", po::value<size_t>(&(all.p->parse_threads)), "number of threads parsing text examples; examples are still learned in input order")
+  ("hash_memo", po::value<size_t>(), "remember the hashes of this many recently parsed text feature names per parse thread, for data with a small vocabulary of frequent tokens")
   ("kill_cache,k", "do not reuse existing cache: create a new one always")
   ("compressed", "use gzip format whenever possible. If a cache file is being created, this option creates a compressed cache file. A mixture of raw-text & compressed inputs are supported with autodetection.")
   ("no_stdin", "do not default to reading from stdin");
@@ -409,6 +445,24 @@ void parse_source(vw& all)
   if (vm.count("compressed"))
     set_compressed(all.p);
 
+  if (vm.count("hash_memo"))
+    init_hash_memos(*all.p, vm["hash_memo"].as<size_t>(), max(all.p->parse_threads, (size_t)1));
+
+  if (all.p->cache_format != 1 && all.p->cache_format != 2)
+    THROW("unknown --cache_format " << all.p->cache_format << ", use 1 or 2");
+  if (vm.count("cache_compression"))
+  { string compression = vm["cache_compression"].as<string>();
+    if (compression == "lz")
+      all.p->cache_lz = true;
+    else if (compression != "none")
+      THROW("unknown --cache_compression " << compression << ", use none or lz");
+    if (all.p->cache_format != 2)
+      THROW("--cache_compression needs --cache_format 2");
+  }
+  if (vm.count("cache_block_size") && (all.p->cache_format != 2 || all.p->cache_block_bytes == 0
+                                       || all.p->cache_block_bytes > (1 << 30)))
+    THROW("--cache_block_size needs --cache_format 2 and a size from 1 byte to 1GB");
+
   if (vm.count("data"))
   { all.data_filename = vm["data"].as<string>();
     if (ends_with(all.data_filename, ".gz"))
@@ -536,8 +590,10 @@ void parse_feature_tweaks(vw& all)
   ("spelling", po::value< vector<string> >(), "compute spelling features for a give namespace (use '_' for default namespace)")
   ("dictionary", po::value< vector<string> >(), "read a dictionary for additional features (arg either 'x:file' or just 'file')")
   ("dictionary_path", po::value< vector<string> >(), "look in this directory for dictionaries; defaults to current directory or env{PATH}")
+  ("dictionary_compile", "also write every text dictionary read with --dictionary compiled, to <file>.vwd; --dictionary <file>.vwd maps it instead of reading it")
   ("interactions", po::value< vector<string> > (), "Create feature interactions of any level between namespaces.")
   ("permutations", "Use permutations instead of combinations for feature interactions of same namespace.")
+  ("interaction_cache", "Expand the interaction features of an example once and reuse them while its features are unchanged. Trades memory for speed when reductions predict an example many times.")
   ("leave_duplicate_interactions", "Don't remove interactions with duplicate combinations of namespaces. For ex. this is a duplicate: '-q ab -q ba' and a lot more in '-q ::'.")
   ("quadratic,q", po::value< vector<string> > (), "Create and use quadratic features")
   ("q:", po::value< string >(), ": corresponds to a wildcard for all printable characters")
@@ -607,6 +663,7 @@ void parse_feature_tweaks(vw& all)
   }
 
   all.permutations = vm.count("permutations") > 0;
+  all.interaction_cache = vm.count("interaction_cache") > 0;
 
   // prepare namespace interactions
   v_array<v_string> expanded_interactions = v_init<v_string>();
@@ -871,7 +928,7 @@ void parse_feature_tweaks(vw& all)
 
     vector<string> dictionary_ns = vm["dictionary"].as< vector<string> >();
     for (size_t id=0; id<dictionary_ns.size(); id++)
-    { parse_dictionary_argument(all, dictionary_ns[id]);
+    { parse_dictionary_argument(all, dictionary_ns[id], vm.count("dictionary_compile") > 0);
       *all.file_options << " --dictionary " << dictionary_ns[id];
     }
   }
@@ -1017,6 +1074,7 @@ void parse_output_model(vw& all)
   ("save_resume", "save extra state so learning can be resumed later with new data")
   ("preserve_performance_counters", "reset performance counters when warmstarting")
   ("save_per_pass", "Save the model after every pass over data")
+  ("aligned_model", "Save dense weights as one page aligned array, so that loading the model maps it instead of reading it")
   ("output_feature_regularizer_binary", po::value< string >(&(all.per_feature_regularizer_output)), "Per feature regularization output file")
   ("output_feature_regularizer_text", po::value< string >(&(all.per_feature_regularizer_text)), "Per feature regularization output file, in text")
   ("id", po::value< string >(&(all.id)), "User supplied ID embedded into the final regressor");
@@ -1045,6 +1103,9 @@ void parse_output_model(vw& all)
   if (vm.count("save_resume"))
     all.save_resume = true;
 
+  if (vm.count("aligned_model"))
+    all.aligned_model = true;
+
   if (vm.count("preserve_performance_counters"))
     all.preserve_performance_counters = true;
   
@@ -1077,75 +1138,84 @@ void load_input_model(vw& all, io_buf& io_temp)
 }
 
 LEARNER::base_learner* setup_base(vw& all)
-{ LEARNER::base_learner* ret = all.reduction_stack.pop()(all);
+{ const char* name = all.reduction_names.pop();
+  LEARNER::base_learner* ret = all.reduction_stack.pop()(all);
   if (ret == nullptr)
     return setup_base(all);
-  else
-    return ret;
+  ret->name = name;
+  return ret;
+}
+
+void push_reduction(vw& all, LEARNER::base_learner* (*setup)(vw&), const char* name)
+{ all.reduction_stack.push_back(setup);
+  all.reduction_names.push_back(name);
 }
 
 void parse_reductions(vw& all)
 { new_options(all, "Reduction options, use [option] --help for more info");
   add_options(all);
   //Base algorithms
-  all.reduction_stack.push_back(GD::setup);
-  all.reduction_stack.push_back(kernel_svm_setup);
-  all.reduction_stack.push_back(ftrl_setup);
-  all.reduction_stack.push_back(svrg_setup);
-  all.reduction_stack.push_back(sender_setup);
-  all.reduction_stack.push_back(gd_mf_setup);
-  all.reduction_stack.push_back(print_setup);
-  all.reduction_stack.push_back(noop_setup);
-  all.reduction_stack.push_back(lda_setup);
-  all.reduction_stack.push_back(bfgs_setup);
-  all.reduction_stack.push_back(OjaNewton_setup);
-  // all.reduction_stack.push_back(VW_CNTK::setup);
+  push_reduction(all, GD::setup, "gd");
+  push_reduction(all, kernel_svm_setup, "kernel_svm");
+  push_reduction(all, ftrl_setup, "ftrl");
+  push_reduction(all, svrg_setup, "svrg");
+  push_reduction(all, sender_setup, "sender");
+  push_reduction(all, gd_mf_setup, "gd_mf");
+  push_reduction(all, print_setup, "print");
+  push_reduction(all, noop_setup, "noop");
+  push_reduction(all, lda_setup, "lda");
+  push_reduction(all, bfgs_setup, "bfgs");
+  push_reduction(all, OjaNewton_setup, "OjaNewton");
+  // push_reduction(all, VW_CNTK::setup, "cntk");
 
   //Score Users
-  all.reduction_stack.push_back(ExpReplay::expreplay_setup<'b', simple_label>);
-  all.reduction_stack.push_back(active_setup);
-  all.reduction_stack.push_back(active_cover_setup);
-  all.reduction_stack.push_back(confidence_setup);
-  all.reduction_stack.push_back(nn_setup);
-  all.reduction_stack.push_back(mf_setup);
-  all.reduction_stack.push_back(marginal_setup);
-  all.reduction_stack.push_back(autolink_setup);
-  all.reduction_stack.push_back(lrq_setup);
-  all.reduction_stack.push_back(lrqfa_setup);
-  all.reduction_stack.push_back(stagewise_poly_setup);
-  all.reduction_stack.push_back(scorer_setup);
+  push_reduction(all, ExpReplay::expreplay_setup<'b', simple_label>, "replay_b");
+  push_reduction(all, active_setup, "active");
+  push_reduction(all, active_cover_setup, "active_cover");
+  push_reduction(all, confidence_setup, "confidence");
+  push_reduction(all, nn_setup, "nn");
+  push_reduction(all, mf_setup, "mf");
+  push_reduction(all, marginal_setup, "marginal");
+  push_reduction(all, autolink_setup, "autolink");
+  push_reduction(all, lrq_setup, "lrq");
+  push_reduction(all, lrqfa_setup, "lrqfa");
+  push_reduction(all, stagewise_poly_setup, "stagewise_poly");
+  push_reduction(all, scorer_setup, "scorer");
 
   //Reductions
-  all.reduction_stack.push_back(binary_setup);
-
-  all.reduction_stack.push_back(ExpReplay::expreplay_setup<'m', MULTICLASS::mc_label>);
-  all.reduction_stack.push_back(topk_setup);
-  all.reduction_stack.push_back(oaa_setup);
-  all.reduction_stack.push_back(boosting_setup);
-  all.reduction_stack.push_back(ect_setup);
-  all.reduction_stack.push_back(log_multi_setup);
-  all.reduction_stack.push_back(recall_tree_setup);
-  all.reduction_stack.push_back(multilabel_oaa_setup);
-  all.reduction_stack.push_back(plt_setup);
-
-  all.reduction_stack.push_back(csoaa_setup);
-  all.reduction_stack.push_back(interact_setup);
-  all.reduction_stack.push_back(csldf_setup);
-  all.reduction_stack.push_back(cb_algs_setup);
-  all.reduction_stack.push_back(cb_adf_setup);
-  all.reduction_stack.push_back(mwt_setup);
-  all.reduction_stack.push_back(cb_explore_setup);
-  all.reduction_stack.push_back(cb_explore_adf_setup);
-  all.reduction_stack.push_back(cbify_setup);
-  all.reduction_stack.push_back(explore_eval_setup);
-
-  all.reduction_stack.push_back(ExpReplay::expreplay_setup<'c', COST_SENSITIVE::cs_label>);
-  all.reduction_stack.push_back(Search::setup);
-  all.reduction_stack.push_back(bs_setup);
-
-  all.reduction_stack.push_back(audit_regressor_setup);
+  push_reduction(all, binary_setup, "binary");
+
+  push_reduction(all, ExpReplay::expreplay_setup<'m', MULTICLASS::mc_label>, "replay_m");
+  push_reduction(all, topk_setup, "topk");
+  push_reduction(all, oaa_setup, "oaa");
+  push_reduction(all, boosting_setup, "boosting");
+  push_reduction(all, ect_setup, "ect");
+  push_reduction(all, log_multi_setup, "log_multi");
+  push_reduction(all, recall_tree_setup, "recall_tree");
+  push_reduction(all, multilabel_oaa_setup, "multilabel_oaa");
+  push_reduction(all, plt_setup, "plt");
+
+  push_reduction(all, csoaa_setup, "csoaa");
+  push_reduction(all, interact_setup, "interact");
+  push_reduction(all, csldf_setup, "csoaa_ldf");
+  push_reduction(all, cb_algs_setup, "cb");
+  push_reduction(all, cb_adf_setup, "cb_adf");
+  push_reduction(all, mwt_setup, "mwt");
+  push_reduction(all, cb_explore_setup, "cb_explore");
+  push_reduction(all, cb_explore_adf_setup, "cb_explore_adf");
+  push_reduction(all, cbify_setup, "cbify");
+  push_reduction(all, explore_eval_setup, "explore_eval");
+
+  push_reduction(all, ExpReplay::expreplay_setup<'c', COST_SENSITIVE::cs_label>, "replay_c");
+  push_reduction(all, Search::setup, "search");
+  push_reduction(all, bs_setup, "bs");
+
+  push_reduction(all, audit_regressor_setup, "audit_regressor");
 
   all.l = setup_base(all);
+
+  if (all.vm.count("profile_reductions"))
+    profile_reductions(all);
 }
 
 void add_to_args(vw& all, int argc, char* argv[], int excl_param_count = 0, const char* excl_params[] = NULL)
@@ -1187,7 +1257,8 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
 
     new_options(all, "VW options")
     ("random_seed", po::value<uint64_t>(&(all.random_seed)), "seed random number generator")
-    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring");
+    ("ring_size", po::value<size_t>(&(all.p->ring_size)), "size of example ring")
+    ("ring_stats", "report how often the parser and learner stalled on a full or empty example ring");
     add_options(all);
 
     new_options(all, "Update options")
@@ -1204,6 +1275,7 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
     ("initial_weight", po::value<float>(&(all.initial_weight)), "Set all weights to an initial value of arg.")
     ("random_weights", po::value<bool>(&(all.random_weights)), "make initial weights random")
     ("sparse_weights", "Use a sparse datastructure for weights")
+    ("weight_allocation", po::value< string >(), "Memory for dense weights: default, thp (transparent huge pages), hugetlb (reserved huge pages) or numa_interleave")
     ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file");
     add_options(all);
  
@@ -1212,22 +1284,47 @@ vw& parse_args(int argc, char *argv[], trace_message_t trace_listener, void* tra
       all.weights.sparse = true;
     else
       all.weights.sparse = false;
+    if (vm.count("weight_allocation"))
+    { all.weight_policy = parse_weight_allocation(vm["weight_allocation"].as<string>());
+      if (all.weights.sparse)
+        all.trace_message << "warning: --weight_allocation only applies to dense weights, ignored with --sparse_weights" << endl;
+    }
     
     new_options(all, "Parallelization options")
     ("span_server", po::value<string>(), "Location of server for setting up spanning tree")
     ("threads", "Enable multi-threading")
+    ("pass_threads", po::value<size_t>(&(all.pass_threads)), "number of threads learning each pass over a --cache_format 2 cache, Hogwild style")
+    ("learner_threads", po::value<size_t>(&(all.learner_threads)), "number of threads learning the parsed examples, Hogwild style")
     ("unique_id", po::value<size_t>()->default_value(0), "unique id used for cluster parallel jobs")
     ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job")
-    ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job");
+    ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job")
+    ("sparse_allreduce", po::value<float>(&(all.sparse_allreduce)), "allreduce the weights as a bitmap of the nonzero ones and their values while fewer than this fraction of them are nonzero over all nodes, such as 0.5 (default 0, all of them)")
+    ("allreduce_stats", "print the bytes sent by every allreduce of the weights")
+    ("allreduce_ring", "allreduce large buffers around a ring of the nodes in pipelined chunks instead of up and down the spanning tree, for all the nodes or none")
+    ("allreduce_compression", po::value<string>(), "send the weights averaged between passes as fp16, bf16 or int8 changes with error feedback")
+    ("weight_threads", po::value<size_t>(&(all.weight_threads)), "number of threads for passes over all the weights: gathering them for allreduces, the vectors of bfgs");
     add_options(all);
 
+    if (all.pass_threads == 0)
+      THROW("--pass_threads needs at least 1 thread");
+    if (all.learner_threads == 0)
+      THROW("--learner_threads needs at least 1 thread");
+    if (all.weight_threads == 0)
+      THROW("--weight_threads needs at least 1 thread");
+    if (all.sparse_allreduce < 0 || all.sparse_allreduce > 1)
+      THROW("--sparse_allreduce must be between 0 and 1");
+    all.allreduce_stats = vm.count("allreduce_stats") > 0;
+    if (vm.count("allreduce_compression"))
+      all.compression = new_allreduce_compression(vm["allreduce_compression"].as<string>());
+
     if (vm.count("span_server"))
     { all.all_reduce_type = AllReduceType::Socket;
       all.all_reduce = new AllReduceSockets(
         vm["span_server"].as<string>(),
         vm["unique_id"].as<size_t>(),
         vm["total"].as<size_t>(),
-        vm["node"].as<size_t>());
+        vm["node"].as<size_t>(),
+        vm.count("allreduce_ring") > 0);
     }
 
     all.random_state = all.random_seed;
@@ -1462,12 +1559,6 @@ vw* seed_vw_model(vw* vw_model, const string extra_args, trace_message_t trace_l
   return new_model;
 }
 
-void delete_dictionary_entry(substring ss, features* A)
-{ free(ss.begin);
-  A->delete_v();
-  delete A;
-}
-
 void sync_stats(vw& all)
 { if (all.all_reduce != nullptr)
   { float loss = (float)all.sd->sum_loss;
@@ -1486,7 +1577,8 @@ void sync_stats(vw& all)
 }
 
 void finish(vw& all, bool delete_all)
-{ // also update VowpalWabbit::PerformanceStatistics::get() (vowpalwabbit.cpp)
+{ close_stats_dump(all);
+  // also update VowpalWabbit::PerformanceStatistics::get() (vowpalwabbit.cpp)
   if (!all.quiet && !all.vm.count("audit_regressor"))
   { all.trace_message.precision(6);
 	all.trace_message << std::fixed;
@@ -1526,8 +1618,19 @@ void finish(vw& all, bool delete_all)
     all.trace_message << endl << "total feature number = " << all.sd->total_features;
     if (all.sd->queries > 0)
       all.trace_message << endl << "total queries = " << all.sd->queries << endl;
+    if (all.vm.count("ring_stats"))
+    { all.trace_message << endl << "ring full stalls = " << all.p->ring_full_stalls;
+      all.trace_message << endl << "ring empty stalls = " << all.p->ring_empty_stalls;
+    }
+    if (all.p->memos != nullptr)
+    { uint64_t hits, misses;
+      hash_memo_stats(*all.p, hits, misses);
+      all.trace_message << endl << "hash memo hits = " << hits;
+      all.trace_message << endl << "hash memo misses = " << misses;
+    }
     all.trace_message << endl;
   }
+  print_reduction_profile(all);
 
   // implement finally.
   // finalize_regressor can throw if it can't write the file.
@@ -1546,6 +1649,7 @@ void finish(vw& all, bool delete_all)
   { all.l->finish();
     free_it(all.l);
   }
+  free_reduction_profile(all);
 
   free_parser(all);
   finalize_source(all.p);
@@ -1562,6 +1666,7 @@ void finish(vw& all, bool delete_all)
     free(all.sd);
   }
   all.reduction_stack.delete_v();
+  all.reduction_names.delete_v();
   delete all.file_options;
   for (size_t i = 0; i < all.final_prediction_sink.size(); i++)
     if (all.final_prediction_sink[i] != 1)
@@ -1569,13 +1674,14 @@ void finish(vw& all, bool delete_all)
   all.final_prediction_sink.delete_v();
   for (size_t i=0; i<all.loaded_dictionaries.size(); i++)
   { free(all.loaded_dictionaries[i].name);
-    all.loaded_dictionaries[i].dict->iter(delete_dictionary_entry);
-    all.loaded_dictionaries[i].dict->delete_v();
-    delete all.loaded_dictionaries[i].dict;
+    free_feature_dict(all.loaded_dictionaries[i].dict);
   }
   delete all.loss;
 
   delete all.all_reduce;
+  free_allreduce_compression(all.compression);
+  free(all.allreduce_staging);
+  free_weight_workers(all.weight_workers);
 
   // destroy all interactions and array of them
   for (v_string& i : all.interactions) i.delete_v();
@@ -6,11 +6,28 @@ license as described in the file LICENSE.
 
 #include <math.h>
 #include <ctype.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 #include "parse_example.h"
 #include "hash.h"
 #include "unique_sort.h"
+#include "feature_dict.h"
 #include "global_data.h"
 #include "constant.h"
+#include "hash_memo.h"
+#include "example_arena.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
@@ -39,11 +56,66 @@ int read_features_string(vw* all, v_array<example*>& examples)
     return (int)num_chars_initial;
 
   substring example = { line, line + num_chars };
-  substring_to_example(all, examples[0], example);
+  substring_to_example(all, examples[0], example, parse_thread_memo(*all->p, 0));
 
   return (int)num_chars_initial;
 }
 
+inline bool is_name_delimiter(char c)
+{ return c == ' ' || c == ':' || c == '\t' || c == '|' || c == '\r';
+}
+
+inline size_t lowest_bit(uint64_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+// bit i is set if window[i] ends a feature or namespace name. names are found 64 bytes at a time, with
+// vector compares where the window is within the line. the line end itself counts as a delimiter.
+inline uint64_t name_delimiters(const char* window, const char* endLine)
+{ uint64_t mask = 0;
+  if (endLine - window >= 64)
+  {
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' '), colon = _mm256_set1_epi8(':'), tab = _mm256_set1_epi8('\t'),
+                  bar = _mm256_set1_epi8('|'), cr = _mm256_set1_epi8('\r');
+    for (size_t i = 0; i < 64; i += 32)
+    { __m256i c = _mm256_loadu_si256((const __m256i*)(window + i));
+      __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, space), _mm256_cmpeq_epi8(c, colon)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(c, tab), _mm256_cmpeq_epi8(c, bar)));
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(c, cr));
+      mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(hit) << i;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i space = _mm_set1_epi8(' '), colon = _mm_set1_epi8(':'), tab = _mm_set1_epi8('\t'),
+                  bar = _mm_set1_epi8('|'), cr = _mm_set1_epi8('\r');
+    for (size_t i = 0; i < 64; i += 16)
+    { __m128i c = _mm_loadu_si128((const __m128i*)(window + i));
+      __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, colon)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(c, tab), _mm_cmpeq_epi8(c, bar)));
+      hit = _mm_or_si128(hit, _mm_cmpeq_epi8(c, cr));
+      mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(hit) << i;
+    }
+#else
+    for (size_t i = 0; i < 64; i++)
+      mask |= (uint64_t)is_name_delimiter(window[i]) << i;
+#endif
+  }
+  else
+  { size_t n = endLine - window;
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)is_name_delimiter(window[i]) << i;
+    mask |= (uint64_t)1 << n;
+  }
+  return mask;
+}
+
 template<bool audit>
 class TC_parser
 {
@@ -63,14 +135,23 @@ public:
   unsigned char (*redefine)[256];
   parser* p;
   example* ae;
+  example_arena* arena; // of ae, holds its audit strings, nullptr without audit
   uint64_t* affix_features;
   bool* spelling_features;
   v_array<char> spelling;
 
   vector<feature_dict*>* namespace_dictionaries;
+  hash_memo* memo; // nullptr without --hash_memo
+
+  char* window; // the 64 bytes of the line whose name delimiters are in window_mask
+  uint64_t window_mask;
 
   ~TC_parser() { }
 
+  inline uint64_t hash_name(substring name, uint64_t seed)
+  { return memo == nullptr ? p->hasher(name, seed) : memo_hash(*memo, p->hasher, name, seed, endLine);
+  }
+
   inline void parserWarning(const char* message, char* begin, char* pos, const char* message2)
   { cout << message << std::string(begin, pos - begin).c_str() << message2
          << "in Example #" << this->p->end_parsed_examples << ": \"" << std::string(this->beginLine, this->endLine).c_str() << "\""
@@ -105,8 +186,16 @@ public:
   inline substring read_name()
   { substring ret;
     ret.begin = reading_head;
-    while( !(*reading_head == ' ' || *reading_head == ':' || *reading_head == '\t' || *reading_head == '|' || reading_head == endLine || *reading_head == '\r' ))
-      ++reading_head;
+    if (reading_head >= window + 64)
+    { window = reading_head;
+      window_mask = name_delimiters(window, endLine);
+    }
+    uint64_t mask = window_mask & (~(uint64_t)0 << (reading_head - window));
+    while (mask == 0)
+    { window += 64;
+      window_mask = mask = name_delimiters(window, endLine);
+    }
+    reading_head = window + lowest_bit(mask);
     ret.end = reading_head;
 
     return ret;
@@ -122,19 +211,14 @@ public:
       v = cur_channel_v * featureValue();
       uint64_t word_hash;
       if (feature_name.end != feature_name.begin)
-        word_hash = (p->hasher(feature_name, channel_hash));
+        word_hash = hash_name(feature_name, channel_hash);
       else
         word_hash = channel_hash + anon++;
       if(v == 0) return; //dont add 0 valued features to list of features
       features& fs = ae->feature_space[index];
       fs.push_back(v, word_hash);
       if(audit)
-      { v_array<char> feature_v = v_init<char>();
-        push_many(feature_v, feature_name.begin, feature_name.end - feature_name.begin);
-        feature_v.push_back('\0');
-        fs.space_names.push_back(audit_strings_ptr(new audit_strings(base, feature_v.begin())));
-        feature_v.delete_v();
-      }
+        fs.space_names.push_back(arena_audit_strings(*arena, base, feature_name.begin, feature_name.end - feature_name.begin));
       if ((affix_features[index] > 0) && (feature_name.end != feature_name.begin))
       { features& affix_fs = ae->feature_space[affix_namespace];
         if (affix_fs.size() == 0)
@@ -159,8 +243,8 @@ public:
             affix_v.push_back('0' + (char)len);
             affix_v.push_back('=');
             push_many(affix_v, affix_name.begin, affix_name.end - affix_name.begin);
-            affix_v.push_back('\0');
-            affix_fs.space_names.push_back(audit_strings_ptr(new audit_strings("affix",affix_v.begin())));
+            affix_fs.space_names.push_back(arena_audit_strings(*arena, "affix", affix_v.begin(), affix_v.size()));
+            affix_v.delete_v();
           }
           affix >>= 4;
         }
@@ -188,30 +272,31 @@ public:
         { v_array<char> spelling_v = v_init<char>();
           if (index != ' ') { spelling_v.push_back(index); spelling_v.push_back('_'); }
           push_many(spelling_v, spelling_ss.begin, spelling_ss.end - spelling_ss.begin);
-          spelling_v.push_back('\0');
-          spell_fs.space_names.push_back(audit_strings_ptr(new audit_strings("spelling",spelling_v.begin())));
+          spell_fs.space_names.push_back(arena_audit_strings(*arena, "spelling", spelling_v.begin(), spelling_v.size()));
+          spelling_v.delete_v();
         }
       }
       if (namespace_dictionaries[index].size() > 0)
       { for (size_t dict=0; dict<namespace_dictionaries[index].size(); dict++)
         { feature_dict* map = namespace_dictionaries[index][dict];
           uint64_t hash = uniform_hash(feature_name.begin, feature_name.end-feature_name.begin, quadratic_constant);
-          features* feats = map->get(feature_name, hash);
-          if ((feats != nullptr) && (feats->values.size() > 0))
+          const dict_entry* feats = dict_find(*map, feature_name.begin, feature_name.end-feature_name.begin, hash);
+          if (feats != nullptr)
           { features& dict_fs = ae->feature_space[dictionary_namespace];
             if (dict_fs.size() == 0)
               ae->indices.push_back(dictionary_namespace);
-            push_many(dict_fs.values, feats->values.begin(), feats->values.size());
-            push_many(dict_fs.indicies, feats->indicies.begin(), feats->indicies.size());
+            push_many(dict_fs.values, map->values + feats->first, feats->count);
+            push_many(dict_fs.indicies, map->indices + feats->first, feats->count);
             dict_fs.sum_feat_sq += feats->sum_feat_sq;
             if (audit)
-              for (size_t i = 0; i < feats->indicies.size(); ++i)
-              { uint64_t id = feats->indicies[i];
+              for (size_t i = 0; i < feats->count; ++i)
+              { uint64_t id = map->indices[feats->first + i];
                 stringstream ss;
                 ss << index << '_';
                 for (char* fc=feature_name.begin; fc!=feature_name.end; ++fc) ss << *fc;
                 ss << '=' << id;
-                dict_fs.space_names.push_back(audit_strings_ptr(new audit_strings("dictionary", ss.str())));
+                string name = ss.str();
+                dict_fs.space_names.push_back(arena_audit_strings(*arena, "dictionary", name.c_str(), name.size()));
               }
           }
         }
@@ -263,7 +348,7 @@ public:
           free(base);
         base = base_v_array.begin();
       }
-      channel_hash = p->hasher(name, hash_base);
+      channel_hash = hash_name(name, hash_base);
       nameSpaceInfoValue();
     }
   }
@@ -324,7 +409,7 @@ public:
     }
   }
 
-  TC_parser(char* reading_head, char* endLine, vw& all, example* ae)
+  TC_parser(char* reading_head, char* endLine, vw& all, example* ae, hash_memo* memo)
   { spelling = v_init<char>();
     if (endLine != reading_head)
     { this->beginLine = reading_head;
@@ -334,10 +419,14 @@ public:
       this->redefine_some = all.redefine_some;
       this->redefine = &all.redefine;
       this->ae = ae;
+      this->arena = audit ? &arena_of(*ae) : nullptr;
       this->affix_features = all.affix_features;
       this->spelling_features = all.spelling_features;
       this->namespace_dictionaries = all.namespace_dictionaries;
       this->base = nullptr;
+      this->memo = memo;
+      this->window = reading_head;
+      this->window_mask = name_delimiters(reading_head, endLine);
       listNameSpace();
       if (base != nullptr)
         free(base);
@@ -345,7 +434,7 @@ public:
   }
 };
 
-void substring_to_example(vw* all, example* ae, substring example)
+char* substring_to_label(vw* all, example* ae, substring example)
 { all->p->lp.default_label(&ae->l);
   char* bar_location = safe_index(example.begin, '|', example.end);
   char* tab_location = safe_index(example.begin, '\t', bar_location);
@@ -374,10 +463,174 @@ void substring_to_example(vw* all, example* ae, substring example)
   if (all->p->words.size() > 0)
     all->p->lp.parse_label(all->p, all->sd, &ae->l, all->p->words);
 
-  if (all->audit || all->hash_inv)
-    TC_parser<true> parser_line(bar_location,example.end,*all,ae);
+  return bar_location;
+}
+
+void substring_to_features(vw* all, example* ae, char* begin, char* end, hash_memo* memo)
+{ if (all->audit || all->hash_inv)
+    TC_parser<true> parser_line(begin,end,*all,ae,memo);
   else
-    TC_parser<false> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<false> parser_line(begin,end,*all,ae,memo);
+  // --sort_features: sorted here, by the parse workers too, rather than in setup_example
+  if (all->p->sort_features)
+    unique_sort_features(all->parse_mask, ae);
+}
+
+void substring_to_example(vw* all, example* ae, substring example, hash_memo* memo)
+{ char* bar_location = substring_to_label(all, ae, example);
+  substring_to_features(all, ae, bar_location, example.end, memo);
+}
+
+/* --parse_threads: the parse thread reads a batch of lines and parses their labels in input order,
+   then the feature part of every line (the expensive part) is parsed by a pool of worker threads.
+   The examples are returned to the parse loop in input order, so learning stays reproducible. */
+struct parse_job
+{ v_array<char> line; // private copy, the io_buf may move or refill while the batch is read
+  example* ae;
+  size_t features_begin;
+  size_t features_end;
+};
+
+struct parse_pool
+{ vw* all;
+  vector<thread> workers;
+  mutex m;
+  condition_variable work_ready;
+  condition_variable work_done;
+  v_array<parse_job> jobs;
+  size_t num_jobs;
+  atomic<size_t> next_job;
+  size_t busy; // workers still working on the current batch
+  uint64_t batch; // incremented for every dispatched batch
+  bool stop;
+  exception_ptr error;
+};
+
+void run_parse_jobs(parse_pool& pool, size_t worker)
+{ try
+  { for (size_t i = pool.next_job++; i < pool.num_jobs; i = pool.next_job++)
+    { parse_job& job = pool.jobs[i];
+      substring_to_features(pool.all, job.ae, job.line.begin() + job.features_begin, job.line.begin() + job.features_end, parse_thread_memo(*pool.all->p, worker));
+    }
+  }
+  catch (...)
+  { lock_guard<mutex> l(pool.m);
+    if (!pool.error)
+      pool.error = current_exception();
+  }
+}
+
+void parse_worker(parse_pool* pool, size_t worker)
+{ uint64_t seen = 0;
+  while (true)
+  { { unique_lock<mutex> l(pool->m);
+      pool->work_ready.wait(l, [pool, seen] { return pool->stop || pool->batch != seen; });
+      if (pool->stop)
+        return;
+      seen = pool->batch;
+    }
+    run_parse_jobs(*pool, worker);
+    { lock_guard<mutex> l(pool->m);
+      if (--pool->busy == 0)
+        pool->work_done.notify_one();
+    }
+  }
+}
+
+void init_parse_threads(vw& all)
+{ parse_pool* pool = new parse_pool;
+  pool->all = &all;
+  pool->jobs = v_init<parse_job>();
+  pool->num_jobs = 0;
+  pool->next_job = 0;
+  pool->busy = 0;
+  pool->batch = 0;
+  pool->stop = false;
+  // the parse thread itself works on every batch too
+  for (size_t i = 1; i < all.p->parse_threads; i++)
+    pool->workers.push_back(thread(parse_worker, pool, i));
+  all.p->parse_pool = pool;
+  all.p->reader = read_features_string_parallel;
+}
+
+void free_parse_threads(parser* p)
+{ parse_pool* pool = (parse_pool*)p->parse_pool;
+  if (pool == nullptr)
+    return;
+  { lock_guard<mutex> l(pool->m);
+    pool->stop = true;
+  }
+  pool->work_ready.notify_all();
+  for (thread& t : pool->workers)
+    t.join();
+  for (parse_job& job : pool->jobs)
+    job.line.delete_v();
+  pool->jobs.delete_v();
+  delete pool;
+  p->parse_pool = nullptr;
+}
+
+int read_features_string_parallel(vw* all, v_array<example*>& examples)
+{ parse_pool& pool = *(parse_pool*)all->p->parse_pool;
+  // keep at least half the ring available to the learner, otherwise the learner can starve waiting on
+  // examples which are held by a batch that cannot complete.
+  size_t batch_size = max((size_t)1, min(all->p->ring_size / 2, all->p->reader_budget));
+  if (pool.jobs.size() < batch_size)
+  { size_t old_size = pool.jobs.size();
+    pool.jobs.resize(batch_size);
+    pool.jobs.end() = pool.jobs.begin() + batch_size;
+    for (size_t i = old_size; i < batch_size; i++)
+      pool.jobs[i].line = v_init<char>();
+  }
+
+  size_t total = 0;
+  size_t n = 0;
+  while (n < batch_size)
+  { char* line;
+    size_t num_chars;
+    size_t num_chars_initial = read_features(all, line, num_chars);
+    if (num_chars_initial < 1)
+      break;
+    total += num_chars_initial;
+
+    parse_job& job = pool.jobs[n];
+    job.line.erase();
+    push_many(job.line, line, num_chars);
+    // the line is followed by a newline in the io_buf, which parseFloat relies on to stop early
+    job.line.push_back('\n');
+    job.line.push_back('\0');
+
+    if (n > 0)
+      examples.push_back(&VW::get_unused_example(all));
+    job.ae = examples[n];
+
+    substring example = { job.line.begin(), job.line.begin() + num_chars };
+    job.features_begin = substring_to_label(all, job.ae, example) - job.line.begin();
+    job.features_end = num_chars;
+    n++;
+  }
+  if (n == 0)
+    return 0;
+
+  { lock_guard<mutex> l(pool.m);
+    pool.num_jobs = n;
+    pool.next_job = 0;
+    pool.busy = pool.workers.size();
+    pool.batch++;
+  }
+  pool.work_ready.notify_all();
+  run_parse_jobs(pool, 0);
+  { unique_lock<mutex> l(pool.m);
+    pool.work_done.wait(l, [&pool] { return pool.busy == 0; });
+  }
+
+  if (pool.error)
+  { exception_ptr error = pool.error;
+    pool.error = nullptr;
+    rethrow_exception(error);
+  }
+
+  return (int)total;
 }
 
 
@@ -386,6 +639,7 @@ namespace VW
 void read_line(vw& all, example* ex, char* line)
 { substring ss = {line, line+strlen(line)};
   while ((ss.end >= ss.begin) && (*(ss.end-1) == '\n')) ss.end--;
-  substring_to_example(&all, ex, ss);
+  // called by the library from any thread, so without the memos of the parse threads
+  substring_to_example(&all, ex, ss, nullptr);
 }
 }
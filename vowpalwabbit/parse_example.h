@@ -15,7 +15,12 @@ typedef enum
   JsonFeatures
 } FeatureInputType;
 
-void substring_to_example(vw* all, example* ae, substring example);
+struct hash_memo;
+
+// memo: of the thread parsing, see parse_thread_memo, or nullptr
+void substring_to_example(vw* all, example* ae, substring example, hash_memo* memo);
+char* substring_to_label(vw* all, example* ae, substring example);
+void substring_to_features(vw* all, example* ae, char* begin, char* end, hash_memo* memo);
 
 namespace VW
 {
@@ -24,4 +29,7 @@ void read_line(vw& all, example* ex, char* line);//read example from the line.
 }
 
 int read_features_string(vw* all, v_array<example*>& examples);
+int read_features_string_parallel(vw* all, v_array<example*>& examples);
+void init_parse_threads(vw& all);
+void free_parse_threads(parser* p);
 size_t read_features(vw* all, char*& line, size_t& num_chars);
@@ -9,14 +9,17 @@ license as described in the file LICENSE.
 #include "parse_primitives.h"
 #include "v_array.h"
 
-// seems to help with skipping spaces
-//#define RAPIDJSON_SIMD
+// rapidjson can skip whitespace 16 bytes at a time (RAPIDJSON_SSE2 or RAPIDJSON_SSE42), but examples are
+// single line JSON with hardly any whitespace between tokens, where the vector skip is slower than the
+// scalar loop (library/json_benchmark on decisionservice.json)
+//#define RAPIDJSON_SSE2
 //#define RAPIDJSON_SSE42
 
 #include <rapidjson/reader.h>
 #include <rapidjson/error/en.h>
 #include "cb.h"
 #include "best_constant.h"
+#include "hash_memo.h"
 #include <boost/algorithm/string.hpp>
 
 // portability fun
@@ -44,6 +47,7 @@ struct Namespace
 	size_t feature_count;
 	BaseState<audit>* return_state;
 	const char* name;
+	size_t name_length;
 
 	void AddFeature(feature_value v, feature_index i, const char* feature_name)
 	{
@@ -58,11 +62,12 @@ struct Namespace
 			ftrs->space_names.push_back(audit_strings_ptr(new audit_strings(name, feature_name)));
 	}
 
-	void AddFeature(vw* all, const char* str)
+	// str is length bytes long and terminated
+	void AddFeature(Context<audit>& ctx, const char* str, size_t length)
 	{
 		ftrs->push_back(
 			1.,
-			VW::hash_feature(*all, str, namespace_hash));
+			ctx.HashFeature(str, length, namespace_hash));
 		feature_count++;
 
 		if (audit)
@@ -364,7 +369,7 @@ struct TextState : BaseState<audit>
 			case '\t':
 				*p = '\0';
 				if (p - start > 0)
-					ns.AddFeature(ctx.all, start);
+					ns.AddFeature(ctx, start, p - start);
 
 				start = p + 1;
 				break;
@@ -377,7 +382,7 @@ struct TextState : BaseState<audit>
 		}
 
 		if (start < end)
-			ns.AddFeature(ctx.all, start);
+			ns.AddFeature(ctx, start, end - start);
 
 		return ctx.previous_state;
 	}
@@ -435,7 +440,7 @@ struct MultiState : BaseState<audit>
 		ctx.examples->push_back(ctx.ex);
 
 		// setup default namespace
-		ctx.PushNamespace(" ", this);
+		ctx.PushNamespace(" ", 1, this);
 
 		return &ctx.default_state;
 	}
@@ -467,7 +472,7 @@ public:
 			return nullptr;
 		}
 
-		ctx.PushNamespace(ctx.key, ctx.previous_state);
+		ctx.PushNamespace(ctx.key, ctx.key_length, ctx.previous_state);
 
 		array_hash = ctx.CurrentNamespace().namespace_hash;
 
@@ -478,10 +483,10 @@ public:
 	{
 		if (audit)
 		{
-			stringstream str;
-			str << '[' << (array_hash - ctx.CurrentNamespace().namespace_hash) << ']';
+			char str[32];
+			snprintf(str, sizeof(str), "[%llu]", (unsigned long long)(array_hash - ctx.CurrentNamespace().namespace_hash));
 
-			ctx.CurrentNamespace().AddFeature(f, array_hash, str.str().c_str());
+			ctx.CurrentNamespace().AddFeature(f, array_hash, str);
 		}
 		else
 			ctx.CurrentNamespace().AddFeature(f, array_hash, nullptr);
@@ -504,7 +509,10 @@ public:
 	BaseState<audit>* StartObject(Context<audit>& ctx)
 	{
 		// parse properties
-		ctx.PushNamespace(ctx.namespace_path.size() > 0 ? ctx.CurrentNamespace().name : " ", this);
+		if (ctx.namespace_path.size() > 0)
+			ctx.PushNamespace(ctx.CurrentNamespace().name, ctx.CurrentNamespace().name_length, this);
+		else
+			ctx.PushNamespace(" ", 1, this);
 
 		return &ctx.default_state;
 	}
@@ -529,7 +537,7 @@ struct IgnoreState : BaseState<audit>
 };
 
 template<bool audit>
-class DefaultState : public BaseState<audit>
+class DefaultState final : public BaseState<audit>
 {
 public:
 	DefaultState() : BaseState<audit>("Default")
@@ -673,7 +681,7 @@ public:
 		char* prepend = (char*)str - ctx.key_length;
 		memmove(prepend, ctx.key, ctx.key_length);
 
-		ctx.CurrentNamespace().AddFeature(ctx.all, prepend);
+		ctx.CurrentNamespace().AddFeature(ctx, prepend, ctx.key_length + length);
 
 		return this;
 	}
@@ -681,14 +689,14 @@ public:
 	BaseState<audit>* Bool(Context<audit>& ctx, bool b)
 	{
 		if (b)
-			ctx.CurrentNamespace().AddFeature(ctx.all, ctx.key);
+			ctx.CurrentNamespace().AddFeature(ctx, ctx.key, ctx.key_length);
 
 		return this;
 	}
 
 	BaseState<audit>* StartObject(Context<audit>& ctx)
 	{
-		ctx.PushNamespace(ctx.key, this);
+		ctx.PushNamespace(ctx.key, ctx.key_length, this);
 		return this;
 	}
 
@@ -728,7 +736,7 @@ public:
 	BaseState<audit>* Float(Context<audit>& ctx, float f)
 	{
 		auto& ns = ctx.CurrentNamespace();
-		ns.AddFeature(f, VW::hash_feature(*ctx.all, ctx.key, ns.namespace_hash), ctx.key);
+		ns.AddFeature(f, ctx.HashFeature(ctx.key, ctx.key_length, ns.namespace_hash), ctx.key);
 
 		return this;
 	}
@@ -944,6 +952,10 @@ struct Context
   v_array<example*>* examples;
   example* ex;
   rapidjson::InsituStringStream* stream;
+  // the line parsed, names within it are hashed with memo, the --hash_memo of the parse thread or nullptr
+  const char* line_begin;
+  const char* line_end;
+  hash_memo* memo;
 
   VW::example_factory_t example_factory;
   void* example_factory_context;
@@ -980,31 +992,54 @@ struct Context
 		namespace_path.delete_v();
 	}
 
-	void init(vw* pall)
+	void init(vw* pall, const char* line, size_t length, hash_memo* pmemo)
 	{
 		all = pall;
 		key = " ";
 		key_length = 1;
+		current_state = root_state = &default_state;
 		previous_state = nullptr;
+		line_begin = line;
+		line_end = line + length;
+		memo = pmemo;
 		label_object_state.init(pall);
 	}
 
+	// the hash of the length bytes of str with seed, without copying them into a string
+	uint64_t Hash(const char* str, size_t length, uint64_t seed)
+	{
+		substring ss = { (char*)str, (char*)str + length };
+		if (memo == nullptr)
+			return all->p->hasher(ss, seed);
+		// names outside of the line, e.g. the default namespace, are only read up to their end
+		const char* limit = (str >= line_begin && str < line_end) ? line_end : ss.end;
+		return memo_hash(*memo, all->p->hasher, ss, seed, limit);
+	}
+
+	// as VW::hash_space and VW::hash_feature
+	feature_index HashSpace(const char* str, size_t length) { return (uint32_t)Hash(str, length, hash_base); }
+	feature_index HashFeature(const char* str, size_t length, uint64_t seed)
+	{
+		return (uint32_t)(Hash(str, length, seed) & all->parse_mask);
+	}
+
     void SetStartStateToDecisionService(DecisionServiceInteraction* data)
     {
 		decision_service_state.data = data;
 		current_state = root_state = &decision_service_state;
     }
 
-	void PushNamespace(const char* ns, BaseState<audit>* return_state)
+	void PushNamespace(const char* ns, size_t length, BaseState<audit>* return_state)
 	{
 		Namespace<audit> n;
 		n.feature_group = ns[0];
-		n.namespace_hash = VW::hash_space(*all, ns);
+		n.namespace_hash = HashSpace(ns, length);
 		n.ftrs = ex->feature_space + ns[0];
 		n.feature_count = 0;
 		n.return_state = return_state;
 
 		n.name = ns;
+		n.name_length = length;
 
 		namespace_path.push_back(n);
 	}
@@ -1049,9 +1084,9 @@ struct VWReaderHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
 {
 	Context<audit> ctx;
 
-	void init(vw* all, v_array<example*>* examples, rapidjson::InsituStringStream* stream, VW::example_factory_t example_factory, void* example_factory_context)
+	void init(vw* all, v_array<example*>* examples, rapidjson::InsituStringStream* stream, size_t length, hash_memo* memo, VW::example_factory_t example_factory, void* example_factory_context)
 	{
-		ctx.init(all);
+		ctx.init(all, stream->src_, length, memo);
 		ctx.examples = examples;
 		ctx.ex = (*examples)[0];
 		all->p->lp.default_label(&ctx.ex->l);
@@ -1061,17 +1096,21 @@ struct VWReaderHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>,
 		ctx.example_factory_context = example_factory_context;
 	}
 
-	// virtual dispatch to current state
-	bool Bool(bool v) { return ctx.TransitionState(ctx.current_state->Bool(ctx, v)); }
-	bool Int(int v) { return ctx.TransitionState(ctx.current_state->Float(ctx, (float)v)); }
-	bool Uint(unsigned v) { return ctx.TransitionState(ctx.current_state->Uint(ctx, v)); }
-	bool Int64(int64_t v) { return ctx.TransitionState(ctx.current_state->Float(ctx, (float)v)); }
-	bool Uint64(uint64_t v) { return ctx.TransitionState(ctx.current_state->Float(ctx, (float)v)); }
-	bool Double(double v) { return ctx.TransitionState(ctx.current_state->Float(ctx, (float)v)); }
-	bool String(const char* str, SizeType len, bool copy) { return ctx.TransitionState(ctx.current_state->String(ctx, str, len, copy)); }
-	bool StartObject() { return ctx.TransitionState(ctx.current_state->StartObject(ctx)); }
-	bool Key(const char* str, SizeType len, bool copy) { return ctx.TransitionState(ctx.current_state->Key(ctx, str, len, copy)); }
-	bool EndObject(SizeType count) { return ctx.TransitionState(ctx.current_state->EndObject(ctx, count)); }
+	// dispatch to current state. most tokens are features handled by the default state, its calls are
+	// direct (and inlined), all other states are called virtually.
+	bool InDefaultState() { return ctx.current_state == &ctx.default_state; }
+
+	bool Bool(bool v) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.Bool(ctx, v) : ctx.current_state->Bool(ctx, v)); }
+	bool Int(int v) { return Float((float)v); }
+	bool Uint(unsigned v) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.Uint(ctx, v) : ctx.current_state->Uint(ctx, v)); }
+	bool Int64(int64_t v) { return Float((float)v); }
+	bool Uint64(uint64_t v) { return Float((float)v); }
+	bool Double(double v) { return Float((float)v); }
+	bool Float(float v) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.Float(ctx, v) : ctx.current_state->Float(ctx, v)); }
+	bool String(const char* str, SizeType len, bool copy) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.String(ctx, str, len, copy) : ctx.current_state->String(ctx, str, len, copy)); }
+	bool StartObject() { return ctx.TransitionState(InDefaultState() ? ctx.default_state.StartObject(ctx) : ctx.current_state->StartObject(ctx)); }
+	bool Key(const char* str, SizeType len, bool copy) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.Key(ctx, str, len, copy) : ctx.current_state->Key(ctx, str, len, copy)); }
+	bool EndObject(SizeType count) { return ctx.TransitionState(InDefaultState() ? ctx.default_state.EndObject(ctx, count) : ctx.current_state->EndObject(ctx, count)); }
 	bool StartArray() { return ctx.TransitionState(ctx.current_state->StartArray(ctx)); }
 	bool EndArray(SizeType count) { return ctx.TransitionState(ctx.current_state->EndArray(ctx, count)); }
 	bool Null() { return ctx.TransitionState(ctx.current_state->Null(ctx)); }
@@ -1097,26 +1136,36 @@ struct json_parser
 namespace VW
 {
 	template<bool audit>
-	void read_line_json(vw& all, v_array<example*>& examples, char* line, example_factory_t example_factory, void* ex_factory_context)
+	// memo: see substring_to_example
+	void parse_json(vw& all, json_parser<audit>& parser, v_array<example*>& examples, char* line, size_t length, hash_memo* memo, example_factory_t example_factory, void* ex_factory_context, DecisionServiceInteraction* data)
 	{
-		// string line_copy(line);
 		// destructive parsing
 		InsituStringStream ss(line);
-		json_parser<audit>* parser = (json_parser<audit>*)all.p->jsonp;
 
-		VWReaderHandler<audit>& handler = parser->handler;
-		handler.init(&all, &examples, &ss, example_factory, ex_factory_context);
+		VWReaderHandler<audit>& handler = parser.handler;
+		handler.init(&all, &examples, &ss, length, memo, example_factory, ex_factory_context);
+		if (data != nullptr)
+			handler.ctx.SetStartStateToDecisionService(data);
 
-		ParseResult result = parser->reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
+		ParseResult result = parser.reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
 		if (!result.IsError())
 			return;
 
 		BaseState<audit>* current_state = handler.current_state();
+		// the parser is reused for the next line
+		std::string error = handler.error().str();
+		handler.error().str("");
 
 		THROW("JSON parser error at " << result.Offset() << ": " << GetParseError_En(result.Code()) << ". "
-			"Handler: " << handler.error().str() <<
-			"State: " << (current_state ? current_state->name : "null")); // <<
-			// "Line: '"<< line_copy << "'");
+			"Handler: " << error <<
+			"State: " << (current_state ? current_state->name : "null"));
+	}
+
+	template<bool audit>
+	void read_line_json(vw& all, v_array<example*>& examples, char* line, example_factory_t example_factory, void* ex_factory_context)
+	{
+		json_parser<audit>* parser = (json_parser<audit>*)all.p->jsonp;
+		parse_json(all, *parser, examples, line, strlen(line), nullptr, example_factory, ex_factory_context, nullptr);
 	}
 
     template<bool audit>
@@ -1125,27 +1174,14 @@ namespace VW
 		std::vector<char> line_vec;
 		if (copy_line)
 		{
-			line_vec.reserve(length);
-			memcpy(&line_vec[0], line, length);
+			line_vec.assign(line, line + length);
+			line_vec.push_back('\0');
 			line = &line_vec[0];
 		}
 
-      InsituStringStream ss(line);
-      json_parser<audit> parser;
-
-      VWReaderHandler<audit>& handler = parser.handler;
-      handler.init(&all, &examples, &ss, example_factory, ex_factory_context);
-      handler.ctx.SetStartStateToDecisionService(data);
-
-      ParseResult result = parser.reader.template Parse<kParseInsituFlag, InsituStringStream, VWReaderHandler<audit>>(ss, handler);
-      if (!result.IsError())
-        return;
-
-      BaseState<audit>* current_state = handler.current_state();
-
-      THROW("JSON parser error at " << result.Offset() << ": " << GetParseError_En(result.Code()) << ". "
-        "Handler: " << handler.error().str() <<
-        "State: " << (current_state ? current_state->name : "null"));
+		// called by the library from any thread, so with a parser of its own and no memo
+		json_parser<audit> parser;
+		parse_json(all, parser, examples, line, length, nullptr, example_factory, ex_factory_context, data);
     }
 }
 
@@ -1159,13 +1195,17 @@ int read_features_json(vw* all, v_array<example*>& examples)
 		return (int)num_chars_initial;
 
 	line[num_chars] = '\0';
+	// the parse thread reuses the parser set up for the input and hashes with its memo
+	json_parser<audit>& parser = *(json_parser<audit>*)all->p->jsonp;
+	hash_memo* memo = parse_thread_memo(*all->p, 0);
+	VW::example_factory_t example_factory = reinterpret_cast<VW::example_factory_t>(&VW::get_unused_example);
 	if (all->p->decision_service_json)
 	{
 		DecisionServiceInteraction interaction;
-		VW::template read_line_decision_service_json<audit>(*all, examples, line, num_chars, false, reinterpret_cast<VW::example_factory_t>(&VW::get_unused_example), all, &interaction);
+		VW::template parse_json<audit>(*all, parser, examples, line, num_chars, memo, example_factory, all, &interaction);
 	}
 	else
-		VW::template read_line_json<audit>(*all, examples, line, reinterpret_cast<VW::example_factory_t>(&VW::get_unused_example), all);
+		VW::template parse_json<audit>(*all, parser, examples, line, num_chars, memo, example_factory, all, nullptr);
 
 	// note: the json parser does single pass parsing and cannot determine if a shared example is needed.
 	// since the communication between the parsing thread the main learner expects examples to be requested in order (as they're layed out in memory)
@@ -1177,7 +1217,7 @@ int read_features_json(vw* all, v_array<example*>& examples)
 		example& ae = VW::get_unused_example(all);
 		char empty = '\0';
 		substring example = { &empty, &empty };
-		substring_to_example(all, &ae, example);
+		substring_to_example(all, &ae, example, nullptr);
 
 		examples.push_back(&ae);
 	}
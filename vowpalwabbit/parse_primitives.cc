@@ -16,6 +16,15 @@ license as described in the file LICENSE.
 #include "hash.h"
 #include "vw_exception.h"
 
+float pow10_table[2 * pow10_range];
+
+static bool fill_pow10_table()
+{ for (int e = -pow10_range; e < pow10_range; e++)
+    pow10_table[e + pow10_range] = powf(10, (float)e);
+  return true;
+}
+static bool pow10_filled = fill_pow10_table();
+
 bool substring_equal(substring&a, substring&b)
 { return (a.end - a.begin == b.end - b.begin) // same length
          && (strncmp(a.begin, b.begin, a.end - a.begin) == 0);
@@ -56,6 +56,15 @@ typedef uint64_t (*hash_func_t)(substring, uint64_t);
 
 hash_func_t getHasher(const std::string& s);
 
+// powf(10, e) for e in [-pow10_range, pow10_range), filled by powf itself so that parsed values are the
+// same with or without the table
+const int pow10_range = 64;
+extern float pow10_table[2 * pow10_range];
+
+inline float pow10f(int e)
+{ return (e >= -pow10_range && e < pow10_range) ? pow10_table[e + pow10_range] : powf(10, (float)e);
+}
+
 // The following function is a home made strtof. The
 // differences are :
 //  - much faster (around 50% but depends on the string to parse)
@@ -102,7 +111,8 @@ inline float parseFloat(char * p, char **end)
 
   }
   if (*p == ' ' || *p == '\n' || *p == '\t')//easy case succeeded.
-  { acc *= powf(10,(float)(exp_acc-num_dec));
+  { if (exp_acc != num_dec)
+      acc *= pow10f(exp_acc-num_dec);
     *end = p;
     return s * acc;
   }
@@ -51,13 +51,28 @@ public:
     }
 };
 
+void construct_weights(vw& all, sparse_parameters& weights, size_t length)
+{ new(&weights) sparse_parameters(length, weights.stride_shift());
+}
+
+void construct_weights(vw& all, dense_parameters& weights, size_t length)
+{ // a loaded --aligned_model replaces the weights by a mapping of the model file without touching them
+  new(&weights) dense_parameters(length, weights.stride_shift(), all.weight_policy, all.vm.count("initial_regressor") > 0);
+  if (!all.quiet && all.vm.count("weight_allocation"))
+  { all.trace_message << "weight allocation = " << weight_allocation_name(weights.allocation());
+    if (weights.allocation() != all.weight_policy)
+      all.trace_message << " (" << weight_allocation_name(all.weight_policy) << " is not available)";
+    all.trace_message << endl;
+  }
+}
+
 template<class T> void initialize_regressor(vw& all, T& weights)
 { // Regressor is already initialized.
   if (weights.not_null())
     return;
   size_t length = ((size_t)1) << all.num_bits;
   try
-    { new(&weights) T(length, weights.stride_shift()); }
+    { construct_weights(all, weights, length); }
   catch (VW::vw_exception anExc)
     { THROW(" Failed to allocate weight array with " << all.num_bits << " bits: try decreasing -b <bits>");
     }
@@ -432,6 +447,8 @@ void dump_regressor(vw& all, io_buf& buf, bool as_text)
 void dump_regressor(vw& all, string reg_name, bool as_text)
 { if (reg_name == string(""))
     return;
+  // written aside and renamed over reg_name, so that a model loaded from reg_name whose weights are mapped
+  // from it keeps its pages
   string start_name = reg_name+string(".writing");
   io_buf io_temp;
 
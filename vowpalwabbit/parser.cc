@@ -41,16 +41,23 @@ int getpid()
 #include <errno.h>
 #include <stdio.h>
 #include <assert.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
 namespace po = boost::program_options;
 
 #include "parse_example.h"
 #include "cache.h"
 #include "unique_sort.h"
+#include "example_arena.h"
 #include "constant.h"
 #include "vw.h"
 #include "interactions.h"
 #include "vw_exception.h"
 #include "parse_example_json.h"
+#include "daemon_server.h"
+#include "pass_threads.h"
+#include "hash_memo.h"
 
 using namespace std;
 
@@ -125,6 +132,29 @@ void condition_variable_signal_all(CV * pcv)
 #endif
 }
 
+/* Handoff state of the example ring.  On the fast path the parser, the learner and finish_example only
+   touch atomics.  examples_lock and the condition variables are used only when one side has to block
+   because the ring is full (parser) or empty (learner), which the *_waiting flags announce to the
+   other side.  All flags and counters use sequentially consistent operations, so either the waiting
+   side sees the update or the updating side sees the waiter and signals it under the lock. */
+struct ring_sync
+{ std::atomic<bool>* used; // per ring slot, example::in_use mirrors it for the reductions
+  std::atomic<uint64_t> published; // number of examples handed to the learner
+  std::atomic<uint64_t> finished; // number of ring examples returned by finish_example
+  std::atomic<bool> parser_waiting;
+  std::atomic<bool> learner_waiting;
+  std::atomic<bool> output_waiting;
+  std::atomic<uint64_t> parser_wait_ns; // spinning or blocked on a full ring
+  std::atomic<uint64_t> learner_wait_ns; // spinning or blocked on an empty ring
+};
+
+uint64_t ring_wait_ns(std::chrono::steady_clock::time_point since)
+{ return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// spin a little before blocking, most handoffs resolve within a few yields
+const size_t ring_spins = 16;
+
 //This should not? matter in a library mode.
 bool got_sigterm;
 
@@ -144,12 +174,23 @@ parser* new_parser()
 { parser& ret = calloc_or_throw<parser>();
   ret.input = new io_buf;
   ret.output = new io_buf;
-  ret.local_example_number = 0;
   ret.in_pass_counter = 0;
   ret.ring_size = 1 << 8;
+  ret.parse_threads = 1;
+  ret.reader_budget = (size_t)-1;
+  ret.parse_pool = nullptr;
+  ret.memos = nullptr;
+  ret.memo_count = 0;
   ret.done = false;
   ret.used_index = 0;
+  ret.ring = nullptr;
+  ret.server = nullptr;
   ret.jsonp = nullptr;
+  ret.cache_format = 1;
+  ret.cache_block_bytes = cache_block_size;
+  ret.cache_lz = false;
+  ret.blocks = nullptr;
+  ret.pass_index = nullptr;
 
   return &ret;
 }
@@ -160,8 +201,10 @@ void set_compressed(parser* par)
   par->output = new comp_io_buf;
 }
 
-uint32_t cache_numbits(io_buf* buf, int filepointer)
+// reads the header of a cache file, blocks tells whether it is a format 2 cache
+uint32_t cache_numbits(io_buf* buf, int filepointer, bool& blocks)
 { v_array<char> t = v_init<char>();
+  blocks = false;
 
   try
   { size_t v_length;
@@ -188,7 +231,8 @@ uint32_t cache_numbits(io_buf* buf, int filepointer)
     if (buf->read_file(filepointer, &temp, 1) < 1)
       THROW("failed to read");
 
-    if (temp != 'c')
+    blocks = temp == 'b';
+    if (temp != 'c' && temp != 'b')
       THROW("data file is not a cache file");
   }
   catch(...)
@@ -212,11 +256,19 @@ bool member(v_array<int> ids, int id)
   return false;
 }
 
+// a format 2 cache needs a parser.blocks, format 1 caches none
+void check_cache_format(parser& p, bool blocks)
+{ if (blocks != (p.blocks != nullptr))
+    THROW("cache files of format 1 and 2 can't be mixed, use --kill_cache to recreate them");
+}
+
 void reset_source(vw& all, size_t numbits)
 { io_buf* input = all.p->input;
   input->current = 0;
   if (all.p->write_cache)
-  { all.p->output->flush();
+  { if (all.p->blocks != nullptr)
+      flush_cache_block(*all.p->blocks, *all.p->output);
+    all.p->output->flush();
     all.p->write_cache = false;
     all.p->output->close_file();
     remove(all.p->output->finalname.begin());
@@ -235,10 +287,7 @@ void reset_source(vw& all, size_t numbits)
   if ( all.p->resettable == true )
   { if (all.daemon)
     { // wait for all predictions to be sent back to client
-      mutex_lock(&all.p->output_lock);
-      while (all.p->local_example_number != all.p->end_parsed_examples)
-        condition_variable_wait(&all.p->output_done, &all.p->output_lock);
-      mutex_unlock(&all.p->output_lock);
+      wait_for_finished_examples(*all.p);
 
       // close socket, erase final prediction sink and socket
       io_buf::close_file_or_socket(all.p->input->files[0]);
@@ -266,10 +315,14 @@ void reset_source(vw& all, size_t numbits)
       }
     }
     else
-    { for (size_t i = 0; i < input->files.size(); i++)
+    { if (all.p->blocks != nullptr)
+        all.p->blocks->examples = 0;
+      for (size_t i = 0; i < input->files.size(); i++)
       { input->reset_file(input->files[i]);
-        if (cache_numbits(input, input->files[i]) < numbits)
+        bool blocks;
+        if (cache_numbits(input, input->files[i], blocks) < numbits)
           THROW("argh, a bug in caching of some sort!");
+        check_cache_format(*all.p, blocks);
       }
     }
   }
@@ -286,6 +339,13 @@ void finalize_source(parser* p)
     p->input->files.pop();
   p->input->close_files();
 
+  free_parse_threads(p);
+  free_hash_memos(*p);
+  free_daemon_server(p);
+  free_cache_blocks(p->blocks);
+  p->blocks = nullptr;
+  free_pass_threads(p);
+
   delete p->input;
   p->output->close_files();
   delete p->output;
@@ -319,7 +379,9 @@ void make_write_cache(vw& all, string &newname, bool quiet)
 
   output->write_file(f, &v_length, sizeof(v_length));
   output->write_file(f,version.to_string().c_str(),v_length);
-  output->write_file(f,"c",1);
+  if (all.p->cache_format == 2 && all.p->blocks == nullptr)
+    all.p->blocks = new_cache_blocks(all.p->cache_lz);
+  output->write_file(f, all.p->blocks != nullptr ? "b" : "c", 1);
   output->write_file(f, &all.num_bits, sizeof(all.num_bits));
 
   push_many(output->finalname,newname.c_str(),newname.length()+1);
@@ -348,7 +410,8 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
     if (f == -1)
       make_write_cache(all, caches[i], quiet);
     else
-    { uint64_t c = cache_numbits(all.p->input, f);
+    { bool blocks;
+      uint64_t c = cache_numbits(all.p->input, f, blocks);
       if (c < all.num_bits)
       { if (!quiet)
 		  all.trace_message << "WARNING: cache file is ignored as it's made with less bit precision than required!" << endl;
@@ -358,6 +421,9 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       else
       { if (!quiet)
           all.trace_message << "using cache_file = " << caches[i].c_str() << endl;
+        if (i == 0 && blocks)
+          all.p->blocks = new_cache_blocks(all.p->cache_lz);
+        check_cache_format(*all.p, blocks);
         all.p->reader = read_cached_features;
         if (c == all.num_bits)
           all.p->sorted_cache = true;
@@ -422,7 +488,7 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       THROWERRNO("bind");
 
     // listen on socket
-    if (listen(all.p->bound_sock, 1) < 0)
+    if (listen(all.p->bound_sock, all.vm.count("multiplex") ? SOMAXCONN : 1) < 0)
       THROWERRNO("listen");
 
     // write port file
@@ -458,6 +524,14 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       pid_file.close();
     }
 
+    if (all.daemon && !all.active && all.vm.count("multiplex"))
+    { // one process serves all connections, nothing needs to be forked or shared
+      fclose(stdin);
+      init_daemon_server(all);
+      all.p->resettable = all.p->write_cache;
+      return;
+    }
+
     if (all.daemon && !all.active)
     {
 #ifdef _WIN32
@@ -466,6 +540,8 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       fclose(stdin);
       // weights will be shared across processes, accessible to children
       all.weights.share(all.length());
+      if (!all.quiet && !all.weights.sparse && all.vm.count("weight_allocation"))
+        all.trace_message << "shared weight allocation = " << weight_allocation_name(all.weights.dense_weights.allocation()) << endl;
 
       // learning state to be shared across children
       shared_data* sd = (shared_data *)mmap(0,sizeof(shared_data),
@@ -599,7 +675,10 @@ child:
 		  all.p->decision_service_json = all.vm.count("dsjson") > 0;
       }
       else
-        all.p->reader = read_features_string;
+      { all.p->reader = read_features_string;
+        if (all.p->parse_threads > 1)
+          init_parse_threads(all);
+      }
 
       all.p->resettable = all.p->write_cache;
     }
@@ -613,11 +692,41 @@ child:
     all.trace_message << "num sources = " << all.p->input->files.size() << endl;
 }
 
+void mark_done(parser& p)
+{ mutex_lock(&p.examples_lock);
+  p.done = true;
+  condition_variable_signal_all(&p.example_available);
+  mutex_unlock(&p.examples_lock);
+}
+
 void set_done(vw& all)
 { all.early_terminate = true;
-  mutex_lock(&all.p->examples_lock);
-  all.p->done = true;
-  mutex_unlock(&all.p->examples_lock);
+  mark_done(*all.p);
+}
+
+uint64_t finished_examples(parser& p)
+{ return p.ring->finished;
+}
+
+ring_usage ring_snapshot(parser& p)
+{ ring_usage usage = { 0, 0., 0. };
+  if (p.ring == nullptr)
+    return usage;
+  uint64_t finished = p.ring->finished;
+  usage.used = p.ring->published - finished;
+  usage.parser_wait = p.ring->parser_wait_ns * 1e-9;
+  usage.learner_wait = p.ring->learner_wait_ns * 1e-9;
+  return usage;
+}
+
+void wait_for_finished_examples(parser& p)
+{ ring_sync& ring = *p.ring;
+  mutex_lock(&p.output_lock);
+  ring.output_waiting = true;
+  while (ring.finished != p.end_parsed_examples)
+    condition_variable_wait(&p.output_done, &p.output_lock);
+  ring.output_waiting = false;
+  mutex_unlock(&p.output_lock);
 }
 
 void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
@@ -660,15 +769,17 @@ void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
  * Hash is evaluated using the principle h(a, b) = h(a)*X + h(b), where X is a random no.
  * 32 random nos. are maintained in an array and are used in the hashing.
  */
-void generateGrams(vw& all, example* &ex)
+void generateGrams(vw& all, example* &ex, v_array<size_t>& gram_mask)
 { for(namespace_index index : ex->indices)
   { size_t length = ex->feature_space[index].size();
     for (size_t n = 1; n < all.ngram[index]; n++)
-    { all.p->gram_mask.erase();
-      all.p->gram_mask.push_back((size_t)0);
+    { gram_mask.erase();
+      gram_mask.push_back((size_t)0);
       addgrams(all, n, all.skips[index], ex->feature_space[index],
-               length, all.p->gram_mask, 0);
+               length, gram_mask, 0);
     }
+    if (ex->feature_space[index].size() != length) // the grams follow the features unsorted
+      ex->sorted = false;
   }
 }
 
@@ -687,52 +798,9 @@ void feature_limit(vw& all, example* ex)
     }
 }
 
-namespace VW
-{
-example& get_unused_example(vw* all)
-{ parser* p = all->p;
-  while (true)
-  { mutex_lock(&p->examples_lock);
-    if (p->examples[p->begin_parsed_examples % p->ring_size].in_use == false)
-    { example& ret = p->examples[p->begin_parsed_examples++ % p->ring_size];
-      ret.in_use = true;
-      mutex_unlock(&p->examples_lock);
-      return ret;
-    }
-    else
-      condition_variable_wait(&p->example_unused, &p->examples_lock);
-    mutex_unlock(&p->examples_lock);
-  }
-}
-
-void setup_examples(vw& all, v_array<example*>& examples)
-{ for (example* ae : examples)
-    setup_example(all, ae);
-}
-
-void setup_example(vw& all, example* ae)
-{ if (all.p->sort_features && ae->sorted == false)
-    unique_sort_features(all.parse_mask, ae);
-
-  if (all.p->write_cache)
-  { all.p->lp.cache_label(&ae->l, *(all.p->output));
-    cache_features(*(all.p->output), ae, all.parse_mask);
-  }
-
-  ae->partial_prediction = 0.;
-  ae->num_features = 0;
-  ae->total_sum_feat_sq = 0;
+void setup_example_features(vw& all, example* ae, v_array<size_t>& gram_mask)
+{ ae->partial_prediction = 0.;
   ae->loss = 0.;
-
-  ae->example_counter = (size_t)(all.p->end_parsed_examples);
-  if (!all.p->emptylines_separate_examples)
-    all.p->in_pass_counter++;
-
-  ae->test_only = is_test_only(all.p->in_pass_counter, all.holdout_period, all.holdout_after, all.holdout_set_off, all.p->emptylines_separate_examples ? (all.holdout_period-1) : 0);
-
-  if (all.p->emptylines_separate_examples && example_is_newline(*ae))
-    all.p->in_pass_counter++;
-
   ae->weight = all.p->lp.get_weight(&ae->l);
 
   if (all.ignore_some)
@@ -746,7 +814,7 @@ void setup_example(vw& all, example* ae)
       }
 
   if(all.ngram_strings.size() > 0)
-    generateGrams(all, ae);
+    generateGrams(all, ae, gram_mask);
 
   if (all.add_constant)//add constant feature
     VW::add_constant_feature(all,ae);
@@ -773,6 +841,68 @@ void setup_example(vw& all, example* ae)
   ae->num_features += new_features_cnt;
   ae->total_sum_feat_sq += new_features_sum_feat_sq;
 }
+
+namespace VW
+{
+example& get_unused_example(vw* all)
+{ parser* p = all->p;
+  ring_sync& ring = *p->ring;
+  size_t ring_index = p->begin_parsed_examples % p->ring_size;
+  std::atomic<bool>& used = ring.used[ring_index];
+
+  if (used)
+  { std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; used && i < ring_spins; i++)
+      std::this_thread::yield();
+    if (used)
+    { // the ring is full, wait for the learner to finish the example in this slot
+      p->ring_full_stalls++;
+      mutex_lock(&p->examples_lock);
+      ring.parser_waiting = true;
+      while (used)
+        condition_variable_wait(&p->example_unused, &p->examples_lock);
+      ring.parser_waiting = false;
+      mutex_unlock(&p->examples_lock);
+    }
+    ring.parser_wait_ns += ring_wait_ns(start);
+  }
+
+  used = true;
+  example& ret = p->examples[ring_index];
+  ret.in_use = true;
+  p->begin_parsed_examples++;
+  return ret;
+}
+
+void setup_examples(vw& all, v_array<example*>& examples)
+{ for (example* ae : examples)
+    setup_example(all, ae);
+}
+
+void setup_example(vw& all, example* ae)
+{ if (all.p->sort_features && ae->sorted == false)
+    unique_sort_features(all.parse_mask, ae);
+
+  if (all.p->write_cache)
+  { if (all.p->blocks != nullptr)
+      cache_block_example(all, *all.p->blocks, ae);
+    else
+    { all.p->lp.cache_label(&ae->l, *(all.p->output));
+      cache_features(*(all.p->output), ae, all.parse_mask);
+    }
+  }
+
+  ae->example_counter = (size_t)(all.p->end_parsed_examples);
+  if (!all.p->emptylines_separate_examples)
+    all.p->in_pass_counter++;
+
+  ae->test_only = is_test_only(all.p->in_pass_counter, all.holdout_period, all.holdout_after, all.holdout_set_off, all.p->emptylines_separate_examples ? (all.holdout_period-1) : 0);
+
+  if (all.p->emptylines_separate_examples && example_is_newline(*ae))
+    all.p->in_pass_counter++;
+
+  setup_example_features(all, ae, all.p->gram_mask);
+}
 }
 
 namespace VW
@@ -871,6 +1001,7 @@ void parse_example_label(vw& all, example&ec, string label)
 void empty_example(vw& all, example& ec)
 { for (features& fs : ec)
     fs.erase();
+  reset_example_arena(ec);
 
   ec.indices.erase();
   ec.tag.erase();
@@ -883,21 +1014,37 @@ void finish_example(vw& all, example* ec)
   if (!is_ring_example(all, ec))
     return;
 
-  mutex_lock(&all.p->output_lock);
-  all.p->local_example_number++;
-  condition_variable_signal(&all.p->output_done);
-  mutex_unlock(&all.p->output_lock);
+  parser& p = *all.p;
+  ring_sync& ring = *p.ring;
+  ring.finished++;
+  if (ring.output_waiting)
+  { mutex_lock(&p.output_lock);
+    condition_variable_signal(&p.output_done);
+    mutex_unlock(&p.output_lock);
+  }
 
   empty_example(all, *ec);
 
-  mutex_lock(&all.p->examples_lock);
   assert(ec->in_use);
   ec->in_use = false;
-  condition_variable_signal(&all.p->example_unused);
-  if (all.p->done)
-    condition_variable_signal_all(&all.p->example_available);
-  mutex_unlock(&all.p->examples_lock);
+  ring.used[ec - p.examples] = false;
+  if (ring.parser_waiting)
+  { mutex_lock(&p.examples_lock);
+    condition_variable_signal(&p.example_unused);
+    mutex_unlock(&p.examples_lock);
+  }
+}
 }
+
+// make the examples parsed so far visible to the learner
+void publish_examples(parser& p)
+{ ring_sync& ring = *p.ring;
+  ring.published = p.end_parsed_examples;
+  if (ring.learner_waiting)
+  { mutex_lock(&p.examples_lock);
+    condition_variable_signal_all(&p.example_available);
+    mutex_unlock(&p.examples_lock);
+  }
 }
 
 #ifdef _WIN32
@@ -913,7 +1060,11 @@ void *main_parse_loop(void *in)
     size_t examples_available;
     while(!all->p->done)
     { examples.push_back(&VW::get_unused_example(all)); // need at least 1 example
-      if (!all->do_reset_source && example_number != all->pass_length && all->max_examples > example_number
+      all->p->reader_budget = min(all->pass_length > example_number ? all->pass_length - example_number : 1,
+                                  all->max_examples > example_number ? all->max_examples - example_number : 1);
+      // a whole pass learned by --pass_threads continues with its end of pass
+      bool pass_learned = example_number == 0 && !all->do_reset_source && learn_pass_threads(*all, example_number);
+      if (!pass_learned && !all->do_reset_source && example_number != all->pass_length && all->max_examples > example_number
           && all->p->reader(all, examples) > 0)
       { VW::setup_examples(*all, examples);
         example_number+=examples.size();
@@ -930,17 +1081,12 @@ void *main_parse_loop(void *in)
           all->pass_length = all->pass_length*2+1;
         }
         if (all->passes_complete >= all->numpasses && all->max_examples >= example_number)
-        { mutex_lock(&all->p->examples_lock);
-          all->p->done = true;
-          mutex_unlock(&all->p->examples_lock);
-        }
+          mark_done(*all->p);
         example_number = 0;
         examples_available=1;
       }
-      mutex_lock(&all->p->examples_lock);
       all->p->end_parsed_examples+=examples_available;
-      condition_variable_signal_all(&all->p->example_available);
-      mutex_unlock(&all->p->examples_lock);
+      publish_examples(*all->p);
       examples.erase();
     }
   }
@@ -952,10 +1098,7 @@ void *main_parse_loop(void *in)
   }
 
   if (!all->p->done)
-  { mutex_lock(&all->p->examples_lock);
-	all->p->done = true;
-	mutex_unlock(&all->p->examples_lock);
-  }
+    mark_done(*all->p);
 
   examples.delete_v();
   return 0L;
@@ -964,27 +1107,36 @@ void *main_parse_loop(void *in)
 namespace VW
 {
 example* get_example(parser* p)
-{ mutex_lock(&p->examples_lock);
-  if (p->end_parsed_examples != p->used_index)
-  { size_t ring_index = p->used_index++ % p->ring_size;
-    if (!(p->examples+ring_index)->in_use)
-      cout << "error: example should be in_use " << p->used_index << " " << p->end_parsed_examples << " " << ring_index << endl;
-    assert((p->examples+ring_index)->in_use);
-    mutex_unlock(&p->examples_lock);
-
-    return p->examples + ring_index;
-  }
-  else
-  { if (!p->done)
-    { condition_variable_wait(&p->example_available, &p->examples_lock);
+{ ring_sync& ring = *p->ring;
+
+  if (ring.published == p->used_index)
+  { std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; ring.published == p->used_index && i < ring_spins; i++)
+      std::this_thread::yield();
+    if (ring.published == p->used_index)
+    { // the ring is empty, wait for the parser to publish more examples or finish
+      mutex_lock(&p->examples_lock);
+      ring.learner_waiting = true;
+      if (ring.published == p->used_index && !p->done)
+        p->ring_empty_stalls++;
+      while (ring.published == p->used_index && !p->done)
+        condition_variable_wait(&p->example_available, &p->examples_lock);
+      ring.learner_waiting = false;
       mutex_unlock(&p->examples_lock);
-      return get_example(p);
     }
-    else
-    { mutex_unlock(&p->examples_lock);
+    ring.learner_wait_ns += ring_wait_ns(start);
+    if (ring.published == p->used_index)
       return nullptr;
-    }
   }
+
+  size_t ring_index = p->used_index++ % p->ring_size;
+  if (!(p->examples+ring_index)->in_use)
+    cout << "error: example should be in_use " << p->used_index << " " << ring.published << " " << ring_index << endl;
+  assert((p->examples+ring_index)->in_use);
+  if (p->server != nullptr)
+    select_daemon_output(*p->server, ring_index);
+
+  return p->examples + ring_index;
 }
 
 float get_topic_prediction(example* ec, size_t i)
@@ -1037,13 +1189,30 @@ void initialize_examples(vw& all)
   all.p->begin_parsed_examples = 0;
   all.p->end_parsed_examples = 0;
   all.p->done = false;
+  all.p->ring_full_stalls = 0;
+  all.p->ring_empty_stalls = 0;
 
+  if (all.p->ring_size == 0)
+    THROW("ring_size must be positive");
   all.p->examples = calloc_or_throw<example>(all.p->ring_size);
 
   for (size_t i = 0; i < all.p->ring_size; i++)
   { memset(&all.p->examples[i].l, 0, sizeof(polylabel));
     all.p->examples[i].in_use = false;
   }
+
+  ring_sync* ring = new ring_sync;
+  ring->used = new std::atomic<bool>[all.p->ring_size];
+  for (size_t i = 0; i < all.p->ring_size; i++)
+    ring->used[i] = false;
+  ring->published = 0;
+  ring->finished = 0;
+  ring->parser_waiting = false;
+  ring->learner_waiting = false;
+  ring->output_waiting = false;
+  ring->parser_wait_ns = 0;
+  ring->learner_wait_ns = 0;
+  all.p->ring = ring;
 }
 
 void adjust_used_index(vw& all)
@@ -1085,6 +1254,12 @@ void free_parser(vw& all)
     free(all.p->examples);
   }
 
+  if (all.p->ring != nullptr)
+  { delete[] all.p->ring->used;
+    delete all.p->ring;
+    all.p->ring = nullptr;
+  }
+
   io_buf* output = all.p->output;
   if (output != nullptr)
   { output->finalname.delete_v();
@@ -12,6 +12,11 @@ license as described in the file LICENSE.
 namespace po = boost::program_options;
 
 struct vw;
+struct ring_sync;
+struct daemon_server;
+struct cache_blocks;
+struct block_index;
+struct hash_memo;
 
 struct parser
 { v_array<substring> channels;//helper(s) for text parsing
@@ -26,16 +31,28 @@ struct parser
   bool write_cache;
   bool sort_features;
   bool sorted_cache;
+  size_t cache_format; // format of a cache written, see --cache_format
+  bool cache_lz; // compress the blocks of a written format 2 cache
+  size_t cache_block_bytes; // size of the blocks of a written format 2 cache, see --cache_block_size
+  cache_blocks* blocks; // block framing of the format 2 cache being written or read
+  block_index* pass_index; // blocks of the format 2 cache learned by --pass_threads
 
   size_t ring_size;
+  size_t parse_threads; // number of threads parsing text features, see --parse_threads
+  size_t reader_budget; // the most examples a reader call may return without exceeding --examples or the pass length
+  void* parse_pool; // worker threads used by read_features_string_parallel
+  hash_memo* memos; // of the names hashed by each parse thread with --hash_memo, nullptr without
+  size_t memo_count;
   uint64_t begin_parsed_examples; // The index of the beginning parsed example.
   uint64_t end_parsed_examples; // The index of the fully parsed example.
-  uint64_t local_example_number;
   uint32_t in_pass_counter;
   example* examples;
   uint64_t used_index;
   bool emptylines_separate_examples; // true if you want to have holdout computed on a per-block basis rather than a per-line basis
-  MUTEX examples_lock;
+  ring_sync* ring; // lock-free handoff of the ring examples between parser and learner
+  uint64_t ring_full_stalls; // times the parser blocked because the next slot was still in use
+  uint64_t ring_empty_stalls; // times the learner blocked waiting for the parser
+  MUTEX examples_lock; // only taken to block on a full or empty ring
   CV example_available;
   CV example_unused;
   MUTEX output_lock;
@@ -50,6 +67,7 @@ struct parser
   int label_sock;
   int bound_sock;
   int max_fd;
+  daemon_server* server; // serves every daemon connection with --multiplex
 
   v_array<substring> parse_name;
 
@@ -74,6 +92,17 @@ void adjust_used_index(vw& all);
 //parser control
 void make_example_available();
 void set_done(vw& all);
+void mark_done(parser& p); // like set_done, but the run finishes normally, e.g. the model is saved
+uint64_t finished_examples(parser& p); // ring examples returned by finish_example so far
+
+// the ring as seen from any thread, for progress statistics
+struct ring_usage
+{ uint64_t used; // examples handed to the learner and not finished yet
+  double parser_wait; // seconds the parser waited on a full ring
+  double learner_wait; // seconds the learner waited on an empty ring
+};
+ring_usage ring_snapshot(parser& p);
+void wait_for_finished_examples(parser& p); // until the learner finished every example handed to it
 
 //source control functions
 bool inconsistent_cache(size_t numbits, io_buf& cache);
@@ -82,3 +111,7 @@ void finalize_source(parser* source);
 void set_compressed(parser* par);
 void initialize_examples(vw& all);
 void free_parser(vw& all);
+
+bool is_test_only(uint32_t counter, uint32_t period, uint32_t after, bool holdout_off, uint32_t target_modulus);
+// the part of VW::setup_example that doesn't touch the parser, gram_mask is scratch space for ngrams
+void setup_example_features(vw& all, example* ae, v_array<size_t>& gram_mask);
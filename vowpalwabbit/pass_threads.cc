@@ -0,0 +1,246 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <float.h>
+#include <thread>
+#include <atomic>
+#include <exception>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "pass_threads.h"
+#include "stats_dump.h"
+#include "global_data.h"
+#include "parser.h"
+#include "cache.h"
+#include "vw.h"
+#include "unique_sort.h"
+#include "gd.h"
+
+using namespace std;
+
+struct block_index
+{ v_array<uint64_t> offsets; // of every block in the cache file
+  v_array<uint64_t> firsts; // position in the pass of the first example of every block
+  uint64_t examples; // in the whole cache
+  int file; // the cache file indexed
+  bool checked; // whether the setup was checked, once
+  bool usable; // and allows learning passes in threads
+};
+
+namespace
+{
+#ifndef _WIN32
+// reads from any offset of a file shared with other threads, without moving its file position
+class pread_buf : public io_buf
+{
+public:
+  uint64_t offset;
+
+  pread_buf(int f) : offset(0) { files.push_back(f); }
+  virtual ssize_t read_file(int f, void* buf, size_t nbytes)
+  { ssize_t read = pread(f, buf, nbytes, (off_t)offset);
+    if (read > 0)
+      offset += read;
+    return read;
+  }
+  void seek(uint64_t to)
+  { offset = to;
+    current = 0;
+    space.end() = space.begin();
+    head = space.begin();
+  }
+};
+
+// indexes the blocks of the cache file f, which start at offset
+bool index_blocks(block_index& index, int f, uint64_t offset)
+{ index.offsets.erase();
+  index.firsts.erase();
+  index.examples = 0;
+  char header[cache_block_header_size];
+  ssize_t read;
+  while ((read = pread(f, header, sizeof(header), (off_t)offset)) == (ssize_t)sizeof(header))
+  { uint32_t examples;
+    index.offsets.push_back(offset);
+    index.firsts.push_back(index.examples);
+    offset += cache_block_extent(header, examples);
+    index.examples += examples;
+  }
+  index.file = f;
+  return read == 0;
+}
+#endif
+
+// the reason the setup can't be learned by pass threads, nullptr if it can
+const char* unsupported(vw& all)
+{
+#ifdef _WIN32
+  return "not available on windows";
+#else
+  const char* reason = GD::hogwild_unsupported(all);
+  if (reason != nullptr)
+    return reason;
+  if (all.pass_length != (size_t)-1 || all.max_examples != (size_t)-1)
+    return "not supported with --examples or --initial_pass_length";
+  if (all.p->emptylines_separate_examples)
+    return "multiline examples are not supported";
+  if (all.p->input->file_offset() < 0)
+    return "the cache file can't be read at any offset, e.g. as it is compressed";
+  return nullptr;
+#endif
+}
+
+struct pass_thread
+{ vw* all;
+  block_index* index;
+  GD::hogwild_state* hogwild;
+  atomic<size_t>* next_block;
+  padded_totals counts; // of the examples this thread learned
+  exception_ptr error;
+};
+
+#ifndef _WIN32
+void learn_blocks(pass_thread& t)
+{ vw& all = *t.all;
+  parser& p = *all.p;
+  block_index& index = *t.index;
+  pread_buf input(index.file);
+  cache_blocks* blocks = new_cache_blocks(false);
+  v_array<size_t> gram_mask = v_init<size_t>();
+  example* ec = VW::alloc_examples(p.lp.label_size, 1);
+
+  try
+  { for (size_t block; (block = (*t.next_block)++) < index.offsets.size();)
+    { input.seek(index.offsets[block]);
+      if (!read_cache_block(all, *blocks, input))
+        THROW("cache block " << block << " can't be read, the cache file changed");
+      uint64_t counter = index.firsts[block];
+      while (blocks->examples > 0)
+      { read_block_example(all, *blocks, ec);
+        if (p.sort_features && ec->sorted == false)
+          unique_sort_features(all.parse_mask, ec);
+        ec->example_counter = (size_t)++counter;
+        ec->test_only = is_test_only((uint32_t)counter, all.holdout_period, all.holdout_after, all.holdout_set_off, 0);
+        setup_example_features(all, ec, gram_mask);
+
+        all.learn(ec);
+        GD::hogwild_learned(*t.hogwild, *ec);
+
+        label_data& ld = ec->l.simple;
+        t.counts.totals.update(ec->test_only, ld.label != FLT_MAX, ec->loss, ec->weight, ec->num_features);
+        if (ld.label != FLT_MAX && !ec->test_only)
+          t.counts.totals.weighted_labels += ld.label * ec->weight;
+        VW::empty_example(all, *ec);
+      }
+    }
+  }
+  catch (...)
+  { t.error = current_exception();
+  }
+
+  VW::dealloc_example(p.lp.delete_label, *ec);
+  free(ec);
+  gram_mask.delete_v();
+  free_cache_blocks(blocks);
+}
+
+// widens the range of labels to those of the cache, which the threads learn without widening it
+void scan_labels(vw& all, block_index& index)
+{ pread_buf input(index.file);
+  cache_blocks* blocks = new_cache_blocks(false);
+  example* ec = VW::alloc_examples(all.p->lp.label_size, 1);
+  for (size_t block = 0; block < index.offsets.size(); block++)
+  { input.seek(index.offsets[block]);
+    if (!read_cache_block(all, *blocks, input))
+      THROW("cache block " << block << " can't be read, the cache file changed");
+    while (blocks->examples > 0)
+    { read_block_example(all, *blocks, ec);
+      all.set_minmax(all.sd, ec->l.simple.label);
+      VW::empty_example(all, *ec);
+    }
+  }
+  VW::dealloc_example(all.p->lp.delete_label, *ec);
+  free(ec);
+  free_cache_blocks(blocks);
+}
+#endif
+
+}
+
+bool learn_pass_threads(vw& all, uint64_t& examples)
+{ parser& p = *all.p;
+  // the parser reads passes which write the cache or don't come from a single format 2 cache
+  if (all.pass_threads <= 1 || p.blocks == nullptr || p.write_cache || p.reader != read_cached_features
+      || p.input->files.size() != 1)
+    return false;
+
+  if (p.pass_index == nullptr)
+  { p.pass_index = &calloc_or_throw<block_index>();
+    p.pass_index->file = -1;
+  }
+  block_index& index = *p.pass_index;
+  if (!index.checked)
+  { const char* reason = unsupported(all);
+    index.checked = true;
+    index.usable = reason == nullptr;
+    if (!index.usable && !all.quiet)
+      all.trace_message << "warning: --pass_threads ignored, " << reason << endl;
+  }
+  if (!index.usable)
+    return false;
+
+#ifdef _WIN32
+  return false;
+#else
+  int file = p.input->files[0];
+  if (index.file != file && !index_blocks(index, file, p.input->file_offset()))
+    THROW("the format 2 cache file is truncated");
+
+  // the learner has to be done with the last pass, including its end of pass example
+  wait_for_finished_examples(p);
+
+  // a pass before this one learned the labels of the cache, unless the cache was there before vw started
+  if (all.passes_complete == 0 && all.set_minmax != noop_mm)
+    scan_labels(all, index);
+  GD::hogwild_state hogwild;
+  GD::start_hogwild(all, hogwild);
+
+  atomic<size_t> next_block(0);
+  vector<pass_thread> threads(all.pass_threads);
+  vector<thread> workers;
+  for (pass_thread& t : threads)
+  { t.all = &all;
+    t.index = &index;
+    t.next_block = &next_block;
+    t.hogwild = &hogwild;
+    t.counts.totals = example_totals();
+  }
+  for (size_t i = 1; i < threads.size(); i++)
+    workers.push_back(thread(learn_blocks, ref(threads[i])));
+  learn_blocks(threads[0]);
+  for (thread& w : workers)
+    w.join();
+  GD::end_hogwild(all, hogwild);
+
+  for (pass_thread& t : threads)
+  { if (t.error)
+      rethrow_exception(t.error);
+    all.sd->add_counts(t.counts.totals);
+  }
+  if (all.stats != nullptr)
+    dump_stats(all, index.examples);
+  examples = index.examples;
+  return true;
+#endif
+}
+
+void free_pass_threads(parser* p)
+{ if (p->pass_index == nullptr)
+    return;
+  p->pass_index->offsets.delete_v();
+  p->pass_index->firsts.delete_v();
+  free(p->pass_index);
+  p->pass_index = nullptr;
+}
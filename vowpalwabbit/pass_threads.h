@@ -0,0 +1,24 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+
+/* --pass_threads: the passes over a format 2 cache (--cache_format 2) which the parser would otherwise
+   read back one example at a time are learned by several threads. The blocks of the cache are indexed
+   once, then every thread takes the next unlearned block, decodes it and learns its examples
+   Hogwild style: all threads update the same weights without locks. Each thread sums its own loss and
+   example counts, they are added to all.sd at the end of the pass, so no progress is printed in between.
+
+   Only the default linear learner (gd under the scorer) with dense weights and without l1/l2
+   regularization is learned this way, other setups and the pass writing the cache are read serially. */
+
+struct vw;
+struct parser;
+
+// learns the pass which is about to start with --pass_threads threads, examples is set to the number of
+// examples learned. false if the pass can't be learned this way, then the parser reads it as usual.
+bool learn_pass_threads(vw& all, uint64_t& examples);
+void free_pass_threads(parser* p);
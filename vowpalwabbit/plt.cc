@@ -7,10 +7,7 @@
 #include <stdio.h>
 #include <sstream>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
 #include <algorithm>
-#include <queue>
 
 #include "reductions.h"
 #include "vw.h"
@@ -39,7 +36,13 @@ struct plt
 
   float* precision;
   uint32_t prediction_count;
-  v_array<polyprediction> preds;
+  v_array<polyprediction> preds; // of the children of a node
+
+  // reused from example to example
+  v_array<uint32_t> positive; // nodes on the paths to the labels, sorted
+  v_array<uint32_t> negative; // children of positive nodes which aren't positive
+  v_array<node> frontier; // nodes left to expand, a fifo for threshold and a heap for top_k predictions
+  v_array<node> positive_labels;
 };
 
 inline void learn_node(plt &p, uint32_t n, base_learner &base, example &ec)
@@ -58,50 +61,41 @@ void learn(plt &p, base_learner &base, example &ec)
   double weighted_holdout_examples = p.all->sd->weighted_holdout_examples;
   p.all->sd->weighted_holdout_examples = 0;
 
-  unordered_set<uint32_t> n_positive; // positive nodes
-  unordered_set<uint32_t> n_negative; // negative nodes
-
+  p.positive.erase();
+  p.negative.erase();
   if (multilabels.label_v.size() > 0)
   { for (uint32_t i = 0; i < multilabels.label_v.size(); ++i)
     { uint32_t tn = multilabels.label_v[i] + p.ti;
-      n_positive.insert(tn);
+      p.positive.push_back(tn);
       while (tn > 0) {
-        tn = floor(static_cast<float>(tn - 1) / p.kary);
-        n_positive.insert(tn);
+        tn = (tn - 1) / p.kary;
+        p.positive.push_back(tn);
       }
     }
     if (multilabels.label_v[multilabels.label_v.size()-1] >= p.k)
       cerr << "label " << multilabels.label_v[multilabels.label_v.size()-1] << " is not in {0," << p.k - 1 << "} This won't work right." << endl;
 
-    queue <uint32_t> n_queue; // nodes queue
-    n_queue.push(0);
-
-    while (!n_queue.empty()) {
-      uint32_t n = n_queue.front(); // current node index
-      n_queue.pop();
-
-      if (n < p.ti) {
-        for (uint32_t i = 1; i <= p.kary; ++i) {
-          uint32_t n_child = p.kary * n + i;
-
-          if (n_child < p.t) {
-            if (n_positive.find(n_child) != n_positive.end())
-              n_queue.push(n_child);
-            else
-              n_negative.insert(n_child);
-          }
-        }
-      }
+    sort(p.positive.begin(), p.positive.end());
+    p.positive.end() = unique(p.positive.begin(), p.positive.end());
+
+    // every ancestor of a positive node is positive, so the negative nodes are the other children of positive nodes
+    for (uint32_t n : p.positive)
+    { if (n >= p.ti)
+        break;
+      uint32_t n_end = min(p.kary * n + p.kary + 1, p.t);
+      for (uint32_t n_child = p.kary * n + 1; n_child < n_end; ++n_child)
+        if (!binary_search(p.positive.begin(), p.positive.end(), n_child))
+          p.negative.push_back(n_child);
     }
   } else
-    n_negative.insert(0);
+    p.negative.push_back(0);
 
   ec.l.simple = {1.f, 1.f, 0.f};
-  for (auto &n : n_positive)
+  for (uint32_t n : p.positive)
     learn_node(p, n, base, ec);
 
   ec.l.simple.label = -1.f;
-  for (auto &n : n_negative)
+  for (uint32_t n : p.negative)
     learn_node(p, n, base, ec);
 
   p.all->sd->t = t;
@@ -117,49 +111,56 @@ inline float predict_node(plt &p, uint32_t n, base_learner &base, example &ec)
   return 1.0f / (1.0f + exp(-ec.partial_prediction));
 }
 
+// scores all the children of internal node n in one call, into p.preds. returns the number of children.
+inline uint32_t predict_children(plt &p, uint32_t n, base_learner &base, example &ec)
+{ uint32_t n_child = p.kary * n + 1;
+  uint32_t children = min(p.kary, p.t - n_child);
+  ec.l.simple = {FLT_MAX, 1.f, 0.f};
+  base.multipredict(ec, n_child, children, p.preds.begin(), false);
+  return children;
+}
+
 template<bool threshold>
 void predict(plt &p, base_learner &base, example &ec)
 { MULTILABEL::labels multilabels = ec.l.multilabels;
   MULTILABEL::labels preds = ec.pred.multilabels;
   preds.label_v.erase();
+  p.frontier.erase();
 
   // threshold prediction
   if (threshold)
-  { vector <node> positive_labels;
-    queue <node> node_queue;
-    node_queue.push({0, 1.0f});
-
-    while (!node_queue.empty())
-    { node node = node_queue.front(); // current node
-      node_queue.pop();
-
-      float cp = node.p * predict_node(p, node.n, base, ec);
-
-      if (cp > p.threshold)
-      { if (node.n < p.ti)
-        { for (uint32_t i = 1; i <= p.kary; ++i)
-          { uint32_t n_child = p.kary * node.n + i;
-            node_queue.push({n_child, cp});
-          }
-        }
-        else {
-          uint32_t l = node.n - p.ti;
-          positive_labels.push_back({l, cp});
+  { p.positive_labels.erase();
+    float cp = predict_node(p, 0, base, ec);
+    if (cp > p.threshold)
+    { if (p.ti > 0)
+        p.frontier.push_back({0, cp});
+      else
+        p.positive_labels.push_back({0, cp});
+    }
+
+    // breadth first, the frontier only holds internal nodes over the threshold
+    for (size_t next = 0; next < p.frontier.size(); ++next)
+    { node node = p.frontier[next];
+      uint32_t children = predict_children(p, node.n, base, ec);
+      uint32_t n_child = p.kary * node.n + 1;
+      for (uint32_t i = 0; i < children; ++i, ++n_child)
+      { float cp_child = node.p * (1.0f / (1.0f + exp(-p.preds[i].scalar)));
+        if (cp_child > p.threshold)
+        { if (n_child < p.ti)
+            p.frontier.push_back({n_child, cp_child});
+          else
+            p.positive_labels.push_back({n_child - p.ti, cp_child});
         }
       }
     }
 
-    sort(positive_labels.rbegin(), positive_labels.rend());
-    for (auto p : positive_labels)
-      preds.label_v.push_back(p.n);
+    sort(p.positive_labels.begin(), p.positive_labels.end(), [](const node& a, const node& b) { return b < a; });
+    for (auto& l : p.positive_labels)
+      preds.label_v.push_back(l.n);
 
-    vector<uint32_t> true_labels;
-    for (uint32_t i = 0; i < multilabels.label_v.size(); ++i)
-      true_labels.push_back(multilabels.label_v[i]);
-
-    if (true_labels.size() > 0)
+    if (multilabels.label_v.size() > 0)
     { for (size_t i = 0; i < preds.label_v.size(); ++i)
-      { if (find(true_labels.begin(), true_labels.end(), preds.label_v[i]) != true_labels.end())
+      { if (find(multilabels.label_v.begin(), multilabels.label_v.end(), preds.label_v[i]) != multilabels.label_v.end())
           p.precision[0] += 1.0f;
       }
     }
@@ -169,58 +170,38 @@ void predict(plt &p, base_learner &base, example &ec)
 
   // top-k predictions
   else
-  { std::unordered_set<uint32_t> found_leaves;
-    priority_queue <node> node_queue;
-
-    node_queue.push({0, predict_node(p, 0, base, ec)});
-
-    // split labels into true and skip (those > max. label num)
-    std::unordered_set<uint32_t> true_labels;
-    std::unordered_set<uint32_t> skip_labels;
+  { // true labels are those < k, a label l >= k means l - k is skipped
+    bool has_true_labels = false;
     for (auto label : multilabels.label_v)
-    { if (label < p.k)
-        true_labels.insert(label);
-      else
-        skip_labels.insert(label - p.k);
-    }
-
-    while (!node_queue.empty())
-    { node node = node_queue.top();
-      node_queue.pop();
-
-      auto found_leaves_it = found_leaves.find(node.n);
-      if (found_leaves_it != found_leaves.end())
-      { uint32_t l = node.n - p.ti;
-        preds.label_v.push_back(l);
-        if (preds.label_v.size() >= p.top_k)
-          break;
+      has_true_labels |= label < p.k;
+
+    p.frontier.push_back({0, predict_node(p, 0, base, ec)});
+
+    // best first: every node in the heap is less probable than its parent, so a leaf at its top is
+    // more probable than all the labels not predicted yet
+    while (p.frontier.size() > 0 && preds.label_v.size() < p.top_k)
+    { pop_heap(p.frontier.begin(), p.frontier.end());
+      node node = p.frontier.pop();
+
+      if (node.n < p.ti)
+      { uint32_t children = predict_children(p, node.n, base, ec);
+        uint32_t n_child = p.kary * node.n + 1;
+        for (uint32_t i = 0; i < children; ++i, ++n_child)
+        { float cp_child = node.p * (1.0f / (1.0f + exp(-p.preds[i].scalar)));
+          p.frontier.push_back({n_child, cp_child});
+          push_heap(p.frontier.begin(), p.frontier.end());
+        }
       }
       else
-      { 
-        if (node.n < p.ti)
-        { uint32_t n_child = p.kary * node.n + 1;
-          ec.l.simple = {FLT_MAX, 1.f, 0.f};
-          base.multipredict(ec, n_child, p.kary, p.preds.begin(), false);
-
-          for (uint32_t i = 0; i < p.kary; ++i, ++n_child) {
-            float cp_child = node.p * (1.0f / (1.0f + exp(-p.preds[i].scalar)));
-            node_queue.push({n_child, cp_child});
-          }
-        }
-        else
-        { uint32_t l = node.n - p.ti;
-
-          if (skip_labels.find(l) == skip_labels.end())
-          { found_leaves.emplace_hint(found_leaves_it, node.n);
-            node_queue.push({node.n, node.p});
-          }
-        }
+      { uint32_t l = node.n - p.ti;
+        if (find(multilabels.label_v.begin(), multilabels.label_v.end(), l + p.k) == multilabels.label_v.end())
+          preds.label_v.push_back(l);
       }
     }
 
-    if (p.top_k > 0 && true_labels.size() > 0)
-    { for (size_t i = 0; i < p.top_k; ++i)
-      { if (find(true_labels.begin(), true_labels.end(), preds.label_v[i]) != true_labels.end())
+    if (p.top_k > 0 && has_true_labels)
+    { for (size_t i = 0; i < p.top_k && i < preds.label_v.size(); ++i)
+      { if (find(multilabels.label_v.begin(), multilabels.label_v.end(), preds.label_v[i]) != multilabels.label_v.end())
           p.precision[i] += 1.0f;
       }
     }
@@ -260,6 +241,10 @@ void finish(plt &p)
   free(p.nodes_t);
   free(p.precision);
   p.preds.delete_v();
+  p.positive.delete_v();
+  p.negative.delete_v();
+  p.frontier.delete_v();
+  p.positive_labels.delete_v();
 }
 
 void save_load_nodes(plt &p, io_buf &model_file, bool read, bool text)
@@ -309,7 +294,7 @@ LEARNER::base_learner* plt_setup(vw &all) //learner setup
   data.ti = data.t - data.k;
   *(all.file_options) << " --kary_tree " << data.kary;
 
-  data.preds.resize(data.k);
+  data.preds.resize(data.kary);
 
   if (all.vm.count("top_k"))
     data.top_k = all.vm["top_k"].as<uint32_t>();
@@ -0,0 +1,181 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <chrono>
+#include <vector>
+#include <iomanip>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "reduction_profile.h"
+#include "global_data.h"
+#include "learner.h"
+
+using namespace std;
+using namespace LEARNER;
+
+namespace
+{
+enum profiled_function { LEARN, PREDICT, UPDATE, MULTIPREDICT, PREDICT_BATCH, FINISH_EXAMPLE, FUNCTIONS };
+const char* function_names[FUNCTIONS] = { "learn", "predict", "update", "multipredict", "predict_batch", "finish_example" };
+
+// the time stamp counter, nanoseconds where there's none
+inline uint64_t ticks()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct call_profile
+{ uint64_t calls;
+  uint64_t inclusive; // ticks
+  uint64_t exclusive;
+};
+}
+
+struct profiled_learner
+{ reduction_profile* profile;
+  const char* name;
+  learn_data original;
+  finish_example_data original_finish;
+  call_profile functions[FUNCTIONS];
+};
+
+struct reduction_profile
+{ vector<profiled_learner*> learners; // from the top of the stack down
+  uint64_t nested; // ticks of the profiled calls made by the call being timed so far
+  uint64_t start_ticks;
+  chrono::steady_clock::time_point start;
+};
+
+namespace
+{
+// times a call to a function of a learner. the profiled calls it makes meanwhile are included in its
+// inclusive time only, itself in the inclusive time of the call it was made by.
+class call_timer
+{ reduction_profile& profile;
+  call_profile& function;
+  uint64_t outer_nested;
+  uint64_t start;
+
+public:
+  call_timer(profiled_learner& p, profiled_function f)
+    : profile(*p.profile), function(p.functions[f]), outer_nested(p.profile->nested)
+  { profile.nested = 0;
+    start = ticks();
+  }
+
+  ~call_timer()
+  { uint64_t time = ticks() - start;
+    function.calls++;
+    function.inclusive += time;
+    function.exclusive += time - profile.nested;
+    profile.nested = outer_nested + time;
+  }
+};
+
+void timed_learn(void* d, base_learner& base, example& ec)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, LEARN);
+  p.original.learn_f(p.original.data, base, ec);
+}
+
+void timed_predict(void* d, base_learner& base, example& ec)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, PREDICT);
+  p.original.predict_f(p.original.data, base, ec);
+}
+
+void timed_update(void* d, base_learner& base, example& ec)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, UPDATE);
+  p.original.update_f(p.original.data, base, ec);
+}
+
+void timed_multipredict(void* d, base_learner& base, example& ec, size_t count, size_t step, polyprediction* pred, bool finalize_predictions)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, MULTIPREDICT);
+  p.original.multipredict_f(p.original.data, base, ec, count, step, pred, finalize_predictions);
+}
+
+void timed_predict_batch(void* d, base_learner& base, example** ecs, size_t count)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, PREDICT_BATCH);
+  p.original.predict_batch_f(p.original.data, base, ecs, count);
+}
+
+void timed_finish_example(vw& all, void* d, example& ec)
+{ profiled_learner& p = *(profiled_learner*)d;
+  call_timer timer(p, FINISH_EXAMPLE);
+  p.original_finish.finish_example_f(all, p.original_finish.data, ec);
+}
+}
+
+void profile_reductions(vw& all)
+{ reduction_profile* profile = new reduction_profile();
+  for (base_learner* l = all.l; l != nullptr; l = l->reduces_to())
+  { profiled_learner* p = new profiled_learner();
+    p->profile = profile;
+    p->name = l->name != nullptr ? l->name : "?";
+
+    learn_data& functions = l->learn_functions();
+    p->original = functions;
+    functions.data = p;
+    functions.learn_f = timed_learn;
+    functions.predict_f = timed_predict;
+    functions.update_f = timed_update;
+    if (functions.multipredict_f != nullptr) // otherwise learner::multipredict calls predict
+      functions.multipredict_f = timed_multipredict;
+    if (functions.predict_batch_f != nullptr)
+      functions.predict_batch_f = timed_predict_batch;
+
+    finish_example_data& finish = l->finish_example_functions();
+    p->original_finish = finish;
+    finish.data = p;
+    finish.finish_example_f = timed_finish_example;
+
+    profile->learners.push_back(p);
+  }
+  profile->start_ticks = ticks();
+  profile->start = chrono::steady_clock::now();
+  all.profile = profile;
+}
+
+void print_reduction_profile(vw& all)
+{ if (all.profile == nullptr)
+    return;
+  reduction_profile& profile = *all.profile;
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - profile.start).count();
+  double seconds_per_tick = seconds > 0. ? seconds / (double)(ticks() - profile.start_ticks) : 0.;
+
+  all.trace_message << endl << "reduction profile, seconds with (inclusive) and without (exclusive) the reductions called:" << endl;
+  all.trace_message << left << setw(16) << "reduction" << setw(16) << "function" << right << setw(12) << "calls"
+                    << setw(14) << "inclusive" << setw(14) << "exclusive" << endl;
+  for (profiled_learner* p : profile.learners)
+    for (size_t f = 0; f < FUNCTIONS; f++)
+    { call_profile& c = p->functions[f];
+      if (c.calls == 0)
+        continue;
+      all.trace_message << left << setw(16) << p->name << setw(16) << function_names[f] << right << setw(12) << c.calls
+                        << fixed << setprecision(6) << setw(14) << c.inclusive * seconds_per_tick
+                        << setw(14) << c.exclusive * seconds_per_tick << endl;
+    }
+}
+
+void free_reduction_profile(vw& all)
+{ if (all.profile == nullptr)
+    return;
+  for (profiled_learner* p : all.profile->learners)
+    delete p;
+  delete all.profile;
+  all.profile = nullptr;
+}
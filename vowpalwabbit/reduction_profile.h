@@ -0,0 +1,22 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+
+/* --profile_reductions: the learn, predict, update, multipredict, predict_batch and finish_example
+   functions of every learner in the reduction stack are replaced by wrappers which count the calls and
+   time them with the time stamp counter, then call the original. At the end a table gives for every
+   reduction and function the calls, the inclusive time (with the reductions below) and the exclusive time
+   (without the calls to the functions of other reductions made meanwhile).
+
+   The functions are only replaced with --profile_reductions, the learners run unchanged otherwise. The
+   timers aren't shared between threads, so the examples are learned by a single thread. */
+
+struct vw;
+
+// wraps the functions of all.l and the learners below it
+void profile_reductions(vw& all);
+void print_reduction_profile(vw& all);
+void free_reduction_profile(vw& all);
@@ -27,6 +27,20 @@ inline void multipredict(scorer&, LEARNER::base_learner& base, example& ec, size
     pred[c].scalar = link(pred[c].scalar);
 }
 
+template <float (*link)(float in)>
+void predict_batch(scorer& s, LEARNER::base_learner& base, example** ecs, size_t count)
+{ for (size_t i=0; i<count; i++)
+    s.all->set_minmax(s.all->sd, ecs[i]->l.simple.label);
+  base.predict_batch(ecs, count);
+
+  for (size_t i=0; i<count; i++)
+  { example& ec = *ecs[i];
+    if(ec.weight > 0 && ec.l.simple.label != FLT_MAX)
+      ec.loss = s.all->loss->getLoss(s.all->sd, ec.pred.scalar, ec.l.simple.label) * ec.weight;
+    ec.pred.scalar = link(ec.pred.scalar);
+  }
+}
+
 void update(scorer& s, LEARNER::base_learner& base, example& ec)
 { s.all->set_minmax(s.all->sd, ec.l.simple.label);
   base.update(ec);
@@ -54,6 +68,7 @@ LEARNER::base_learner* scorer_setup(vw& all)
   LEARNER::base_learner* base = setup_base(all);
   LEARNER::learner<scorer>* l;
   void (*multipredict_f)(scorer&, LEARNER::base_learner&, example&, size_t, size_t, polyprediction*, bool) = multipredict<id>;
+  void (*predict_batch_f)(scorer&, LEARNER::base_learner&, example**, size_t) = predict_batch<id>;
 
   string link = vm["link"].as<string>();
   if (!vm.count("link") || link.compare("identity") == 0)
@@ -63,22 +78,26 @@ LEARNER::base_learner* scorer_setup(vw& all)
     l = &init_learner(&s, base, predict_or_learn<true, logistic>,
                       predict_or_learn<false, logistic>);
     multipredict_f = multipredict<logistic>;
+    predict_batch_f = predict_batch<logistic>;
   }
   else if (link.compare("glf1") == 0)
   { *all.file_options << " --link=glf1 ";
     l = &init_learner(&s, base, predict_or_learn<true, glf1>,
                       predict_or_learn<false, glf1>);
     multipredict_f = multipredict<glf1>;
+    predict_batch_f = predict_batch<glf1>;
   }
   else if (link.compare("poisson") == 0)
   { *all.file_options << " --link=poisson ";
     l = &init_learner(&s, base, predict_or_learn<true, expf>, predict_or_learn<false, expf>);
     multipredict_f = multipredict<expf>;
+    predict_batch_f = predict_batch<expf>;
   }
   else
     THROW("Unknown link function: " << link);
 
   l->set_multipredict(multipredict_f);
+  l->set_predict_batch(predict_batch_f);
   l->set_update(update);
   all.scorer = make_base(*l);
 
@@ -249,11 +249,17 @@ void SpanningTree::Run()
           fail_send(partial_nodeset.nodes[i].socket, &client_ports[parent[i]], sizeof(client_ports[parent[i]]));
         }
         else
-        { int bogus = -1;
+        { uint16_t bogus = (uint16_t)-1; // a port, the ring follows
           uint32_t bogus2 = -1;
           fail_send(partial_nodeset.nodes[i].socket, &bogus2, sizeof(bogus2));
           fail_send(partial_nodeset.nodes[i].socket, &bogus, sizeof(bogus));
         }
+        // the ring through the nodes in the order of the tree, for the nodes which allreduce around it
+        uint32_t ring_position = (uint32_t)i;
+        size_t next = (i + 1) % total;
+        fail_send(partial_nodeset.nodes[i].socket, &ring_position, sizeof(ring_position));
+        fail_send(partial_nodeset.nodes[i].socket, &partial_nodeset.nodes[next].client_ip, sizeof(partial_nodeset.nodes[next].client_ip));
+        fail_send(partial_nodeset.nodes[i].socket, &client_ports[next], sizeof(client_ports[next]));
         CLOSESOCK(partial_nodeset.nodes[i].socket);
       }
       free(client_ports);
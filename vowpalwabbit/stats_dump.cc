@@ -0,0 +1,117 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include "stats_dump.h"
+#include "global_data.h"
+#include "parser.h"
+#include "vw_exception.h"
+
+using namespace std;
+typedef chrono::steady_clock stats_clock;
+
+// the clock is read every few examples only
+const uint64_t examples_per_check = 64;
+
+struct stats_dump
+{ ofstream file;
+  string name;
+  double interval; // seconds
+  stats_clock::time_point start;
+  double next; // seconds since start of the next line
+  uint64_t unchecked; // examples since the clock was read
+  // at the previous line
+  double last_seconds;
+  uint64_t last_examples;
+  double last_sum_loss;
+  double last_labeled;
+};
+
+namespace
+{
+double since(const stats_dump& d)
+{ return chrono::duration<double>(stats_clock::now() - d.start).count();
+}
+
+// value, or null where it's undefined
+void json_number(ostream& out, double value, bool defined)
+{ if (defined)
+    out << value;
+  else
+    out << "null";
+}
+
+void write_line(vw& all, stats_dump& d, double seconds)
+{ shared_data& sd = *all.sd;
+  ring_usage ring = ring_snapshot(*all.p);
+  uint64_t examples = sd.example_number;
+  double labeled = sd.weighted_labeled_examples;
+  double interval = seconds - d.last_seconds;
+
+  ostream& out = d.file;
+  out << "{\"seconds\":" << seconds
+      << ",\"pass\":" << all.current_pass
+      << ",\"examples\":" << examples
+      << ",\"weighted_examples\":" << sd.weighted_examples()
+      << ",\"examples_per_second\":";
+  json_number(out, (examples - d.last_examples) / interval, interval > 0.);
+  out << ",\"average_loss\":";
+  json_number(out, sd.sum_loss / labeled, labeled > 0.);
+  out << ",\"since_last_loss\":";
+  json_number(out, (sd.sum_loss - d.last_sum_loss) / (labeled - d.last_labeled), labeled > d.last_labeled);
+  out << ",\"parse_seconds\":" << max(seconds - ring.parser_wait, 0.)
+      << ",\"learn_seconds\":" << max(seconds - ring.learner_wait, 0.)
+      << ",\"ring_used\":" << ring.used
+      << ",\"ring_size\":" << all.p->ring_size
+      << "}" << endl;
+  if (!out)
+    THROW("error: cannot write to --stats_file " << d.name);
+
+  d.last_seconds = seconds;
+  d.last_examples = examples;
+  d.last_sum_loss = sd.sum_loss;
+  d.last_labeled = labeled;
+}
+}
+
+void open_stats_dump(vw& all, const string& file, float interval)
+{ if (interval <= 0.f)
+    THROW("error: --stats_interval must be positive");
+  stats_dump* d = new stats_dump();
+  d->file.open(file.c_str(), ios::out | ios::app);
+  if (!d->file)
+  { delete d;
+    THROW("error: cannot open --stats_file " << file);
+  }
+  d->file.precision(6);
+  d->name = file;
+  d->interval = interval;
+  d->start = stats_clock::now();
+  d->next = interval;
+  all.stats = d;
+}
+
+void dump_stats(vw& all, uint64_t examples)
+{ stats_dump& d = *all.stats;
+  d.unchecked += examples;
+  if (d.unchecked < examples_per_check)
+    return;
+  d.unchecked = 0;
+  double seconds = since(d);
+  if (seconds < d.next)
+    return;
+  write_line(all, d, seconds);
+  d.next = seconds + d.interval;
+}
+
+void close_stats_dump(vw& all)
+{ if (all.stats == nullptr)
+    return;
+  write_line(all, *all.stats, since(*all.stats));
+  delete all.stats;
+  all.stats = nullptr;
+}
@@ -0,0 +1,30 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/* --stats_file: progress statistics for monitoring long runs, one JSON object per line appended every
+   --stats_interval seconds while examples are learned and once more when the run finishes:
+
+   {"seconds":12.0,"pass":1,"examples":1500000,"weighted_examples":1500000,"examples_per_second":125000,
+    "average_loss":0.31,"since_last_loss":0.29,"parse_seconds":11.2,"learn_seconds":7.9,"ring_used":212,
+    "ring_size":256}
+
+   examples_per_second and since_last_loss cover the examples since the previous line. parse_seconds and
+   learn_seconds are the time the parser and the learner were not blocked on the ring of parsed examples
+   since the run started, ring_used the examples parsed and not finished yet. A loss is null before the
+   first labeled example. Lines are written by the thread adding to all.sd, never by the threads learning
+   on their own totals, so the counts are those of the last progress update. */
+
+struct vw;
+struct stats_dump;
+
+void open_stats_dump(vw& all, const std::string& file, float interval);
+// appends a line when the interval elapsed, cheap otherwise. examples were learned since the last call.
+void dump_stats(vw& all, uint64_t examples = 1);
+// appends the final line and closes the file
+void close_stats_dump(vw& all);
@@ -3,9 +3,122 @@ Copyright (c) by respective owners including Yahoo!, Microsoft, and
 individual contributors. All rights reserved.  Released under a BSD
 license as described in the file LICENSE.
  */
+#include <vector>
 #include "example.h"
 #include "unique_sort.h"
 
+namespace
+{
+struct sort_item
+{ feature_index index;
+  feature_value value;
+  uint32_t position; // in the unsorted features, for the audit strings
+};
+
+// groups up to this size are insertion sorted on the stack
+const size_t small_group = 64;
+
+inline bool before(const sort_item& a, const sort_item& b)
+{ return a.index < b.index || (a.index == b.index && a.value < b.value);
+}
+
+void insertion_sort(sort_item* items, size_t n)
+{ for (size_t i = 1; i < n; i++)
+  { sort_item item = items[i];
+    size_t j = i;
+    for (; j > 0 && before(item, items[j - 1]); j--)
+      items[j] = items[j - 1];
+    items[j] = item;
+  }
+}
+
+// least significant digit first radix sort on the index, a byte per pass. Bytes which are 0 in all the
+// indices, or the same in all of them, take no pass. Returns the one of items and scratch sorted into.
+sort_item* radix_sort(sort_item* items, sort_item* scratch, size_t n, uint64_t index_bits)
+{ size_t offsets[256];
+  for (unsigned shift = 0; shift < 64 && (index_bits >> shift) != 0; shift += 8)
+  { if (((index_bits >> shift) & 0xff) == 0)
+      continue;
+    memset(offsets, 0, sizeof(offsets));
+    for (size_t i = 0; i < n; i++)
+      offsets[(items[i].index >> shift) & 0xff]++;
+    size_t sum = 0;
+    bool one_digit = false;
+    for (size_t d = 0; d < 256 && !one_digit; d++)
+    { size_t count = offsets[d];
+      one_digit = count == n;
+      offsets[d] = sum;
+      sum += count;
+    }
+    if (one_digit)
+      continue;
+    for (size_t i = 0; i < n; i++)
+      scratch[offsets[(items[i].index >> shift) & 0xff]++] = items[i];
+    std::swap(items, scratch);
+  }
+  // the sort is stable, equal indices are ordered by value as order_features does
+  for (size_t i = 0; i < n;)
+  { size_t j = i + 1;
+    while (j < n && items[j].index == items[i].index)
+      j++;
+    if (j - i > 1)
+      insertion_sort(items + i, j - i);
+    i = j;
+  }
+  return items;
+}
+
+// sorts fs and, with unique, keeps the first of equal indices in the same pass. false if fs is empty.
+bool sort_features(features& fs, uint64_t parse_mask, bool unique)
+{ size_t n = fs.indicies.size();
+  if (n == 0)
+    return false;
+
+  sort_item stack_items[small_group];
+  std::vector<sort_item> heap_items;
+  sort_item* items = stack_items;
+  if (n > small_group)
+  { heap_items.resize(2 * n);
+    items = heap_items.data();
+  }
+
+  uint64_t index_bits = 0;
+  for (size_t i = 0; i < n; i++)
+  { items[i].index = fs.indicies[i] & parse_mask;
+    items[i].value = fs.values[i];
+    items[i].position = (uint32_t)i;
+    index_bits |= items[i].index;
+  }
+  if (n > small_group)
+    items = radix_sort(items, items + n, n, index_bits);
+  else
+    insertion_sort(items, n);
+
+  bool audit = !fs.space_names.empty();
+  std::vector<audit_strings_ptr> names;
+  if (audit)
+    names.assign(fs.space_names.begin(), fs.space_names.end());
+
+  size_t kept = 0;
+  for (size_t i = 0; i < n; i++)
+  { if (unique && kept > 0 && items[i].index == fs.indicies[kept - 1])
+      continue;
+    fs.values[kept] = items[i].value;
+    fs.indicies[kept] = items[i].index;
+    if (audit)
+      fs.space_names[kept] = names[items[i].position];
+    kept++;
+  }
+  if (kept < n)
+    fs.truncate_to(kept);
+  return true;
+}
+}
+
+bool features::sort(uint64_t parse_mask)
+{ return sort_features(*this, parse_mask, false);
+}
+
 void unique_features(features& fs, int max)
 { if (fs.indicies.empty())
     return;
@@ -29,8 +142,7 @@ void unique_features(features& fs, int max)
 
 void unique_sort_features(uint64_t parse_mask, example* ae)
 { for (features& fs : *ae)
-    if (fs.sort(parse_mask))
-      unique_features(fs);
+    sort_features(fs, parse_mask, true);
 
   ae->sorted=true;
 }
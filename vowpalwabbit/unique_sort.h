@@ -7,6 +7,8 @@ license as described in the file LICENSE.
 #include "parser.h"
 #include "example.h"
 
+// sorts every group of ae by the masked index, keeping the first of equal indices, and sets ae->sorted.
+// With --sort_features the text parser calls it as it parses, setup_example for the other readers.
 void unique_sort_features(uint64_t parse_mask, example* ae);
 
 void unique_features(features& fs, int max = -1);
@@ -91,6 +91,10 @@ float get_confidence(example* ec);
 feature* get_features(vw& all, example* ec, size_t& feature_number);
 void return_features(feature* f);
 
+//predicts count examples at once, for reductions like scorer and gd once per batch instead of once per example.
+//read the predictions from the examples afterwards, e.g. with get_prediction.
+void predict_batch(vw& all, example** ecs, size_t count);
+
 void add_constant_feature(vw& all, example*ec);
 void add_label(example* ec, float label, float weight = 1, float base = 0);
 
@@ -247,6 +247,14 @@ VW_DLL_MEMBER float VW_CALLING_CONV VW_PredictCostSensitive(VW_HANDLE handle, VW
   return VW::get_cost_sensitive_prediction(ex);
 }
 
+VW_DLL_MEMBER void VW_CALLING_CONV VW_PredictBatch(VW_HANDLE handle, VW_EXAMPLE* examples, size_t count, float* predictions)
+{ vw * pointer = static_cast<vw*>(handle);
+  example ** ex = reinterpret_cast<example**>(examples);
+  VW::predict_batch(*pointer, ex, count);
+  for (size_t i = 0; i < count; i++)
+    predictions[i] = VW::get_prediction(ex[i]);
+}
+
 VW_DLL_MEMBER float VW_CALLING_CONV VW_Get_Weight(VW_HANDLE handle, size_t index, size_t offset)
 { vw* pointer = static_cast<vw*>(handle);
   return VW::get_weight(*pointer, (uint32_t) index, (uint32_t) offset);
@@ -0,0 +1,218 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include "weight_allocation.h"
+#include "vw_exception.h"
+#include "memory.h"
+#include <string.h>
+#include <fstream>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef __APPLE__
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3  // from linux/mempolicy.h, to not depend on libnuma
+#endif
+
+using namespace std;
+
+weight_allocation parse_weight_allocation(const string& name)
+{ if (name == "default")
+    return WEIGHTS_DEFAULT;
+  if (name == "thp")
+    return WEIGHTS_THP;
+  if (name == "hugetlb")
+    return WEIGHTS_HUGETLB;
+  if (name == "numa_interleave")
+    return WEIGHTS_NUMA_INTERLEAVE;
+  THROW("unknown --weight_allocation " << name << ", use one of default, thp, hugetlb or numa_interleave");
+}
+
+const char* weight_allocation_name(weight_allocation policy)
+{ switch (policy)
+  { case WEIGHTS_THP:
+      return "thp";
+    case WEIGHTS_HUGETLB:
+      return "hugetlb";
+    case WEIGHTS_NUMA_INTERLEAVE:
+      return "numa_interleave";
+    default:
+      return "default";
+  }
+}
+
+#ifndef _WIN32
+namespace
+{
+#ifdef __linux__
+size_t huge_page_size()
+{ ifstream meminfo("/proc/meminfo");
+  string key;
+  size_t kb;
+  while (meminfo >> key)
+    if (key == "Hugepagesize:" && meminfo >> kb)
+      return kb << 10;
+  return 2 << 20;
+}
+
+// madvise(MADV_HUGEPAGE) succeeds even when transparent huge pages are switched off system wide
+bool transparent_huge_pages_enabled()
+{ ifstream enabled("/sys/kernel/mm/transparent_hugepage/enabled");
+  string modes;
+  if (!getline(enabled, modes))
+    return false;
+  return modes.find("[never]") == string::npos;
+}
+
+// the online memory nodes as an mbind node mask, "0-1,3" becomes 0b1011
+vector<unsigned long> online_numa_nodes(size_t& node_count, size_t& max_node)
+{ vector<unsigned long> mask;
+  node_count = max_node = 0;
+  ifstream online("/sys/devices/system/node/online");
+  string ranges;
+  if (!getline(online, ranges))
+    return mask;
+  const size_t bits = 8 * sizeof(unsigned long);
+  for (const char* p = ranges.c_str(); *p != '\0';)
+  { char* end;
+    size_t first = strtoul(p, &end, 10), last = first;
+    if (end == p)
+      break;
+    if (*end == '-')
+    { p = end + 1;
+      last = strtoul(p, &end, 10);
+    }
+    for (size_t node = first; node <= last; node++)
+    { if (mask.size() <= node / bits)
+        mask.resize(node / bits + 1, 0);
+      mask[node / bits] |= 1UL << (node % bits);
+      node_count++;
+      max_node = node;
+    }
+    p = *end == ',' ? end + 1 : end;
+  }
+  return mask;
+}
+#endif
+
+size_t mapped_bytes(size_t count, weight_allocation policy)
+{ size_t page = (size_t)sysconf(_SC_PAGE_SIZE);
+#ifdef __linux__
+  if (policy == WEIGHTS_HUGETLB)
+    page = huge_page_size();
+#endif
+  return (count * sizeof(float) + page - 1) / page * page;
+}
+
+float* map_anonymous(size_t bytes, bool shared, int extra_flags)
+{ void* data = mmap(0, bytes, PROT_READ | PROT_WRITE, (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return data == MAP_FAILED ? nullptr : (float*)data;
+}
+}
+
+float* allocate_weights(size_t count, weight_allocation& policy, bool shared, bool lazy, bool& mapped)
+{ if (count == 0)
+    return nullptr;
+
+  float* data = nullptr;
+#ifdef __linux__
+  if (policy == WEIGHTS_HUGETLB)
+  { data = map_anonymous(mapped_bytes(count, WEIGHTS_HUGETLB), shared, MAP_HUGETLB);
+    if (data == nullptr)  // no or not enough reserved huge pages, the next best thing are transparent ones
+      policy = WEIGHTS_THP;
+  }
+  if (policy == WEIGHTS_NUMA_INTERLEAVE)
+  { size_t node_count, max_node;
+    vector<unsigned long> nodes = online_numa_nodes(node_count, max_node);
+    if (node_count > 1)
+    { size_t bytes = mapped_bytes(count, WEIGHTS_NUMA_INTERLEAVE);
+      data = map_anonymous(bytes, shared, 0);
+      // the policy has to be in place before the first touch of a page, the kernel zeroes them lazily
+      if (data != nullptr && syscall(SYS_mbind, data, bytes, MPOL_INTERLEAVE, nodes.data(), max_node + 2, 0) != 0)
+        policy = WEIGHTS_DEFAULT;
+    }
+    else
+      policy = WEIGHTS_DEFAULT;
+  }
+  if (policy == WEIGHTS_THP)
+  { size_t bytes = mapped_bytes(count, WEIGHTS_THP);
+    data = map_anonymous(bytes, shared, 0);
+    if (data != nullptr && (!transparent_huge_pages_enabled() || madvise(data, bytes, MADV_HUGEPAGE) != 0))
+      policy = WEIGHTS_DEFAULT;
+  }
+#else
+  policy = WEIGHTS_DEFAULT;
+#endif
+
+  if (data == nullptr && shared)
+  { policy = WEIGHTS_DEFAULT;
+    data = map_anonymous(mapped_bytes(count, WEIGHTS_DEFAULT), true, 0);
+    if (data == nullptr)
+      THROWERRNO("mmap of shared weights");
+  }
+  if (data == nullptr && lazy)
+  { // anonymous pages are zero and only backed by memory once written, unlike calloc'ed ones
+    policy = WEIGHTS_DEFAULT;
+    size_t bytes = mapped_bytes(count, WEIGHTS_DEFAULT);
+    data = map_anonymous(bytes, false, 0);
+#ifdef MADV_MERGEABLE
+    // see calloc_mergable_or_throw
+    if (data != nullptr && madvise(data, bytes, MADV_MERGEABLE) != 0)
+      fputs("internal warning: marking memory as ksm mergeable failed!\n", stderr);
+#endif
+  }
+
+  mapped = data != nullptr;
+  if (!mapped)
+  { policy = WEIGHTS_DEFAULT;
+    data = calloc_mergable_or_throw<float>(count);
+  }
+  return data;
+}
+
+void free_weights(float* data, size_t count, weight_allocation policy, bool mapped)
+{ if (data == nullptr)
+    return;
+  if (mapped)
+    munmap(data, mapped_bytes(count, policy));
+  else
+    free(data);
+}
+
+float* map_weights_file(int fd, size_t count, uint64_t offset)
+{ struct stat file;
+  size_t bytes = count * sizeof(float);
+  // pages past the end of the file would fault on first access
+  if (count == 0 || offset % sysconf(_SC_PAGE_SIZE) != 0 || fstat(fd, &file) != 0 || !S_ISREG(file.st_mode)
+      || (uint64_t)file.st_size < offset + bytes)
+    return nullptr;
+  void* data = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+  return data == MAP_FAILED ? nullptr : (float*)data;
+}
+#else
+float* allocate_weights(size_t count, weight_allocation& policy, bool, bool, bool& mapped)
+{ policy = WEIGHTS_DEFAULT;
+  mapped = false;
+  return calloc_mergable_or_throw<float>(count);
+}
+
+void free_weights(float* data, size_t, weight_allocation, bool)
+{ free(data);
+}
+
+float* map_weights_file(int, size_t, uint64_t)
+{ return nullptr;
+}
+#endif
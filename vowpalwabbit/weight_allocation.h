@@ -0,0 +1,33 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* Memory backing the dense weight vector, selected with --weight_allocation.
+   A policy the machine can't provide (no reserved huge pages, a single NUMA node, a kernel without
+   transparent huge pages) falls back to a weaker one instead of failing, allocate_weights returns
+   the policy that actually took effect. */
+enum weight_allocation
+{ WEIGHTS_DEFAULT,        // calloc'ed, or lazily zeroed anonymous pages when shared or lazy, marked KSM mergeable
+  WEIGHTS_THP,            // anonymous mapping advised to use transparent huge pages
+  WEIGHTS_HUGETLB,        // explicit huge pages from the reserved pool (MAP_HUGETLB)
+  WEIGHTS_NUMA_INTERLEAVE // pages interleaved round robin over all memory nodes
+};
+
+weight_allocation parse_weight_allocation(const std::string& name);
+const char* weight_allocation_name(weight_allocation policy);
+
+// zeroed memory for count floats. shared memory stays visible to forked children (daemon mode). lazy
+// memory isn't zeroed up front but by the kernel as pages are first touched, for weights a loaded model
+// is likely to replace with map_weights_file. policy is updated to the policy that took effect, mapped
+// tells free_weights how to release it.
+float* allocate_weights(size_t count, weight_allocation& policy, bool shared, bool lazy, bool& mapped);
+void free_weights(float* data, size_t count, weight_allocation policy, bool mapped);
+// copy-on-write mapping of count floats at offset of the regular file fd, nullptr if it can't be mapped.
+// released with free_weights(data, count, WEIGHTS_DEFAULT, true).
+float* map_weights_file(int fd, size_t count, uint64_t offset);
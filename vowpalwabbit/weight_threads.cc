@@ -0,0 +1,124 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "weight_threads.h"
+#include "global_data.h"
+
+using namespace std;
+
+struct weight_pool
+{ mutex lock;
+  condition_variable started; // of a pass, or of stopping
+  condition_variable finished; // the workers of the pass are done
+  vector<thread> threads;
+
+  uint64_t pass; // the passes started
+  const function<void(uint64_t, uint64_t)>* f; // of the pass
+  size_t pass_threads; // with the calling thread
+  uint64_t blocks;
+  uint64_t length;
+  size_t running; // workers of the pass which haven't finished
+  bool stopping;
+};
+
+namespace
+{
+// the range of thread t of threads splitting blocks of length weights
+uint64_t range_begin(uint64_t blocks, size_t t, size_t threads) { return blocks * t / threads * weight_block; }
+uint64_t range_end(uint64_t blocks, uint64_t length, size_t t, size_t threads)
+{ return t + 1 == threads ? length : range_begin(blocks, t + 1, threads);
+}
+
+// worker t takes range t of every pass split in more than t threads
+void work(weight_pool& w, size_t t)
+{ uint64_t seen = 0;
+  unique_lock<mutex> lock(w.lock);
+  while (true)
+  { w.started.wait(lock, [&] { return w.stopping || w.pass != seen; });
+    if (w.stopping)
+      return;
+    seen = w.pass;
+    if (t >= w.pass_threads)
+      continue;
+    uint64_t begin = range_begin(w.blocks, t, w.pass_threads);
+    uint64_t end = range_end(w.blocks, w.length, t, w.pass_threads);
+    const function<void(uint64_t, uint64_t)>& f = *w.f;
+    lock.unlock();
+    f(begin, end);
+    lock.lock();
+    if (--w.running == 0)
+      w.finished.notify_one();
+  }
+}
+
+weight_pool& workers_of(vw& all)
+{ if (all.weight_workers == nullptr)
+  { weight_pool* w = new weight_pool();
+    w->pass = 0;
+    w->f = nullptr;
+    w->pass_threads = 0;
+    w->blocks = 0;
+    w->length = 0;
+    w->running = 0;
+    w->stopping = false;
+    for (size_t t = 1; t < all.weight_threads; t++)
+      w->threads.push_back(thread(work, ref(*w), t));
+    all.weight_workers = w;
+  }
+  return *all.weight_workers;
+}
+}
+
+void for_weight_ranges(vw& all, size_t threads, uint64_t length, const function<void(uint64_t, uint64_t)>& f)
+{ uint64_t blocks = (length + weight_block - 1) / weight_block;
+  if (threads > blocks)
+    threads = (size_t)blocks;
+  if (threads > all.weight_threads)
+    threads = all.weight_threads;
+  if (threads <= 1)
+  { if (length > 0)
+      f((uint64_t)0, length);
+    return;
+  }
+
+  weight_pool& w = workers_of(all);
+  { lock_guard<mutex> lock(w.lock);
+    w.pass++;
+    w.f = &f;
+    w.pass_threads = threads;
+    w.blocks = blocks;
+    w.length = length;
+    w.running = threads - 1;
+  }
+  w.started.notify_all();
+  auto wait = [&]()
+  { unique_lock<mutex> lock(w.lock);
+    w.finished.wait(lock, [&] { return w.running == 0; });
+  };
+  try
+  { f((uint64_t)0, range_end(blocks, length, 0, threads));
+  }
+  catch (...)
+  { wait(); // the workers still call f
+    throw;
+  }
+  wait();
+}
+
+void free_weight_workers(weight_pool* workers)
+{ if (workers == nullptr)
+    return;
+  { lock_guard<mutex> lock(workers->lock);
+    workers->stopping = true;
+  }
+  workers->started.notify_all();
+  for (thread& t : workers->threads)
+    t.join();
+  delete workers;
+}
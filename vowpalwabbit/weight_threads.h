@@ -0,0 +1,26 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <functional>
+
+/* --weight_threads: passes over all the weights (the staging of their allreduces, the vectors of bfgs)
+   split them in contiguous ranges of whole blocks, one per thread. The blocks don't depend on the
+   number of threads, so sums made block by block and then added in block order come out the same
+   with any number of them. The threads other than the calling one are started by the first pass which
+   is split and wait for the next one until vw is finished, so the chunks of an allreduce and the sweeps
+   of bfgs don't each start and join threads. */
+
+struct vw;
+struct weight_pool;
+
+const uint64_t weight_block = 4096; // weights
+
+// calls f(begin, end) on ranges covering [0, length) in up to threads of all's workers, the calling thread
+// takes the first. f is called concurrently.
+void for_weight_ranges(vw& all, size_t threads, uint64_t length, const std::function<void(uint64_t, uint64_t)>& f);
+
+void free_weight_workers(weight_pool* workers);